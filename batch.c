@@ -0,0 +1,157 @@
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * ============================================================================
+ * Helpers
+ * ============================================================================
+ */
+
+/* Copies the current H of every listed run side by side into stack; returns the columns used */
+static int stack_H(symnmf_ctx **ctx, const int *list, int count, matrix *stack) {
+    const matrix *H;
+    int r, i, col;
+
+    col = 0;
+    for (r = 0; r < count; r++) {
+        H = ctx[list[r]]->H[ctx[list[r]]->cur];
+        for (i = 0; i < H->rows; i++) {
+            memcpy(MAT_ROW(stack, i) + col, MAT_ROW(H, i), H->cols * sizeof(double));
+        }
+        col += H->cols;
+    }
+
+    return col;
+}
+
+/* Hands every listed run its columns of the stacked product W * [H_1 | H_2 | ...] */
+static void unstack_WH(symnmf_ctx **ctx, const int *list, int count, const matrix *product) {
+    matrix *WH;
+    int r, i, col;
+
+    col = 0;
+    for (r = 0; r < count; r++) {
+        WH = ctx[list[r]]->WH;
+        for (i = 0; i < WH->rows; i++) {
+            memcpy(MAT_ROW(WH, i), MAT_ROW(product, i) + col, WH->cols * sizeof(double));
+        }
+        col += WH->cols;
+    }
+}
+
+/* W * [H_1 | H_2 | ...] over the listed runs, into product */
+static int stacked_multiply(const affinity *W, symnmf_ctx **ctx, const int *list, int count, matrix *stack,
+                            matrix *product, double *work, int threads) {
+    /* The blocks are sized for every run; the product uses the leading columns */
+    stack->cols = stack_H(ctx, list, count, stack);
+    product->cols = stack->cols;
+    if (affinity_multiply(W, stack, product, work, threads) != 0)
+        return 1;
+
+    unstack_WH(ctx, list, count, product);
+    return 0;
+}
+
+/* ||W - H H^T||_F^2 of the current H, with ctx->WH = W * H */
+static double objective(symnmf_ctx *ctx, double w_norm2) {
+    gram_matrix(ctx);
+    return objective_at(ctx, ctx->H[ctx->cur], w_norm2);
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+int calc_symnmf_batch(const affinity *W, int n, symnmf_run *runs, int nruns, int threads) {
+    symnmf_ctx **ctx;
+    matrix *stack, *product, *H;
+    double *work, residual, w_norm2;
+    int *active, r, i, count, total_k, failed;
+
+    /* The shared workspace holds one slice per thread */
+    if (threads < 1)
+        threads = 1;
+    total_k = 0;
+    for (r = 0; r < nruns; r++) {
+        runs[r].H = NULL;
+        runs[r].objective = 0.0;
+        runs[r].iterations = 0;
+        if (runs[r].k < 1 || runs[r].k >= n)
+            return 1;
+        total_k += runs[r].k;
+    }
+
+    ctx = calloc(nruns > 0 ? nruns : 1, sizeof(symnmf_ctx *));
+    active = calloc(nruns > 0 ? nruns : 1, sizeof(int));
+    stack = matrix_init(n, total_k > 0 ? total_k : 1);
+    product = matrix_init(n, total_k > 0 ? total_k : 1);
+    work = malloc((affinity_workspace_size(W, n, total_k, threads) + 1) * sizeof(double));
+    failed = !ctx || !active || !stack || !product || !work;
+
+    /* Every run owns a workspace, started from its own initial H */
+    for (r = 0; !failed && r < nruns; r++) {
+        H = init_H(W, n, runs[r].k, runs[r].seed, threads);
+        ctx[r] = H ? symnmf_ctx_init(W, H, threads, METHOD_MU) : NULL;
+        if (ctx[r] == NULL) {
+            free_matrix(H);
+            failed = 1;
+        }
+        active[r] = r;
+    }
+
+    /* Each iteration advances the unconverged runs, which stay at the front of active */
+    count = failed ? 0 : nruns;
+    for (i = 0; i < MAX_ITER && count > 0 && !failed; i++) {
+        failed = stacked_multiply(W, ctx, active, count, stack, product, work, threads);
+        for (r = 0; r < count && !failed; r++) {
+            residual = H_step(ctx[active[r]]);
+            runs[active[r]].iterations = i + 1;
+            if (residual < 0.0) {
+                failed = 1;
+            } else if (residual < EPS) {
+                /* Converged: drop the run, keeping the order of the rest */
+                memmove(active + r, active + r + 1, (count - r - 1) * sizeof(int));
+                count--;
+                r--;
+            }
+        }
+    }
+
+    /* One more shared product gives W * H of every final H for the objectives */
+    for (r = 0; !failed && r < nruns; r++) {
+        active[r] = r;
+    }
+    if (!failed)
+        failed = stacked_multiply(W, ctx, active, nruns, stack, product, work, threads);
+    w_norm2 = failed ? 0.0 : affinity_norm2(W, n);
+    for (r = 0; !failed && r < nruns; r++) {
+        runs[r].objective = objective(ctx[r], w_norm2);
+        runs[r].H = ctx[r]->H[ctx[r]->cur];
+        ctx[r]->H[ctx[r]->cur] = NULL;
+    }
+
+    for (r = 0; ctx != NULL && r < nruns; r++) {
+        symnmf_ctx_free(ctx[r]);
+    }
+    free(ctx);
+    free(active);
+    free_matrix(stack);
+    free_matrix(product);
+    free(work);
+    if (failed)
+        free_runs(runs, nruns);
+
+    return failed;
+}
+
+void free_runs(symnmf_run *runs, int nruns) {
+    int r;
+
+    for (r = 0; r < nruns; r++) {
+        free_matrix(runs[r].H);
+        runs[r].H = NULL;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "symnmf.h"
+
+/**
+ * @brief One SymNMF solve of a batch: its k and seed in, its H and fit out.
+ */
+struct symnmf_run {
+    int k;
+    unsigned long seed;
+    matrix *H;
+    double objective;
+    int iterations;
+};
+
+typedef struct symnmf_run symnmf_run;
+
+/*
+ * ============================================================================
+ * Batch Solver Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Runs several SymNMF solves against one W, for model selection over k and seeds.
+ * Each run starts from init_H with its own k and seed and iterates exactly as
+ * calc_symnmf would, but the W * H products of all unconverged runs are formed
+ * together as W * [H_1 | H_2 | ...], so W is read once per iteration for the batch.
+ * @param W The n x n normalized similarity matrix, in any storage format.
+ * @param n Number of points.
+ * @param runs The runs; k (1 <= k < n) and seed are read, and H (owned by the caller,
+ *             NULL on failure), objective ||W - H H^T||_F^2 and iterations are filled in.
+ * @param nruns Number of runs.
+ * @param threads Number of worker threads.
+ * @return 0 on success, 1 on invalid k or allocation failure.
+ */
+int calc_symnmf_batch(const affinity *W, int n, symnmf_run *runs, int nruns, int threads);
+
+/**
+ * @brief Frees the H matrices of a batch.
+ * @param runs The runs.
+ * @param nruns Number of runs.
+ */
+void free_runs(symnmf_run *runs, int nruns);
+
+#endif
@@ -0,0 +1,310 @@
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+import time
+import numpy as np
+
+GOALS = ["sym", "ddg", "norm", "symnmf"]
+
+# Stage names of the --stats JSON, in order
+STAGES = ["read", "sym", "ddg", "norm", "init", "solve", "write"]
+
+
+def generate_data(rng: np.random.Generator, n: int, dim: int, k: int) -> np.ndarray:
+    """
+    Draws a tester-style dataset: k Gaussian blobs around normal or uniform centers, rounded to 4 places.
+
+    Args:
+        rng (np.random.Generator): Source of randomness.
+        n (int): Number of points.
+        dim (int): Dimension of the points.
+        k (int): Number of blobs.
+    Returns:
+        np.ndarray: The data points, of shape (n, dim).
+    """
+    if rng.choice(2):
+        centers = rng.normal(scale=10.0, size=(k, dim))
+    else:
+        centers = rng.uniform(-10, 11, size=(k, dim))
+    return np.round(rng.choice(centers, n) + rng.standard_normal((n, dim)), 4)
+
+
+def nominal_flops(goal: str, n: int, dim: int, k: int, iterations: int, knn: int) -> float:
+    """
+    Floating-point operations a goal nominally needs, for GFLOP/s figures comparable across builds.
+    A is n^2 / 2 distances of 2d flops each and n^2 exponentials counted as one; the degrees and
+    the normalization add n^2 each. An iteration is W * H (2 n^2 k) plus H^T H and H (H^T H) (4 n k^2).
+    A kNN graph counts its at most 2 n knn stored entries in place of the n^2 ones.
+
+    Args:
+        goal (str): One of GOALS.
+        n (int): Number of points.
+        dim (int): Dimension of the points.
+        k (int): Number of clusters.
+        iterations (int): Iterations the solve ran, for symnmf.
+        knn (int): Neighbours per point of a sparse W, or 0 for a dense one.
+    Returns:
+        float: The flop count.
+    """
+    entries = 2.0 * n * knn if knn else float(n) * n
+    flops = entries * (dim + 1)
+    if goal in ("ddg", "norm", "symnmf"):
+        flops += entries
+    if goal in ("norm", "symnmf"):
+        flops += entries
+    if goal == "symnmf":
+        flops += iterations * (2.0 * entries * k + 4.0 * n * k * k)
+    return flops
+
+
+def summarize(times: list[float]) -> dict:
+    """
+    Median and 95th percentile of a list of timings.
+    """
+    return {"median": float(np.median(times)), "p95": float(np.percentile(times, 95))}
+
+
+def wait_rss(proc: subprocess.Popen) -> int:
+    """
+    Waits for a child and returns its ru_maxrss in bytes. On Linux this also counts the pages of this
+    driver the child held between fork and exec, so it is only the fallback where the child cannot
+    report its own peak (see own_peak_rss).
+    """
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+    return usage.ru_maxrss if sys.platform == "darwin" else usage.ru_maxrss * 1024
+
+
+def own_peak_rss() -> int:
+    """
+    Peak resident set size of this process since its exec, from VmHWM, as the CLI's --stats reports it.
+
+    Returns:
+        int: The peak in bytes, or 0 where /proc is not available.
+    """
+    try:
+        with open("/proc/self/status") as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1]) * 1024
+    except OSError:
+        pass
+    return 0
+
+
+def run_cli(args: argparse.Namespace, goal: str, path: str, k: int) -> tuple[float, int, dict]:
+    """
+    Runs the CLI once with --stats, its result discarded.
+
+    Returns:
+        tuple: (wall seconds, peak RSS in bytes as the CLI reports it, the --stats record)
+    """
+    command = [args.binary, "--stats", f"--threads={args.threads}"]
+    if args.knn:
+        command.append(f"--knn={args.knn}")
+    if goal == "symnmf":
+        command += [f"--k={k}", f"--method={args.method}"]
+    command += [goal, path]
+
+    start = time.perf_counter()
+    proc = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    err = proc.stderr.read()
+    rss = wait_rss(proc)
+    elapsed = time.perf_counter() - start
+    proc.stderr.close()
+    if proc.returncode != 0:
+        raise RuntimeError(f"{' '.join(command)} failed: {err.decode().strip()}")
+    record = json.loads(err.decode().strip().splitlines()[-1])
+    return elapsed, record.get("peak_rss_bytes") or rss, record
+
+
+def run_python(args: argparse.Namespace, goal: str, path: str, k: int) -> tuple[list[float], int, int]:
+    """
+    Times a mysymnmf wrapper in a fresh interpreter, which reports its own peak RSS.
+
+    Returns:
+        tuple: (seconds of each measured call, peak RSS in bytes, iterations of the last symnmf solve)
+    """
+    command = [sys.executable, __file__, "--worker", goal, path, str(k), "--threads", str(args.threads),
+               "--knn", str(args.knn), "--method", args.method, "--reps", str(args.reps), "--warmup",
+               str(args.warmup)]
+    proc = subprocess.Popen(command, stdout=subprocess.PIPE)
+    out = proc.stdout.read()
+    rss = wait_rss(proc)
+    proc.stdout.close()
+    if proc.returncode != 0:
+        raise RuntimeError(f"python worker for {goal} failed")
+    result = json.loads(out.decode())
+    return result["times"], result["peak_rss"] or rss, result["iterations"]
+
+
+def worker(args: argparse.Namespace):
+    """
+    Body of run_python: calls one wrapper warmup + reps times and prints the timings and its peak RSS as JSON.
+    """
+    import mysymnmf as symnmf
+
+    kwargs = {"threads": args.threads}
+    if args.knn:
+        kwargs["knn"] = args.knn
+    times, iterations = [], 0
+    for rep in range(args.warmup + args.reps):
+        start = time.perf_counter()
+        if args.goal == "symnmf":
+            _, stats = symnmf.fit(args.path, args.k, method=args.method, stats=True, **kwargs)
+            iterations = stats["iterations"]
+        else:
+            getattr(symnmf, args.goal)(args.path, **kwargs)
+        if rep >= args.warmup:
+            times.append(time.perf_counter() - start)
+    print(json.dumps({"times": times, "iterations": iterations, "peak_rss": own_peak_rss()}))
+
+
+def bench_case(args: argparse.Namespace, impl: str, goal: str, path: str, n: int, dim: int, k: int) -> dict:
+    """
+    Measures one goal on one dataset through the CLI ("c") or the module ("python").
+
+    Returns:
+        dict: The case, keyed for comparison with a baseline.
+    """
+    iterations, stages = 0, {}
+    if impl == "c":
+        times, rss, records = [], 0, []
+        for rep in range(args.warmup + args.reps):
+            elapsed, peak, record = run_cli(args, goal, path, k)
+            if rep >= args.warmup:
+                times.append(elapsed)
+                records.append(record)
+                rss = max(rss, peak)
+        iterations = records[-1]["iterations"]
+        stages = {s: float(np.median([r["seconds"][s] for r in records])) for s in STAGES}
+    else:
+        times, rss, iterations = run_python(args, goal, path, k)
+
+    summary = summarize(times)
+    case = {
+        "key": f"{impl}:{goal}:n={n}:d={dim}:k={k}",
+        "impl": impl,
+        "goal": goal,
+        "n": n,
+        "d": dim,
+        "k": k,
+        "median": summary["median"],
+        "p95": summary["p95"],
+        "gflops": nominal_flops(goal, n, dim, k, iterations, args.knn) / summary["median"] / 1e9,
+        "peak_rss": rss,
+        "iterations": iterations,
+    }
+    if stages:
+        case["stages"] = stages
+    return case
+
+
+def compare(cases: list[dict], baseline: dict, tolerance: float) -> int:
+    """
+    Prints the median of every case against a stored baseline.
+
+    Returns:
+        int: Number of cases slower than the baseline by more than tolerance.
+    """
+    stored = {c["key"]: c for c in baseline["cases"]}
+    regressions = 0
+    for case in cases:
+        if case["key"] not in stored:
+            continue
+        ratio = case["median"] / stored[case["key"]]["median"]
+        flag = "REGRESSION" if ratio > 1.0 + tolerance else ""
+        regressions += bool(flag)
+        print(f"{case['key']:>40} {stored[case['key']]['median']:>10.4f}s -> {case['median']:>10.4f}s "
+              f"{ratio:>6.2f}x {flag}")
+    return regressions
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Times the symnmf CLI goals and the mysymnmf wrappers.")
+    parser.add_argument("--n", type=int, nargs="+", default=[1000, 5000, 20000, 50000])
+    parser.add_argument("--d", type=int, nargs="+", default=[4, 16])
+    parser.add_argument("--k", type=int, nargs="+", default=[5, 20])
+    parser.add_argument("--goals", nargs="+", choices=GOALS, default=GOALS)
+    parser.add_argument("--impl", nargs="+", choices=["c", "python"], default=["c", "python"])
+    parser.add_argument("--reps", type=int, default=5, help="measured runs per case")
+    parser.add_argument("--warmup", type=int, default=1, help="discarded runs before them")
+    parser.add_argument("--threads", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--knn", type=int, default=0, help="sparse kNN affinities instead of dense ones")
+    parser.add_argument("--method", default="mu", help="solver engine of the symnmf goal")
+    parser.add_argument("--max-bytes", type=float, default=None,
+                        help="skip dense cases whose n x n W exceeds this (default: half the physical memory)")
+    parser.add_argument("--binary", default="./symnmf")
+    parser.add_argument("--seed", type=int, default=1234)
+    parser.add_argument("--output", help="JSON file to write the results to")
+    parser.add_argument("--baseline", help="JSON file from an earlier --output to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="slowdown flagged as a regression")
+    parser.add_argument("--worker", nargs=3, metavar=("GOAL", "PATH", "K"), help=argparse.SUPPRESS)
+    return parser.parse_args()
+
+
+def main():
+    """
+    Benchmarks every goal over the grid of n, d and k, and optionally checks it against a baseline.
+    Usage: python3 bench.py [--n N ...] [--d D ...] [--k K ...] [--output FILE] [--baseline FILE]
+    Exits with status 1 when a case regressed past the tolerance.
+    """
+    args = parse_args()
+    if args.worker:
+        args.goal, args.path, args.k = args.worker[0], args.worker[1], int(args.worker[2])
+        worker(args)
+        return
+    if args.max_bytes is None:
+        args.max_bytes = os.sysconf("SC_PHYS_PAGES") * os.sysconf("SC_PAGE_SIZE") / 2
+
+    rng = np.random.default_rng(args.seed)
+    cases = []
+    print(f"{'case':>40} {'median':>10} {'p95':>10} {'GFLOP/s':>8} {'RSS MiB':>8} {'iters':>5}")
+    with tempfile.TemporaryDirectory() as tmp:
+        for n in args.n:
+            for dim in args.d:
+                path = os.path.join(tmp, f"points_{n}_{dim}.txt")
+                ks = [k for k in args.k if k < n]
+                if not ks:
+                    continue
+                np.savetxt(path, generate_data(rng, n, dim, max(ks)), fmt="%.4f", delimiter=",")
+                for goal in args.goals:
+                    if not args.knn and 8.0 * n * n > args.max_bytes:
+                        print(f"{goal}:n={n}:d={dim}: skipped, dense W needs {8.0 * n * n / 2**30:.1f} GiB")
+                        continue
+                    # Only the solve depends on k
+                    for k in ks if goal == "symnmf" else ks[:1]:
+                        for impl in args.impl:
+                            case = bench_case(args, impl, goal, path, n, dim, k)
+                            cases.append(case)
+                            print(f"{case['key']:>40} {case['median']:>10.4f} {case['p95']:>10.4f} "
+                                  f"{case['gflops']:>8.2f} {case['peak_rss'] / 2**20:>8.1f} "
+                                  f"{case['iterations']:>5}")
+
+    result = {
+        "machine": {"platform": platform.platform(), "processor": platform.processor(), "cpus": os.cpu_count()},
+        "threads": args.threads,
+        "knn": args.knn,
+        "method": args.method,
+        "reps": args.reps,
+        "warmup": args.warmup,
+        "cases": cases,
+    }
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(result, f, indent=2)
+    if args.baseline:
+        with open(args.baseline) as f:
+            regressions = compare(cases, json.load(f), args.tolerance)
+        print(f"{regressions} regression(s) past {args.tolerance:.0%}")
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "gemm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * GEMM throughput benchmark: times C = A * B for the W*H shapes of a SymNMF
+ * iteration (n x n times n x k) and a square product, with the original
+ * textbook triple loop over double** as the reference.
+ * Usage: ./bench_gemm [n ...]
+ */
+
+/* Minimum wall time per measurement, in seconds */
+#define MIN_SECONDS 0.2
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The previous matrix_multiply: i-j-k loop over jagged rows */
+static void naive_multiply(double **A, double **B, double **C, int m, int k, int n) {
+    int i, j, p;
+
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < n; j++) {
+            C[i][j] = 0.0;
+            for (p = 0; p < k; p++) {
+                C[i][j] += A[i][p] * B[p][j];
+            }
+        }
+    }
+}
+
+static double **jagged(const double *data, int rows, int cols) {
+    double **rowsp;
+    int i;
+
+    rowsp = malloc(rows * sizeof(double *));
+    for (i = 0; i < rows; i++) {
+        rowsp[i] = malloc(cols * sizeof(double));
+        memcpy(rowsp[i], data + (size_t)i * cols, cols * sizeof(double));
+    }
+    return rowsp;
+}
+
+static void free_jagged(double **rowsp, int rows) {
+    int i;
+
+    for (i = 0; i < rows; i++) {
+        free(rowsp[i]);
+    }
+    free(rowsp);
+}
+
+/* Runs one shape with the naive loop and every supported kernel, printing GFLOP/s */
+static void bench_shape(int m, int k, int n) {
+    static const char *kernels[] = {"generic", "sse2", "avx2", "avx512"};
+    double *A, *B, *C, *ref, **Aj, **Bj, **Cj, *work, start, elapsed, flops, err;
+    int reps, r, i, q;
+    size_t t;
+
+    A = malloc((size_t)m * k * sizeof(double));
+    B = malloc((size_t)k * n * sizeof(double));
+    C = malloc((size_t)m * n * sizeof(double));
+    ref = malloc((size_t)m * n * sizeof(double));
+    work = malloc(gemm_workspace_size(n) * sizeof(double));
+    for (t = 0; t < (size_t)m * k; t++) {
+        A[t] = rand() / (double)RAND_MAX;
+    }
+    for (t = 0; t < (size_t)k * n; t++) {
+        B[t] = rand() / (double)RAND_MAX;
+    }
+    flops = 2.0 * m * n * k;
+
+    Aj = jagged(A, m, k);
+    Bj = jagged(B, k, n);
+    Cj = jagged(C, m, n);
+    reps = 0;
+    start = now();
+    do {
+        naive_multiply(Aj, Bj, Cj, m, k, n);
+        reps++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    for (i = 0; i < m; i++) {
+        memcpy(ref + (size_t)i * n, Cj[i], n * sizeof(double));
+    }
+    printf("%6d x %6d x %4d  %-8s %8.2f GFLOP/s\n", m, k, n, "naive", flops * reps / elapsed * 1e-9);
+    free_jagged(Aj, m);
+    free_jagged(Bj, k);
+    free_jagged(Cj, m);
+
+    for (q = 0; q < 4; q++) {
+        if (gemm_kernel_set(kernels[q]) != 0)
+            continue;
+
+        reps = 0;
+        start = now();
+        do {
+            gemm(m, n, k, A, k, B, n, C, n, work);
+            reps++;
+            elapsed = now() - start;
+        } while (elapsed < MIN_SECONDS);
+
+        err = 0.0;
+        for (r = 0; r < m * n; r++) {
+            if (C[r] - ref[r] > err)
+                err = C[r] - ref[r];
+            if (ref[r] - C[r] > err)
+                err = ref[r] - C[r];
+        }
+        printf("%6d x %6d x %4d  %-8s %8.2f GFLOP/s  (max abs diff %.1e)\n", m, k, n, kernels[q],
+               flops * reps / elapsed * 1e-9, err);
+    }
+
+    free(A);
+    free(B);
+    free(C);
+    free(ref);
+    free(work);
+}
+
+int main(int argc, char *argv[]) {
+    static const int default_sizes[] = {1000, 2000, 4000};
+    static const int ks[] = {4, 10};
+    int i, q, n, count;
+
+    count = argc > 1 ? argc - 1 : 3;
+    printf("%24s  %-8s %8s\n", "m x k x n", "kernel", "rate");
+    for (i = 0; i < count; i++) {
+        n = argc > 1 ? atoi(argv[i + 1]) : default_sizes[i];
+        for (q = 0; q < 2; q++) {
+            bench_shape(n, n, ks[q]); /* W * H */
+        }
+    }
+    bench_shape(512, 512, 512);
+
+    return 0;
+}
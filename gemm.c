@@ -0,0 +1,35 @@
+#include "gemm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+/* Whether the running CPU can execute the named kernel */
+static int kernel_supported(const char *name) {
+#ifdef GEMM_X86
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return 1;
+}
+
+/* The kernels, selection and driver of each precision */
+#define REAL_TEMPLATE "gemm_real.inc"
+#include "precision.h"
+
+int gemm_kernel_set(const char *name) {
+    /* Both precisions list the same kernels */
+    if (kernel_set(name) != 0)
+        return 1;
+    return kernel_set_f(name);
+}
+
+void gemm_kernel_init(void) {
+    gemm_kernel_get();
+    gemm_kernel_get_f();
+}
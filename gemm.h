@@ -0,0 +1,38 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stddef.h>
+
+/* Columns in one packed panel of B, one 64-byte line of elements; every micro-kernel produces MR x GEMM_NR tiles */
+#define GEMM_NR(real) ((int)(64 / sizeof(real)))
+
+/* Depth of one packed block of B, sized so a panel stays in L1 */
+#define GEMM_KC 256
+
+/* Largest row count (MR) of any micro-kernel */
+#define GEMM_MR_MAX 8
+
+/* Kernels, workspaces and drivers of each precision: gemm for double, gemm_f for float */
+#define REAL_TEMPLATE "gemm_real.h"
+#include "precision.h"
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Forces a micro-kernel by name ("generic", "sse2", "avx2" or "avx512") in both precisions.
+ * @param name The kernel name.
+ * @return 0 on success, 1 if the kernel is unknown or not supported by this CPU.
+ */
+int gemm_kernel_set(const char *name);
+
+/**
+ * @brief Picks the widest supported micro-kernel of both precisions.
+ * Call once before any worker thread runs so the lazy selection never races.
+ */
+void gemm_kernel_init(void);
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * GEMM declarations for one precision; instantiated through precision.h.
+ */
+
+/*
+ * ============================================================================
+ * Struct definitions
+ * ============================================================================
+ */
+
+/**
+ * @brief A register-blocked micro-kernel.
+ * Computes the MR x GEMM_NR tile ctile = A[0:MR, 0:kc] * Bp, where A is read in
+ * place with leading dimension lda and Bp is a kc x GEMM_NR panel with row
+ * stride ldbp (GEMM_NR when packed).
+ */
+typedef void (*R(gemm_kernel_fn))(int kc, const REAL *a, int lda, const REAL *bp, int ldbp, REAL *ctile);
+
+struct R(gemm_kernel) {
+    const char *name;
+    int mr;
+    R(gemm_kernel_fn) fn;
+};
+
+typedef struct R(gemm_kernel) R(gemm_kernel);
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Returns the active micro-kernel, picking the widest one the CPU supports on first use.
+ * The pick is not thread-safe; gemm_kernel_init makes it before any worker starts.
+ * @return The active kernel.
+ */
+const R(gemm_kernel) *R(gemm_kernel_get)(void);
+
+/**
+ * @brief Number of elements of scratch gemm needs for a product with n output columns.
+ * @param n Number of columns of B and C.
+ * @return The workspace size, in elements.
+ */
+size_t R(gemm_workspace_size)(int n);
+
+/**
+ * @brief Computes C = A * B for row-major operands using cache blocking and packed panels of B.
+ * @param m Rows of A and C.
+ * @param n Columns of B and C.
+ * @param k Columns of A and rows of B.
+ * @param A The m x k left operand.
+ * @param lda Row stride of A.
+ * @param B The k x n right operand.
+ * @param ldb Row stride of B.
+ * @param C The m x n output.
+ * @param ldc Row stride of C.
+ * @param work Scratch of gemm_workspace_size(n) elements, or NULL to allocate it per call.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int R(gemm)(int m, int n, int k, const REAL *A, int lda, const REAL *B, int ldb, REAL *C, int ldc, REAL *work);
+
+/**
+ * @brief Computes C += A * B; the operands are as for gemm.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int R(gemm_update)(int m, int n, int k, const REAL *A, int lda, const REAL *B, int ldb, REAL *C, int ldc,
+                   REAL *work);
+
+/**
+ * @brief Computes C += A * B without packing B, for operands already laid out in
+ * GEMM_NR-wide rows. Every row of B must be readable up to n rounded up to a
+ * multiple of GEMM_NR; the extra columns only feed discarded lanes.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int R(gemm_update_unpacked)(int m, int n, int k, const REAL *A, int lda, const REAL *B, int ldb, REAL *C, int ldc,
+                            REAL *work);
@@ -0,0 +1,237 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "half.h"
+#include "gemm.h"
+#include "parallel.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HALF_X86 1
+#include <immintrin.h>
+#endif
+
+/* The bit manipulation below assumes 16-bit shorts and 32-bit ints, as on every supported target */
+typedef char half_size_check[sizeof(unsigned short) == 2 && sizeof(unsigned int) == 4 ? 1 : -1];
+
+/* Shared state of the narrowing loop */
+struct narrow_job {
+    const matrix *mat;
+    half_matrix *out;
+};
+
+/* W * H for each precision: half_multiply for double and half_multiply_f for float */
+#define REAL_TEMPLATE "half_real.inc"
+#include "precision.h"
+
+/*
+ * ============================================================================
+ * Rounding
+ * ============================================================================
+ */
+
+/* Nearest integer to a non-negative v, ties to even */
+static double round_even(double v) {
+    double r;
+
+    r = floor(v);
+    if (v - r > 0.5 || (v - r == 0.5 && fmod(r, 2.0) != 0.0))
+        r += 1.0;
+    return r;
+}
+
+/*
+ * Exact rounding of any double: m = x / 2^(e - t) rounded, where e is the
+ * exponent of x (clamped to the smallest normal one) and t the number of
+ * stored mantissa bits. A carry out of m bumps the exponent.
+ */
+static unsigned short half_round(double x, int format) {
+    unsigned long sign, m;
+    double a;
+    int e, t, bias, emax;
+
+    t = format == HALF_BF16 ? 7 : 10;
+    bias = format == HALF_BF16 ? 127 : 15;
+    emax = format == HALF_BF16 ? 255 : 31;
+    sign = x < 0.0 || (x == 0.0 && 1.0 / x < 0.0) ? 0x8000UL : 0; /* keeps the sign of -0 */
+
+    if (x != x)
+        return (unsigned short)((unsigned long)emax << t | 1UL << (t - 1)); /* quiet NaN */
+    a = fabs(x);
+    if (a == 0.0 || (format == HALF_BF16 && a < FLT_MIN))
+        return (unsigned short)sign;
+    if (a > DBL_MAX)
+        return (unsigned short)(sign | (unsigned long)emax << t);
+
+    frexp(a, &e);
+    e--; /* a = 1.f * 2^e */
+    if (e < 1 - bias)
+        e = 1 - bias;
+    if (e > bias)
+        return (unsigned short)(sign | (unsigned long)emax << t);
+
+    m = (unsigned long)round_even(ldexp(a, t - e));
+    if (m == 1UL << (t + 1)) {
+        m >>= 1;
+        e++;
+    }
+    if (e > bias)
+        return (unsigned short)(sign | (unsigned long)emax << t);
+    if (m < 1UL << t)
+        return (unsigned short)(sign | m); /* subnormal */
+    return (unsigned short)(sign | (unsigned long)(e + bias) << t | (m - (1UL << t)));
+}
+
+/*
+ * ============================================================================
+ * Parallel Loop Body
+ * ============================================================================
+ */
+
+/* Rounds one PAR_ROWS block of rows */
+static void narrow_task(void *arg, int task, int worker) {
+    struct narrow_job *job;
+    const double *src;
+    unsigned short *dst;
+    int i, j, end;
+
+    job = arg;
+    (void)worker;
+    end = (task + 1) * PAR_ROWS < job->mat->rows ? (task + 1) * PAR_ROWS : job->mat->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        src = MAT_ROW(job->mat, i);
+        dst = MAT_ROW(job->out, i);
+        for (j = 0; j < job->mat->cols; j++) {
+            dst[j] = half_from_double(src[j], job->out->format);
+        }
+    }
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+half_matrix *half_init(int rows, int cols, int format) {
+    half_matrix *result;
+    size_t size;
+    void *block;
+
+    result = malloc(sizeof(half_matrix));
+    if (!result)
+        return NULL;
+
+    /* Pad rows to a whole number of aligned lines */
+    result->rows = rows;
+    result->cols = cols;
+    result->format = format;
+    result->stride = (cols + MATRIX_ALIGN / 2 - 1) / (MATRIX_ALIGN / 2) * (MATRIX_ALIGN / 2);
+
+    size = (size_t)rows * (size_t)result->stride * sizeof(unsigned short);
+    if (size == 0)
+        size = MATRIX_ALIGN;
+
+    if (posix_memalign(&block, MATRIX_ALIGN, size) != 0) {
+        free(result);
+        return NULL;
+    }
+    memset(block, 0, size);
+    result->data = block;
+
+    return result;
+}
+
+void free_half(half_matrix *mat) {
+    if (mat != NULL) {
+        free(mat->data);
+        free(mat);
+    }
+}
+
+int half_format_from_name(const char *name) {
+    if (strcmp(name, "fp16") == 0)
+        return HALF_FP16;
+    if (strcmp(name, "bf16") == 0)
+        return HALF_BF16;
+    return -1;
+}
+
+/*
+ * Normal results go through float: the conversion rounds the double once,
+ * and unless that float sits exactly on a 16-bit tie, rounding it again
+ * gives the same result as rounding the double. Ties and the remaining
+ * ranges take the exact path.
+ */
+unsigned short half_from_double(double x, int format) {
+    unsigned int bits, exponent;
+    float narrow;
+
+    if (!(fabs(x) >= FLT_MIN && fabs(x) <= FLT_MAX))
+        return half_round(x, format);
+
+    narrow = (float)x;
+    memcpy(&bits, &narrow, sizeof(bits));
+    if (format == HALF_BF16) {
+        if ((bits & 0xffffu) == 0x8000u)
+            return half_round(x, format);
+        return (unsigned short)((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+    }
+
+    /* binary16 normals have float exponents 113 .. 142 */
+    exponent = (bits >> 23) & 0xffu;
+    if (exponent < 113 || exponent > 142 || (bits & 0x1fffu) == 0x1000u)
+        return half_round(x, format);
+    return (unsigned short)((bits >> 16 & 0x8000u) |
+                            ((((bits & 0x7fffffffu) + 0xfffu + ((bits >> 13) & 1u)) >> 13) - (112u << 10)));
+}
+
+float half_to_float(unsigned short h, int format) {
+    unsigned int bits, exponent, mantissa;
+    float value;
+
+    if (format == HALF_BF16) {
+        bits = (unsigned int)h << 16;
+    } else {
+        exponent = (h >> 10) & 0x1fu;
+        mantissa = h & 0x3ffu;
+        if (exponent == 0) {
+            /* Zero or subnormal: mantissa * 2^-24, a normal float */
+            value = (float)ldexp((double)mantissa, -24);
+            return h & 0x8000u ? -value : value;
+        }
+        bits = (exponent == 31 ? 0xffu : exponent + 112) << 23 | mantissa << 13;
+        bits |= (unsigned int)(h & 0x8000u) << 16;
+    }
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+half_matrix *half_from_matrix(const matrix *mat, int format, int threads) {
+    struct narrow_job job;
+    half_matrix *result;
+
+    result = half_init(mat->rows, mat->cols, format);
+    if (result == NULL)
+        return NULL;
+
+    job.mat = mat;
+    job.out = result;
+    parallel_for(threads, (mat->rows + PAR_ROWS - 1) / PAR_ROWS, narrow_task, &job);
+
+    return result;
+}
+
+const char *half_kernel_name(void) {
+    static const char *name = NULL;
+
+    /* Both precisions pick from the same CPU features */
+    if (name == NULL) {
+        half_select_f();
+        name = half_select();
+    }
+    return name;
+}
@@ -0,0 +1,107 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include "symnmf.h"
+
+/* Entries of a row of W widened per kernel step: one 256-bit load */
+#define HALF_COLS 16
+
+/*
+ * ============================================================================
+ * 16-bit Storage Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Allocates a zeroed 16-bit matrix.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param format HALF_FP16 or HALF_BF16.
+ * @return A pointer to the matrix, or NULL on allocation failure.
+ */
+half_matrix *half_init(int rows, int cols, int format);
+
+/**
+ * @brief Frees a 16-bit matrix.
+ * @param mat The matrix to free (may be NULL).
+ */
+void free_half(half_matrix *mat);
+
+/**
+ * @brief Looks up a 16-bit format by name.
+ * @param name "fp16" or "bf16".
+ * @return HALF_FP16 or HALF_BF16, or -1 for an unknown name.
+ */
+int half_format_from_name(const char *name);
+
+/**
+ * @brief Rounds a double to the nearest 16-bit value, ties to even.
+ * bfloat16 results below FLT_MIN are flushed to zero, as float subnormals
+ * slow every kernel that reads them; binary16 keeps its subnormals, which
+ * widen to normal floats.
+ * @param x The value to round.
+ * @param format HALF_FP16 or HALF_BF16.
+ * @return The 16-bit encoding.
+ */
+unsigned short half_from_double(double x, int format);
+
+/**
+ * @brief Widens a 16-bit value to float; exact for both formats.
+ * @param h The 16-bit encoding.
+ * @param format HALF_FP16 or HALF_BF16.
+ * @return The value.
+ */
+float half_to_float(unsigned short h, int format);
+
+/**
+ * @brief Rounds a dense double matrix to a new 16-bit matrix.
+ * @param mat The matrix to convert.
+ * @param format HALF_FP16 or HALF_BF16.
+ * @param threads Number of worker threads.
+ * @return The 16-bit copy, or NULL on allocation failure.
+ */
+half_matrix *half_from_matrix(const matrix *mat, int format, int threads);
+
+/**
+ * @brief Number of doubles of per-worker scratch half_multiply needs.
+ * @param k The number of columns of H.
+ * @return The workspace size, in doubles.
+ */
+size_t half_workspace_size(int k);
+
+/**
+ * @brief Number of floats of per-worker scratch half_multiply_f needs.
+ * @param k The number of columns of H.
+ * @return The workspace size, in floats.
+ */
+size_t half_workspace_size_f(int k);
+
+/**
+ * @brief Returns the name of the active W * H kernel ("generic", "avx2" or "avx512").
+ * The kernel is picked on first use, which is not thread-safe; call this first
+ * when workers will share it.
+ * @return The kernel name.
+ */
+const char *half_kernel_name(void);
+
+/**
+ * @brief Writes W * H into out for a symmetric 16-bit W.
+ * The kernels widen W in registers as they stream it, so W is read from
+ * memory at two bytes per entry while H and the sums stay in double. Each
+ * row of out is summed in a fixed order, independent of the thread count.
+ * @param W The n x n symmetric 16-bit matrix.
+ * @param H The n x k dense matrix.
+ * @param out The n x k output.
+ * @param work Scratch of threads * half_workspace_size(k) doubles, or NULL to allocate it.
+ * @param threads Number of worker threads.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int half_multiply(const half_matrix *W, const matrix *H, matrix *out, double *work, int threads);
+
+/**
+ * @brief Single precision half_multiply: H, the sums and the scratch are float.
+ * @return 0 on success, 1 on allocation failure.
+ */
+int half_multiply_f(const half_matrix *W, const matrix_f *H, matrix_f *out, float *work, int threads);
+
+#endif
@@ -0,0 +1,271 @@
+#include "incremental.h"
+#include "parallel.h"
+#include "vmath.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* New rows of A and the columns they add to the old rows */
+struct append_job {
+    const matrix *points;
+    matrix *A;
+    const double *old_degrees;
+    double *degrees;
+    int n;
+    int m;
+};
+
+/*
+ * ============================================================================
+ * Parallel Loop Bodies
+ * ============================================================================
+ */
+
+/* Row n + task of A: exp(-0.5 ||x_i - x_j||^2) against every point, and its degree */
+static void new_row_task(void *arg, int task, int worker) {
+    struct append_job *job;
+    const double *x;
+    double *row, sum;
+    int i, j, total;
+
+    job = arg;
+    (void)worker;
+    i = job->n + task;
+    total = job->n + job->m;
+    x = MAT_ROW(job->points, i);
+    row = MAT_ROW(job->A, i);
+    for (j = 0; j < total; j++) {
+        row[j] = -0.5 * euclidean_distance(x, MAT_ROW(job->points, j), job->points->cols);
+    }
+    vexp(row, total);
+    row[i] = 0.0;
+
+    sum = 0.0;
+    for (j = 0; j < total; j++) {
+        sum += row[j];
+    }
+    job->degrees[i] = sum;
+}
+
+/* PAR_ROWS old rows: the new columns, mirrored from the new rows, added to their degrees */
+static void old_rows_task(void *arg, int task, int worker) {
+    struct append_job *job;
+    double *row, sum;
+    int i, j, end;
+
+    job = arg;
+    (void)worker;
+    end = (task + 1) * PAR_ROWS < job->n ? (task + 1) * PAR_ROWS : job->n;
+    for (j = task * PAR_ROWS; j < end; j++) {
+        row = MAT_ROW(job->A, j);
+        sum = job->old_degrees[j];
+        for (i = job->n; i < job->n + job->m; i++) {
+            row[i] = MAT_AT(job->A, i, j);
+            sum += row[i];
+        }
+        job->degrees[j] = sum;
+    }
+}
+
+/*
+ * ============================================================================
+ * Helpers
+ * ============================================================================
+ */
+
+/* W = diag(scale) * A * diag(scale) as an affinity view */
+static void scaled_affinity(const matrix *A, const double *scale, affinity *W) {
+    W->format = AFFINITY_SCALED;
+    W->dense = A;
+    W->csr = NULL;
+    W->packed = NULL;
+    W->half = NULL;
+    W->scale = scale;
+}
+
+/* D^-0.5 of a degree vector, into a new array */
+static double *scale_of(const double *degrees, int n) {
+    double *scale;
+
+    scale = malloc((n > 0 ? n : 1) * sizeof(double));
+    if (scale != NULL) {
+        memcpy(scale, degrees, n * sizeof(double));
+        inv_root(scale, n);
+    }
+    return scale;
+}
+
+/* A copy of A with room for capacity rows and columns */
+static matrix *grow_A(const matrix *A, int n, int capacity) {
+    matrix *grown;
+    int i;
+
+    grown = matrix_init(capacity, capacity);
+    if (grown == NULL)
+        return NULL;
+    for (i = 0; i < n; i++) {
+        memcpy(MAT_ROW(grown, i), MAT_ROW(A, i), n * sizeof(double));
+    }
+    grown->rows = n;
+    grown->cols = n;
+    return grown;
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+symnmf_state *state_init(matrix *points, int k, unsigned long seed, int threads) {
+    symnmf_state *state;
+    affinity W;
+    int n, i;
+
+    n = points->rows;
+    state = calloc(1, sizeof(symnmf_state));
+    if (state == NULL || k < 1 || k >= n) {
+        free(state);
+        free_matrix(points);
+        return NULL;
+    }
+    state->points = points;
+    state->n = n;
+    state->k = k;
+    state->capacity = n;
+
+    /* A and its degrees in one sweep; A is kept unnormalized */
+    state->degrees = malloc((n > 0 ? n : 1) * sizeof(double));
+    state->A = state->degrees ? calc_sym_ddg(points, state->degrees, threads) : NULL;
+    state->scale = state->A ? scale_of(state->degrees, n) : NULL;
+    if (state->scale == NULL) {
+        state_free(state);
+        return NULL;
+    }
+
+    /* A cold solve, from init_H's draws; the generator then continues where they stop */
+    scaled_affinity(state->A, state->scale, &W);
+    state->H = init_H(&W, n, k, seed, threads);
+    state->H = state->H ? calc_symnmf(&W, state->H, threads, METHOD_MU, NULL) : NULL;
+    if (state->H == NULL) {
+        state_free(state);
+        return NULL;
+    }
+    rng_seed(&state->rng, seed);
+    for (i = 0; i < n * k; i++) {
+        rng_double(&state->rng);
+    }
+
+    return state;
+}
+
+int state_append(symnmf_state *state, matrix *points, int threads) {
+    struct append_job job;
+    matrix *all, *A, A_view, *H;
+    double *degrees, *scale, mean, high;
+    rng_state rng;
+    affinity W;
+    int n, m, d, i, j, capacity;
+
+    n = state->n;
+    m = points->rows;
+    d = points->cols;
+    if (d != state->points->cols) {
+        free_matrix(points);
+        return 1;
+    }
+
+    /* The points, and A at a capacity that grows by half so appends copy it O(log n) times */
+    all = matrix_init(n + m, d);
+    for (i = 0; all != NULL && i < n + m; i++) {
+        memcpy(MAT_ROW(all, i), i < n ? MAT_ROW(state->points, i) : MAT_ROW(points, i - n), d * sizeof(double));
+    }
+    free_matrix(points);
+    capacity = state->capacity;
+    A = state->A;
+    if (n + m > capacity) {
+        capacity = capacity + capacity / 2 > n + m ? capacity + capacity / 2 : n + m;
+        A = grow_A(state->A, n, capacity);
+    }
+    degrees = malloc((n + m) * sizeof(double));
+    if (all == NULL || A == NULL || degrees == NULL) {
+        free_matrix(all);
+        if (A != state->A)
+            free_matrix(A);
+        free(degrees);
+        return 1;
+    }
+
+    /* The m x (n + m) block, then its transpose into the old rows with their degrees */
+    job.points = all;
+    job.A = A;
+    job.old_degrees = state->degrees;
+    job.degrees = degrees;
+    job.n = n;
+    job.m = m;
+    parallel_for(threads, m, new_row_task, &job);
+    parallel_for(threads, (n + PAR_ROWS - 1) / PAR_ROWS, old_rows_task, &job);
+
+    /* W of all n + m points as a view; state->A keeps its shape until the refit succeeds */
+    A_view = *A;
+    A_view.rows = n + m;
+    A_view.cols = n + m;
+    scale = scale_of(degrees, n + m);
+    scaled_affinity(&A_view, scale, &W);
+
+    /* Warm start: the previous H, with rows for the new points drawn as init_H draws them */
+    rng = state->rng;
+    mean = scale ? affinity_mean(&W, n + m, threads) : -1.0;
+    H = mean < 0.0 ? NULL : matrix_init(n + m, state->k);
+    if (H != NULL) {
+        high = 2.0 * sqrt(mean / (double)state->k);
+        for (i = 0; i < n; i++) {
+            memcpy(MAT_ROW(H, i), MAT_ROW(state->H, i), state->k * sizeof(double));
+        }
+        for (i = n; i < n + m; i++) {
+            for (j = 0; j < state->k; j++) {
+                MAT_AT(H, i, j) = rng_uniform(&rng, 0.0, high);
+            }
+        }
+        H = calc_symnmf(&W, H, threads, METHOD_MU, NULL);
+    }
+    if (H == NULL) {
+        free_matrix(all);
+        if (A != state->A)
+            free_matrix(A);
+        free(degrees);
+        free(scale);
+        return 1;
+    }
+
+    /* Commit */
+    if (A != state->A)
+        free_matrix(state->A);
+    state->A = A;
+    state->A->rows = n + m;
+    state->A->cols = n + m;
+    free_matrix(state->points);
+    state->points = all;
+    free(state->degrees);
+    state->degrees = degrees;
+    free(state->scale);
+    state->scale = scale;
+    free_matrix(state->H);
+    state->H = H;
+    state->rng = rng;
+    state->n = n + m;
+    state->capacity = capacity;
+
+    return 0;
+}
+
+void state_free(symnmf_state *state) {
+    if (state != NULL) {
+        free_matrix(state->points);
+        free_matrix(state->A);
+        free(state->degrees);
+        free(state->scale);
+        free_matrix(state->H);
+        free(state);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "rng.h"
+#include "symnmf.h"
+
+/**
+ * @brief A SymNMF fit that grows as points are appended.
+ * A holds the unnormalized similarity matrix of the n points with room for
+ * capacity rows and columns, and W is used as diag(scale) * A * diag(scale),
+ * so new points only add rows and columns to A and change the degrees, never
+ * the stored entries. rng continues the draws of the initial H.
+ */
+struct symnmf_state {
+    matrix *points;
+    matrix *A;
+    double *degrees;
+    double *scale;
+    matrix *H;
+    rng_state rng;
+    int n;
+    int k;
+    int capacity;
+};
+
+typedef struct symnmf_state symnmf_state;
+
+/*
+ * ============================================================================
+ * Incremental Fit Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Starts an incremental fit: A and its degrees from the points, then a cold solve.
+ * @param points The n x d matrix of data points, kept by the state.
+ * @param k Number of clusters (1 <= k < n).
+ * @param seed Seed of the initial H, as for init_H.
+ * @param threads Number of worker threads.
+ * @return The state, or NULL on invalid k or allocation failure (points are then freed).
+ */
+symnmf_state *state_init(matrix *points, int k, unsigned long seed, int threads);
+
+/**
+ * @brief Appends m points and refits from the previous H.
+ * Only the m x (n + m) block of A is computed; the degrees of the old points
+ * gain the new columns and the scaling is recomputed in O(n). H keeps its rows,
+ * gets freshly drawn rows for the new points, and is solved from there.
+ * @param state The state; unchanged on failure.
+ * @param points The m x d matrix of new points, freed here.
+ * @param threads Number of worker threads.
+ * @return 0 on success, 1 on a dimension mismatch or allocation failure.
+ */
+int state_append(symnmf_state *state, matrix *points, int threads);
+
+/**
+ * @brief Frees a state and everything it holds.
+ * @param state The state (may be NULL).
+ */
+void state_free(symnmf_state *state);
+
+#endif
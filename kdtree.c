@@ -0,0 +1,294 @@
+#include "kdtree.h"
+#include <stdlib.h>
+
+/* State of one neighbour query */
+struct kd_query {
+    const kdtree *tree;
+    const double *q;
+    int self;
+    int k;
+    int size;
+    double *dist;
+    int *idx;
+    double r2;
+    int *out;
+    size_t count;
+};
+
+/*
+ * ============================================================================
+ * Construction
+ * ============================================================================
+ */
+
+/* Orders perm entries a and b by coordinate dim, then by index */
+static int kd_less(const matrix *X, int dim, int a, int b) {
+    double xa, xb;
+
+    xa = MAT_AT(X, a, dim);
+    xb = MAT_AT(X, b, dim);
+    return xa < xb || (xa == xb && a < b);
+}
+
+/* Partially sorts perm[begin .. end) so that perm[nth] is in its sorted position */
+static void kd_select(const matrix *X, int dim, int *perm, int begin, int end, int nth) {
+    int lo, hi, i, store, pivot, tmp;
+
+    lo = begin;
+    hi = end - 1;
+    while (lo < hi) {
+        /* Lomuto partition around the middle element */
+        pivot = perm[lo + (hi - lo) / 2];
+        perm[lo + (hi - lo) / 2] = perm[hi];
+        perm[hi] = pivot;
+        store = lo;
+        for (i = lo; i < hi; i++) {
+            if (kd_less(X, dim, perm[i], pivot)) {
+                tmp = perm[i];
+                perm[i] = perm[store];
+                perm[store++] = tmp;
+            }
+        }
+        perm[hi] = perm[store];
+        perm[store] = pivot;
+
+        if (store == nth)
+            return;
+        if (store < nth)
+            lo = store + 1;
+        else
+            hi = store - 1;
+    }
+}
+
+/* Builds the subtree over perm[begin .. end) and returns its node index */
+static int kd_build_node(kdtree *tree, int begin, int end) {
+    const matrix *X;
+    struct kd_node *node;
+    double lo, hi, spread, best;
+    int id, i, c, mid;
+
+    X = tree->points;
+    id = tree->nnodes++;
+    node = tree->nodes + id;
+    node->begin = begin;
+    node->end = end;
+    node->left = -1;
+    node->right = -1;
+    node->dim = 0;
+    node->split = 0.0;
+    if (end - begin <= KD_LEAF_SIZE)
+        return id;
+
+    /* Split on the coordinate with the widest spread */
+    best = -1.0;
+    for (c = 0; c < X->cols; c++) {
+        lo = hi = MAT_AT(X, tree->perm[begin], c);
+        for (i = begin + 1; i < end; i++) {
+            if (MAT_AT(X, tree->perm[i], c) < lo)
+                lo = MAT_AT(X, tree->perm[i], c);
+            if (MAT_AT(X, tree->perm[i], c) > hi)
+                hi = MAT_AT(X, tree->perm[i], c);
+        }
+        spread = hi - lo;
+        if (spread > best) {
+            best = spread;
+            node->dim = c;
+        }
+    }
+
+    mid = begin + (end - begin) / 2;
+    kd_select(X, node->dim, tree->perm, begin, end, mid);
+    node->split = MAT_AT(X, tree->perm[mid], node->dim);
+
+    /* nodes is allocated up front, so node stays valid across the recursion */
+    node->left = kd_build_node(tree, begin, mid);
+    node->right = kd_build_node(tree, mid, end);
+
+    return id;
+}
+
+/*
+ * ============================================================================
+ * Queries
+ * ============================================================================
+ */
+
+/* Orders candidates by distance, breaking ties by index so results are deterministic */
+static int closer(double da, int ia, double db, int ib) {
+    return da < db || (da == db && ia < ib);
+}
+
+/* Offers a candidate to a max-heap holding the cap closest points seen so far */
+static void heap_offer(double *dist, int *idx, int *size, int cap, double d, int j) {
+    int pos, child, parent;
+
+    if (*size < cap) {
+        /* Sift the new leaf up */
+        pos = (*size)++;
+        while (pos > 0) {
+            parent = (pos - 1) / 2;
+            if (!closer(dist[parent], idx[parent], d, j))
+                break;
+            dist[pos] = dist[parent];
+            idx[pos] = idx[parent];
+            pos = parent;
+        }
+        dist[pos] = d;
+        idx[pos] = j;
+        return;
+    }
+
+    if (cap == 0 || !closer(d, j, dist[0], idx[0]))
+        return;
+
+    /* Replace the farthest entry and sift it down */
+    pos = 0;
+    for (;;) {
+        child = 2 * pos + 1;
+        if (child >= cap)
+            break;
+        if (child + 1 < cap && closer(dist[child], idx[child], dist[child + 1], idx[child + 1]))
+            child++;
+        if (!closer(d, j, dist[child], idx[child]))
+            break;
+        dist[pos] = dist[child];
+        idx[pos] = idx[child];
+        pos = child;
+    }
+    dist[pos] = d;
+    idx[pos] = j;
+}
+
+/*
+ * Both searches visit the near child first and the far one only if the gap to
+ * the splitting plane does not exceed the current bound. The squared gap never
+ * exceeds the computed distance of any point beyond the plane, so the pruning
+ * is exact in floating point.
+ */
+static void kd_knn_node(struct kd_query *qs, int id) {
+    const struct kd_node *node;
+    const matrix *X;
+    double diff;
+    int p, j;
+
+    node = qs->tree->nodes + id;
+    X = qs->tree->points;
+    if (node->left < 0) {
+        for (p = node->begin; p < node->end; p++) {
+            j = qs->tree->perm[p];
+            if (j != qs->self)
+                heap_offer(qs->dist, qs->idx, &qs->size, qs->k, euclidean_distance(qs->q, MAT_ROW(X, j), X->cols), j);
+        }
+        return;
+    }
+
+    diff = qs->q[node->dim] - node->split;
+    kd_knn_node(qs, diff <= 0 ? node->left : node->right);
+    if (qs->size < qs->k || diff * diff <= qs->dist[0])
+        kd_knn_node(qs, diff <= 0 ? node->right : node->left);
+}
+
+static void kd_radius_node(struct kd_query *qs, int id) {
+    const struct kd_node *node;
+    const matrix *X;
+    double diff;
+    int p, j;
+
+    node = qs->tree->nodes + id;
+    X = qs->tree->points;
+    if (node->left < 0) {
+        for (p = node->begin; p < node->end; p++) {
+            j = qs->tree->perm[p];
+            if (j != qs->self && euclidean_distance(qs->q, MAT_ROW(X, j), X->cols) <= qs->r2) {
+                if (qs->out)
+                    qs->out[qs->count] = j;
+                qs->count++;
+            }
+        }
+        return;
+    }
+
+    diff = qs->q[node->dim] - node->split;
+    kd_radius_node(qs, diff <= 0 ? node->left : node->right);
+    if (diff * diff <= qs->r2)
+        kd_radius_node(qs, diff <= 0 ? node->right : node->left);
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x, y;
+
+    x = *(const int *)a;
+    y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+kdtree *kdtree_build(const matrix *points) {
+    kdtree *tree;
+    int i, n;
+
+    n = points->rows;
+    tree = malloc(sizeof(kdtree));
+    if (tree == NULL)
+        return NULL;
+
+    tree->points = points;
+    tree->nnodes = 0;
+    tree->perm = malloc(((size_t)n + 1) * sizeof(int));
+    tree->nodes = malloc((2 * (size_t)n + 1) * sizeof(struct kd_node));
+    if (!tree->perm || !tree->nodes) {
+        kdtree_free(tree);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        tree->perm[i] = i;
+    }
+    kd_build_node(tree, 0, n);
+
+    return tree;
+}
+
+void kdtree_free(kdtree *tree) {
+    if (tree != NULL) {
+        free(tree->perm);
+        free(tree->nodes);
+        free(tree);
+    }
+}
+
+void kdtree_knn(const kdtree *tree, int i, int k, double *dist, int *idx) {
+    struct kd_query qs;
+
+    qs.tree = tree;
+    qs.q = MAT_ROW(tree->points, i);
+    qs.self = i;
+    qs.k = k;
+    qs.size = 0;
+    qs.dist = dist;
+    qs.idx = idx;
+    if (k > 0)
+        kd_knn_node(&qs, 0);
+}
+
+size_t kdtree_radius(const kdtree *tree, int i, double r2, int *out) {
+    struct kd_query qs;
+
+    qs.tree = tree;
+    qs.q = MAT_ROW(tree->points, i);
+    qs.self = i;
+    qs.r2 = r2;
+    qs.out = out;
+    qs.count = 0;
+    kd_radius_node(&qs, 0);
+    if (out)
+        qsort(out, qs.count, sizeof(int), compare_ints);
+
+    return qs.count;
+}
@@ -0,0 +1,82 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include "symnmf.h"
+
+/* Most points held by one leaf of the tree */
+#define KD_LEAF_SIZE 16
+
+/*
+ * ============================================================================
+ * Struct definitions
+ * ============================================================================
+ */
+
+/**
+ * @brief One node of a k-d tree: the points perm[begin .. end).
+ * Inner nodes split on coordinate dim at value split; the left child holds the
+ * points with coordinate <= split. Leaves have left == right == -1.
+ */
+struct kd_node {
+    int begin;
+    int end;
+    int dim;
+    double split;
+    int left;
+    int right;
+};
+
+/**
+ * @brief A k-d tree over the rows of a borrowed point matrix.
+ */
+struct kdtree {
+    const matrix *points;
+    int *perm;
+    struct kd_node *nodes;
+    int nnodes;
+};
+
+typedef struct kdtree kdtree;
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Builds a k-d tree by median splits on the coordinate of widest spread.
+ * @param points The n x d matrix of points; must outlive the tree.
+ * @return A pointer to the tree, or NULL on allocation failure.
+ */
+kdtree *kdtree_build(const matrix *points);
+
+/**
+ * @brief Frees a k-d tree.
+ * @param tree The tree to free (may be NULL).
+ */
+void kdtree_free(kdtree *tree);
+
+/**
+ * @brief Finds the k nearest neighbours of point i, other than i itself.
+ * Distances are squared euclidean, ties are broken by the smaller index, so the
+ * result is the same as an exhaustive search.
+ * @param tree The tree.
+ * @param i The query point (a row of the tree's matrix).
+ * @param k The number of neighbours, at most n - 1.
+ * @param dist Output of k squared distances, in max-heap order.
+ * @param idx Output of the k neighbour indices, matching dist.
+ */
+void kdtree_knn(const kdtree *tree, int i, int k, double *dist, int *idx);
+
+/**
+ * @brief Finds the points j != i with squared distance to point i at most r2.
+ * @param tree The tree.
+ * @param i The query point.
+ * @param r2 The squared search radius.
+ * @param out Output of the neighbour indices in increasing order, or NULL to only count them.
+ * @return The number of neighbours found.
+ */
+size_t kdtree_radius(const kdtree *tree, int i, double r2, int *out);
+
+#endif
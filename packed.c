@@ -0,0 +1,333 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "packed.h"
+#include "gemm.h"
+#include "parallel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Shared state of the packed row loops and the SYMM kernel */
+struct packed_job {
+    const sym_packed *P;
+    sym_packed *A;
+    const matrix *H;
+    double *Ht;
+    matrix *out;
+    const double *vec;
+    double *acc;
+    int slices;
+    int first[SYMM_SLICES + 1];
+};
+
+/* Doubles per slice: the n x k accumulator, its k x n transposed twin, and GEMM scratch */
+static size_t symm_slice_size(int n, int k) {
+    return 2 * (size_t)n * k + gemm_workspace_size(k > SYM_TILE ? k : SYM_TILE);
+}
+
+/* Slices of an order-n SYMM: one per block row up to SYMM_SLICES, as more would stay empty */
+static int symm_slices(int n) {
+    int nblocks;
+
+    nblocks = (n + SYM_TILE - 1) / SYM_TILE;
+    if (nblocks > SYMM_SLICES)
+        return SYMM_SLICES;
+    return nblocks > 1 ? nblocks : 1;
+}
+
+/* Bytes of the tiles of a packed matrix of nblocks block rows */
+static size_t packed_size(int nblocks) {
+    return (size_t)nblocks * (nblocks + 1) / 2 * SYM_TILE * SYM_TILE * sizeof(double);
+}
+
+/*
+ * ============================================================================
+ * Parallel Loop Bodies
+ * ============================================================================
+ */
+
+/* A_ij <- d_i * A_ij * d_j over the tiles of one block row */
+static void norm_packed_task(void *arg, int task, int worker) {
+    struct packed_job *job;
+    double *tile, scale;
+    int bj, r, c, r0, c0, rows, cols, n;
+
+    job = arg;
+    (void)worker;
+    n = job->A->n;
+    r0 = task * SYM_TILE;
+    rows = n - r0 < SYM_TILE ? n - r0 : SYM_TILE;
+    for (bj = task; bj < job->A->nblocks; bj++) {
+        tile = PACKED_TILE(job->A, task, bj);
+        c0 = bj * SYM_TILE;
+        cols = n - c0 < SYM_TILE ? n - c0 : SYM_TILE;
+        for (r = 0; r < rows; r++) {
+            scale = job->vec[r0 + r];
+            for (c = 0; c < cols; c++) {
+                tile[r * SYM_TILE + c] = scale * tile[r * SYM_TILE + c] * job->vec[c0 + c];
+            }
+        }
+    }
+}
+
+/*
+ * One accumulator slice: every tile of block rows first[s] .. first[s + 1] - 1.
+ * A tile T at (I, J) adds T * H_J to rows I of acc and, off the diagonal,
+ * H_I^T * T to columns J of the transposed accumulator acct, so neither
+ * product needs the tile transposed. Both go through the GEMM micro-kernels.
+ */
+static void symm_slice_task(void *arg, int task, int worker) {
+    struct packed_job *job;
+    const double *tile;
+    double *acc, *acct, *gw;
+    size_t from;
+    int bi, bj, q, r0, c0, rows, cols, n, k;
+
+    job = arg;
+    (void)worker;
+    n = job->P->n;
+    k = job->H->cols;
+    acc = job->acc + (size_t)task * symm_slice_size(n, k);
+    acct = acc + (size_t)n * k;
+    gw = acct + (size_t)n * k;
+    if (job->first[task] == job->first[task + 1])
+        return;
+
+    /* Rows above the slice's first block row are never touched by it */
+    from = (size_t)job->first[task] * SYM_TILE;
+    memset(acc + from * k, 0, (n - from) * k * sizeof(double));
+    for (q = 0; q < k; q++) {
+        memset(acct + (size_t)q * n + from, 0, (n - from) * sizeof(double));
+    }
+
+    for (bi = job->first[task]; bi < job->first[task + 1]; bi++) {
+        r0 = bi * SYM_TILE;
+        rows = n - r0 < SYM_TILE ? n - r0 : SYM_TILE;
+        for (bj = bi; bj < job->P->nblocks; bj++) {
+            tile = PACKED_TILE(job->P, bi, bj);
+            c0 = bj * SYM_TILE;
+            cols = n - c0 < SYM_TILE ? n - c0 : SYM_TILE;
+
+            gemm_update_unpacked(rows, k, cols, tile, SYM_TILE, MAT_ROW(job->H, c0), job->H->stride, acc + (size_t)r0 * k, k,
+                                 gw);
+            if (bi != bj)
+                gemm_update_unpacked(k, cols, rows, job->Ht + r0, n, tile, SYM_TILE, acct + c0, n, gw);
+        }
+    }
+}
+
+/* Ht = H^T for one PAR_ROWS block of rows of H */
+static void transpose_task(void *arg, int task, int worker) {
+    struct packed_job *job;
+    int i, q, n, end;
+
+    job = arg;
+    (void)worker;
+    n = job->P->n;
+    end = (task + 1) * PAR_ROWS < n ? (task + 1) * PAR_ROWS : n;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        for (q = 0; q < job->H->cols; q++) {
+            job->Ht[(size_t)q * n + i] = MAT_AT(job->H, i, q);
+        }
+    }
+}
+
+/* out[i] = sum of the slice accumulators that reach row i, in slice order */
+static void symm_reduce_task(void *arg, int task, int worker) {
+    struct packed_job *job;
+    const double *part, *partt;
+    double *o;
+    int i, s, q, k, n, end;
+
+    job = arg;
+    (void)worker;
+    n = job->P->n;
+    k = job->H->cols;
+    end = (task + 1) * PAR_ROWS < n ? (task + 1) * PAR_ROWS : n;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        o = MAT_ROW(job->out, i);
+        for (q = 0; q < k; q++) {
+            o[q] = 0.0;
+        }
+        for (s = 0; s < job->slices && job->first[s] * SYM_TILE <= i; s++) {
+            if (job->first[s] == job->first[s + 1])
+                continue;
+            part = job->acc + (size_t)s * symm_slice_size(n, k) + (size_t)i * k;
+            partt = job->acc + (size_t)s * symm_slice_size(n, k) + (size_t)n * k + i;
+            for (q = 0; q < k; q++) {
+                o[q] += part[q] + partt[(size_t)q * n];
+            }
+        }
+    }
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+sym_packed *packed_init(int n) {
+    sym_packed *mat;
+    size_t size;
+    void *block;
+
+    mat = malloc(sizeof(sym_packed));
+    if (mat == NULL)
+        return NULL;
+
+    mat->n = n;
+    mat->nblocks = (n + SYM_TILE - 1) / SYM_TILE;
+    mat->map_size = 0;
+    size = packed_size(mat->nblocks);
+    if (size == 0)
+        size = MATRIX_ALIGN;
+
+    if (posix_memalign(&block, MATRIX_ALIGN, size) != 0) {
+        free(mat);
+        return NULL;
+    }
+    memset(block, 0, size);
+    mat->data = block;
+
+    return mat;
+}
+
+sym_packed *packed_init_mapped(int n, const char *dir) {
+    sym_packed *mat;
+    char *path;
+    void *map;
+    int fd, err;
+
+    mat = malloc(sizeof(sym_packed));
+    path = malloc(strlen(dir) + sizeof("/symnmf-XXXXXX"));
+    if (mat == NULL || path == NULL) {
+        free(mat);
+        free(path);
+        return NULL;
+    }
+    strcpy(path, dir);
+    strcat(path, "/symnmf-XXXXXX");
+    fd = mkstemp(path);
+    err = errno;
+    if (fd >= 0)
+        unlink(path);
+    free(path);
+    if (fd < 0) {
+        free(mat);
+        errno = err;
+        return NULL;
+    }
+
+    /* A fresh file reads as zeros, as packed_init's block does */
+    mat->n = n;
+    mat->nblocks = (n + SYM_TILE - 1) / SYM_TILE;
+    mat->map_size = packed_size(mat->nblocks);
+    if (mat->map_size == 0)
+        mat->map_size = MATRIX_ALIGN;
+    map = MAP_FAILED;
+    err = posix_fallocate(fd, 0, (off_t)mat->map_size);
+    if (err == 0) {
+        map = mmap(NULL, mat->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        err = errno;
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        free(mat);
+        errno = err;
+        return NULL;
+    }
+    mat->data = map;
+
+    return mat;
+}
+
+void free_packed(sym_packed *mat) {
+    if (mat != NULL) {
+        if (mat->map_size != 0)
+            munmap(mat->data, mat->map_size);
+        else
+            free(mat->data);
+        free(mat);
+    }
+}
+
+double packed_at(const sym_packed *mat, int i, int j) {
+    int bi, bj;
+
+    bi = i / SYM_TILE;
+    bj = j / SYM_TILE;
+    if (bi <= bj)
+        return PACKED_TILE(mat, bi, bj)[(i % SYM_TILE) * SYM_TILE + j % SYM_TILE];
+    return PACKED_TILE(mat, bj, bi)[(j % SYM_TILE) * SYM_TILE + i % SYM_TILE];
+}
+
+void calc_norm_packed(sym_packed *A, double *degrees, int threads) {
+    struct packed_job job;
+
+    inv_root(degrees, A->n); /* D <- D^-0.5 */
+
+    job.A = A;
+    job.vec = degrees;
+    parallel_for(threads, A->nblocks, norm_packed_task, &job);
+}
+
+size_t symm_workspace_size(int n, int k) {
+    /* The slices, then H^T */
+    return (size_t)symm_slices(n) * symm_slice_size(n, k) + (size_t)n * k;
+}
+
+int symm(const sym_packed *W, const matrix *H, matrix *out, double *work, int threads) {
+    struct packed_job job;
+    double *own;
+    size_t total, done;
+    int s, bi;
+
+    own = NULL;
+    if (work == NULL) {
+        own = malloc((symm_workspace_size(W->n, H->cols) + 1) * sizeof(double));
+        if (own == NULL)
+            return 1;
+        work = own;
+    }
+
+    /* Split the block rows into slices of about equal tile counts */
+    job.slices = symm_slices(W->n);
+    total = (size_t)W->nblocks * (W->nblocks + 1) / 2;
+    done = 0;
+    bi = 0;
+    for (s = 0; s < job.slices; s++) {
+        job.first[s] = bi;
+        while (bi < W->nblocks && done < total * (s + 1) / job.slices) {
+            done += W->nblocks - bi;
+            bi++;
+        }
+    }
+    job.first[job.slices] = W->nblocks;
+
+    job.P = W;
+    job.H = H;
+    job.out = out;
+    job.acc = work;
+    job.Ht = work + (size_t)job.slices * symm_slice_size(W->n, H->cols);
+    parallel_for(threads, (W->n + PAR_ROWS - 1) / PAR_ROWS, transpose_task, &job);
+    parallel_for(threads, job.slices, symm_slice_task, &job);
+    parallel_for(threads, (W->n + PAR_ROWS - 1) / PAR_ROWS, symm_reduce_task, &job);
+
+    free(own);
+    return 0;
+}
+
+void print_packed(const sym_packed *mat, out_writer *out) {
+    int i, j;
+
+    for (i = 0; i < mat->n; i++) {
+        for (j = 0; j < mat->n; j++) {
+            writer_value(out, packed_at(mat, i, j));
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "symnmf.h"
+
+/*
+ * Most accumulator slices of the SYMM kernel. The count depends on n only, so results do not
+ * depend on the thread count; it also bounds the threads the kernel's main loop can use.
+ */
+#define SYMM_SLICES 16
+
+/*
+ * ============================================================================
+ * Packed Symmetric Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Allocates a zeroed packed symmetric matrix.
+ * @param n The order of the matrix.
+ * @return A pointer to the matrix, or NULL on allocation failure.
+ */
+sym_packed *packed_init(int n);
+
+/**
+ * @brief Creates a zeroed packed symmetric matrix whose tiles live in a scratch file.
+ * The file is created under dir and unlinked at once, so its blocks go back to the
+ * filesystem when the matrix is freed, even after a crash. They are reserved up
+ * front, so a full disk fails here rather than partway through a build. The kernel
+ * pages tiles between the file and memory, so n is bounded by disk, not RAM.
+ * @param n The order of the matrix.
+ * @param dir Directory of the scratch file.
+ * @return A pointer to the matrix, or NULL with errno set if the file cannot be created,
+ *         reserved or mapped (ENOMEM when memory runs out).
+ */
+sym_packed *packed_init_mapped(int n, const char *dir);
+
+/**
+ * @brief Frees a packed symmetric matrix.
+ * @param mat The matrix to free (may be NULL).
+ */
+void free_packed(sym_packed *mat);
+
+/**
+ * @brief Reads element (i, j) of a packed symmetric matrix.
+ * @param mat The matrix.
+ * @param i Row index.
+ * @param j Column index.
+ * @return The element.
+ */
+double packed_at(const sym_packed *mat, int i, int j);
+
+/**
+ * @brief Turns a packed A into W = D^-0.5*A*D^-0.5 in place.
+ * @param A The packed similarity matrix, overwritten by W.
+ * @param degrees The degree vector (replaced by D^-0.5).
+ * @param threads Number of worker threads.
+ */
+void calc_norm_packed(sym_packed *A, double *degrees, int threads);
+
+/**
+ * @brief Number of doubles of scratch symm needs: 2 * n * k doubles, plus GEMM scratch, for each of
+ * min(SYMM_SLICES, ceil(n / SYM_TILE)) slices whatever the thread count, and n * k for H^T. At
+ * most about 33 * n * k doubles, or 66 * k / n times the n^2 / 2 of the packed W.
+ * @param n The order of W.
+ * @param k The number of columns of H.
+ * @return The workspace size, in doubles.
+ */
+size_t symm_workspace_size(int n, int k);
+
+/**
+ * @brief Writes W * H into out, reading every stored tile of W once.
+ * Each tile contributes to its own row block and, through its transpose, to
+ * its column block. Contributions go to up to SYMM_SLICES private accumulators,
+ * one per fixed range of block rows, which are summed in slice order.
+ * @param W The n x n packed symmetric matrix.
+ * @param H The n x k dense matrix.
+ * @param out The n x k output.
+ * @param work Scratch of symm_workspace_size(n, k) doubles, or NULL to allocate it.
+ * @param threads Number of worker threads (at most SYMM_SLICES are used).
+ * @return 0 on success, 1 on allocation failure.
+ */
+int symm(const sym_packed *W, const matrix *H, matrix *out, double *work, int threads);
+
+/**
+ * @brief Prints a packed symmetric matrix in full, one row at a time, through a writer.
+ * @param mat The matrix to print.
+ * @param out A writer opened for n x n values.
+ */
+void print_packed(const sym_packed *mat, out_writer *out);
+
+#endif
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "parallel.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * ============================================================================
+ * Worker Pool
+ * ============================================================================
+ */
+
+struct parallel_job {
+    parallel_fn fn;
+    void *arg;
+    int ntasks;
+    int next;
+    int helpers;
+    int finished;
+};
+
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+/* Published job, guarded by pool_lock; generation counts submissions */
+static struct parallel_job *current_job = NULL;
+static int current_helpers = 0;
+static unsigned long generation = 0;
+static unsigned long start_generation[THREADS_MAX];
+static int pool_size = 0;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+/* Claims and runs tasks until none are left */
+static void run_tasks(struct parallel_job *job, int worker) {
+    int task;
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        task = job->next < job->ntasks ? job->next++ : -1;
+        pthread_mutex_unlock(&pool_lock);
+
+        if (task < 0)
+            return;
+        job->fn(job->arg, task, worker);
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct parallel_job *job;
+    unsigned long seen;
+    int id, joins;
+
+    /* Workers are numbered from 1; the submitting thread is worker 0 */
+    id = (int)(size_t)arg;
+
+    pthread_mutex_lock(&pool_lock);
+    seen = start_generation[id];
+    for (;;) {
+        while (generation == seen) {
+            pthread_cond_wait(&pool_wake, &pool_lock);
+        }
+        seen = generation;
+        job = current_job;
+        joins = id <= current_helpers;
+        pthread_mutex_unlock(&pool_lock);
+
+        if (joins)
+            run_tasks(job, id);
+
+        pthread_mutex_lock(&pool_lock);
+        if (joins && ++job->finished == job->helpers)
+            pthread_cond_signal(&pool_done);
+    }
+
+    return NULL;
+}
+
+/*
+ * A forked child inherits the pool's state but none of its threads, and may
+ * have been forked while another thread held a lock; it starts over empty.
+ */
+static void pool_reset_child(void) {
+    pthread_mutex_init(&submit_lock, NULL);
+    pthread_mutex_init(&pool_lock, NULL);
+    pthread_cond_init(&pool_wake, NULL);
+    pthread_cond_init(&pool_done, NULL);
+    current_job = NULL;
+    current_helpers = 0;
+    pool_size = 0;
+}
+
+static void register_atfork(void) {
+    pthread_atfork(NULL, NULL, pool_reset_child);
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+void parallel_for(int threads, int ntasks, parallel_fn fn, void *arg) {
+    struct parallel_job job;
+    pthread_t tid;
+    int task;
+
+    if (threads > ntasks)
+        threads = ntasks;
+    if (threads > THREADS_MAX)
+        threads = THREADS_MAX;
+
+    if (threads <= 1) {
+        for (task = 0; task < ntasks; task++) {
+            fn(arg, task, 0);
+        }
+        return;
+    }
+
+    pthread_once(&atfork_once, register_atfork);
+    pthread_mutex_lock(&submit_lock);
+    pthread_mutex_lock(&pool_lock);
+
+    /* Grow the pool; a failed start just leaves fewer helpers */
+    while (pool_size < threads - 1) {
+        start_generation[pool_size + 1] = generation;
+        if (pthread_create(&tid, NULL, worker_main, (void *)(size_t)(pool_size + 1)) != 0)
+            break;
+        pthread_detach(tid);
+        pool_size++;
+    }
+
+    job.fn = fn;
+    job.arg = arg;
+    job.ntasks = ntasks;
+    job.next = 0;
+    job.helpers = threads - 1 < pool_size ? threads - 1 : pool_size;
+    job.finished = 0;
+
+    current_job = &job;
+    current_helpers = job.helpers;
+    generation++;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_tasks(&job, 0);
+
+    /* Wait for the helpers before the job leaves scope */
+    pthread_mutex_lock(&pool_lock);
+    while (job.finished < job.helpers) {
+        pthread_cond_wait(&pool_done, &pool_lock);
+    }
+    current_job = NULL;
+    current_helpers = 0;
+    pthread_mutex_unlock(&pool_lock);
+
+    pthread_mutex_unlock(&submit_lock);
+}
+
+int default_threads(void) {
+    const char *env;
+    char *end;
+    long threads;
+
+    env = getenv(THREADS_ENV);
+    if (env == NULL)
+        return 1;
+
+    /* The range --threads accepts; anything else falls back to one thread */
+    threads = strtol(env, &end, 10);
+    if (end == env || *end != '\0' || threads < 1 || threads > THREADS_MAX)
+        return 1;
+    return (int)threads;
+}
@@ -0,0 +1,41 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* Environment variable holding the default thread count */
+#define THREADS_ENV "SYMNMF_THREADS"
+
+/* Largest thread count accepted from --threads, the module or THREADS_ENV, and the size of the worker pool */
+#define THREADS_MAX 1024
+
+/* Rows per task in row-parallel loops; a multiple of every GEMM kernel's MR */
+#define PAR_ROWS 240
+
+/**
+ * @brief Body of a parallel loop.
+ * @param arg The shared loop argument.
+ * @param task Index of the task to run, in [0, ntasks).
+ * @param worker Index of the calling worker, in [0, threads), for per-worker scratch.
+ */
+typedef void (*parallel_fn)(void *arg, int task, int worker);
+
+/**
+ * @brief Runs fn for every task on up to threads workers (the caller included).
+ * Tasks are handed out dynamically, so callers that need reproducible sums must
+ * reduce per-task partial results in task order rather than per worker.
+ * Workers come from a process-wide pool that grows on demand; if a thread cannot
+ * be started the loop runs on fewer workers. Concurrent callers take turns.
+ * A child created by fork starts with an empty pool and grows its own.
+ * @param threads Number of workers to use, at most THREADS_MAX; 1 runs every task inline.
+ * @param ntasks Number of tasks.
+ * @param fn The loop body.
+ * @param arg Argument passed to every call of fn.
+ */
+void parallel_for(int threads, int ntasks, parallel_fn fn, void *arg);
+
+/**
+ * @brief Reads the default thread count from the SYMNMF_THREADS environment variable.
+ * @return The thread count, or 1 if the variable is unset or not a whole number in 1..THREADS_MAX.
+ */
+int default_threads(void);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Instantiates the precision template named by REAL_TEMPLATE once per element
+ * type. No include guard: it is meant to be included once per template.
+ *
+ *     #define REAL_TEMPLATE "gemm_real.h"
+ *     #include "precision.h"
+ *
+ * Inside a template, REAL is the element type and R(name) the name of a
+ * symbol of that precision: double keeps the plain name, float appends _f
+ * (R(gemm) is gemm or gemm_f). REAL_SINGLE is defined for the float pass.
+ */
+
+#ifndef REAL_TEMPLATE
+#error "precision.h needs REAL_TEMPLATE"
+#endif
+
+/* Double precision */
+#define REAL double
+#define R(name) name
+#include REAL_TEMPLATE
+#undef REAL
+#undef R
+
+/* Single precision */
+#define REAL float
+#define R(name) name##_f
+#define REAL_SINGLE
+#include REAL_TEMPLATE
+#undef REAL
+#undef R
+#undef REAL_SINGLE
+
+#undef REAL_TEMPLATE
@@ -0,0 +1,173 @@
+import sys
+import time
+import numpy as np
+import mysymnmf as symnmf
+from symnmf import init_H
+
+# Iterations at which the residual trajectories are sampled, roughly log-spaced up to MAX_ITER
+CHECKPOINTS = [1, 2, 5, 10, 20, 50, 100, 200, 300]
+
+# Reduced-precision modes of mysymnmf.symnmf, compared against the double solve
+VARIANTS = {
+    "float32": {"float32": True},
+    "fp16": {"half": "fp16"},
+    "bf16": {"half": "bf16"},
+    "fp16+f32": {"half": "fp16", "float32": True},
+}
+
+
+def generate_data(rng: np.random.Generator) -> tuple[np.ndarray, int]:
+    """
+    Draws a tester-style dataset: Gaussian blobs around uniform centroids.
+
+    Args:
+        rng (np.random.Generator): Source of randomness.
+    Returns:
+        tuple: (data points of shape (n, d), number of blobs k)
+    """
+    k = int(rng.integers(2, 11))
+    dim = int(rng.integers(2, 10))
+    n = int(rng.integers(100, 700))
+    centroids = rng.uniform(-11, 11, (k, dim))
+    data = rng.choice(centroids, n) + rng.standard_normal((n, dim))
+    return np.unique(data, axis=0), k
+
+
+def timed(fn, *args, **kwargs):
+    """
+    Calls fn and returns its result with the elapsed wall time in seconds.
+    """
+    start = time.perf_counter()
+    result = fn(*args, **kwargs)
+    return result, time.perf_counter() - start
+
+
+def stored_error(w: np.ndarray, variant: str) -> float:
+    """
+    Largest entrywise error of W as the variant stores it.
+
+    Args:
+        w (np.ndarray): The double W.
+        variant (str): A key of VARIANTS.
+    Returns:
+        float: max |W - stored W|.
+    """
+    if variant.startswith("fp16"):
+        stored = w.astype(np.float16).astype(np.float64)
+    elif variant == "bf16":
+        # Round to nearest even on the top 16 bits of the float32 pattern
+        bits = w.astype(np.float32).view(np.uint32).astype(np.uint64)
+        bits = (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16 << 16
+        stored = bits.astype(np.uint32).view(np.float32).astype(np.float64)
+    else:
+        stored = w.astype(np.float32).astype(np.float64)
+    return float(np.abs(w - stored).max())
+
+
+def trajectory(stats: dict) -> list[float | None]:
+    """
+    Residual ||H_new - H_old||_F^2 of a solve at each of CHECKPOINTS.
+
+    Args:
+        stats (dict): The stats of a symnmf call with stats=True.
+    Returns:
+        list: The residual after each checkpoint iteration, None past the last iteration.
+    """
+    residual = stats["residual"]
+    return [residual[i - 1] if i <= len(residual) else None for i in CHECKPOINTS]
+
+
+def format_trajectory(values: list[float | None]) -> str:
+    """
+    Formats a residual trajectory, with converged checkpoints left blank.
+    """
+    return " ".join(f"{v:>8.1e}" if v is not None else f"{'':>8}" for v in values)
+
+
+def compare(points: np.ndarray, k: int) -> list[dict]:
+    """
+    Solves from the same initial H in double and in every reduced-precision variant.
+
+    Args:
+        points (np.ndarray): The n x d data points.
+        k (int): Number of clusters.
+    Returns:
+        list: One dict of agreement, convergence and timing figures per variant, the double solve first.
+    """
+    n, d = points.shape
+    w_double = np.array(symnmf.norm(points.tolist(), n, d))
+    w_list = w_double.tolist()
+    h_init = init_H(w_double, k).tolist()
+
+    (h_double, stats_double), t_double = timed(symnmf.symnmf, w_list, h_init, n, k, stats=True)
+    h_double = np.array(h_double)
+    obj_double = np.linalg.norm(w_double - h_double @ h_double.T)
+
+    rows = [{
+        "n": n,
+        "d": d,
+        "k": k,
+        "variant": "double",
+        "w_err": 0.0,
+        "h_err": 0.0,
+        "obj": 0.0,
+        "labels": 1.0,
+        "speedup": 1.0,
+        "iterations": stats_double["iterations"],
+        "trajectory": trajectory(stats_double),
+    }]
+    for variant, kwargs in VARIANTS.items():
+        (h, stats), t = timed(symnmf.symnmf, w_list, h_init, n, k, stats=True, **kwargs)
+        h = np.array(h)
+        rows.append({
+            "n": n,
+            "d": d,
+            "k": k,
+            "variant": variant,
+            "w_err": stored_error(w_double, variant),
+            "h_err": np.linalg.norm(h_double - h) / np.linalg.norm(h_double),
+            # Objective ||W - HH^T||_F against the double W, relative to the double solve
+            "obj": np.linalg.norm(w_double - h @ h.T) / obj_double - 1.0,
+            "labels": np.mean(h_double.argmax(axis=1) == h.argmax(axis=1)),
+            "speedup": t_double / t,
+            # Convergence: iterations to the EPS residual, and the residual along the way
+            "iterations": stats["iterations"],
+            "trajectory": trajectory(stats),
+        })
+    return rows
+
+
+def main():
+    """
+    Prints the agreement of the reduced-precision solves with the double one, and how each converged:
+    its iterations and its residual trajectory, next to the double solve's.
+    Usage: python3 precision_report.py [trials] [seed]
+    """
+    trials = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+    seed = int(sys.argv[2]) if len(sys.argv) > 2 else 1234
+    rng = np.random.default_rng(seed)
+
+    print(f"{'n':>5} {'d':>3} {'k':>3} {'variant':>9} {'max|dW|':>10} {'|dH|/|H|':>10} {'dObj':>10} "
+          f"{'labels':>8} {'speedup':>8} {'iters':>5} "
+          + " ".join(f"{'res@' + str(i):>8}" for i in CHECKPOINTS))
+    rows = []
+    for _ in range(trials):
+        points, k = generate_data(rng)
+        for row in compare(points, k):
+            rows.append(row)
+            print(f"{row['n']:>5} {row['d']:>3} {row['k']:>3} {row['variant']:>9} {row['w_err']:>10.2e} "
+                  f"{row['h_err']:>10.2e} {row['obj']:>10.2e} {row['labels']:>8.2%} {row['speedup']:>7.2f}x "
+                  f"{row['iterations']:>5} {format_trajectory(row['trajectory'])}")
+
+    double = [r for r in rows if r["variant"] == "double"]
+    for variant in VARIANTS:
+        mine = [r for r in rows if r["variant"] == variant]
+        extra = [r["iterations"] - base["iterations"] for r, base in zip(mine, double)]
+        print(f"{variant}: worst |dH|/|H| {max(r['h_err'] for r in mine):.2e}, "
+              f"worst dObj {max(r['obj'] for r in mine):.2e}, "
+              f"mean label agreement {np.mean([r['labels'] for r in mine]):.2%}, "
+              f"iterations vs double {np.mean(extra):+.1f} mean, {max(extra):+d} worst")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "reader.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bytes read per call when the file cannot be mapped */
+#define READ_BLOCK (1 << 20)
+
+/* Longest number handed to strtod */
+#define TOKEN_MAX 512
+
+/* Significant digits that always fit a double exactly */
+#define FAST_DIGITS 15
+
+/* Every power of ten up to 10^22 is exact in double */
+#define FAST_EXP 22
+
+static const double exact_pow10[FAST_EXP + 1] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                                 1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                                 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* Magic of a .npy file, followed by the major and minor format version */
+#define NPY_MAGIC "\223NUMPY"
+#define NPY_MAGIC_LEN 6
+
+/* The bytes of an input file, mapped or read into memory */
+struct input_buffer {
+    char *data;
+    size_t size;
+    int mapped;
+};
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+/* Appends a significant digit; past FAST_DIGITS they are only counted, as the fast path is off anyway */
+#define ADD_DIGIT(c)                                  \
+    do {                                              \
+        if (digits < FAST_DIGITS)                     \
+            mantissa = mantissa * 10.0 + ((c) - '0'); \
+        digits++;                                     \
+    } while (0)
+
+/*
+ * ============================================================================
+ * File Access
+ * ============================================================================
+ */
+
+/* Reads the rest of fd into a growing block, for files that cannot be mapped */
+static int buffer_read(int fd, struct input_buffer *buf) {
+    size_t capacity;
+    ssize_t got;
+    char *grown;
+
+    capacity = 0;
+    buf->data = NULL;
+    buf->size = 0;
+    for (;;) {
+        if (capacity - buf->size < READ_BLOCK) {
+            capacity = capacity * 2 + READ_BLOCK;
+            grown = realloc(buf->data, capacity);
+            if (grown == NULL)
+                return 1;
+            buf->data = grown;
+        }
+        got = read(fd, buf->data + buf->size, capacity - buf->size);
+        if (got < 0)
+            return 1;
+        if (got == 0)
+            return 0;
+        buf->size += (size_t)got;
+    }
+}
+
+/* Maps the file, or reads it whole when it is empty or not mappable; returns 1 on failure */
+static int buffer_open(const char *file_name, struct input_buffer *buf) {
+    struct stat st;
+    void *map;
+    int fd, err;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    buf->mapped = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            buf->data = map;
+            buf->size = (size_t)st.st_size;
+            buf->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+
+    err = buffer_read(fd, buf);
+    close(fd);
+    if (err) {
+        free(buf->data);
+        return 1;
+    }
+    return 0;
+}
+
+/* Releases the buffer, unless its mapping was handed to a matrix (data is then NULL) */
+static void buffer_close(struct input_buffer *buf) {
+    if (buf->mapped)
+        munmap(buf->data, buf->size);
+    else
+        free(buf->data);
+}
+
+/*
+ * ============================================================================
+ * Binary Formats
+ * ============================================================================
+ */
+
+/* Whether doubles are stored little-endian, as both binary formats hold them */
+static int host_little_endian(void) {
+    const double one = 1.0;
+
+    return ((const unsigned char *)&one)[sizeof(double) - 1] == 0x3f;
+}
+
+static unsigned long read_le32(const unsigned char *p) {
+    return (unsigned long)p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static double read_le_double(const unsigned char *p, int little_endian) {
+    unsigned char bytes[sizeof(double)];
+    double value;
+    size_t b;
+
+    for (b = 0; b < sizeof(double); b++) {
+        bytes[b] = little_endian ? p[b] : p[sizeof(double) - 1 - b];
+    }
+    memcpy(&value, bytes, sizeof(double));
+    return value;
+}
+
+/*
+ * Gives a matrix of the rows x cols doubles at offset of buf. A mapped, aligned
+ * block on a little-endian host is viewed in place and the matrix takes over
+ * the mapping; anything else is decoded into a new matrix.
+ */
+static matrix *binary_matrix(struct input_buffer *buf, size_t offset, int rows, int cols) {
+    const unsigned char *src;
+    matrix *result;
+    int i, j, little_endian;
+
+    if (rows <= 0 || cols <= 0 || offset > buf->size || (buf->size - offset) / sizeof(double) / cols < (size_t)rows)
+        return NULL;
+
+    little_endian = host_little_endian();
+    if (buf->mapped && little_endian && offset % sizeof(double) == 0) {
+        result = malloc(sizeof(matrix));
+        if (result == NULL)
+            return NULL;
+        result->data = (double *)(buf->data + offset);
+        result->rows = rows;
+        result->cols = cols;
+        result->stride = cols;
+        result->map = buf->data;
+        result->map_size = buf->size;
+        buf->data = NULL;
+        buf->mapped = 0;
+        return result;
+    }
+
+    result = matrix_init(rows, cols);
+    if (result == NULL)
+        return NULL;
+    src = (const unsigned char *)buf->data + offset;
+    for (i = 0; i < rows; i++) {
+        for (j = 0; j < cols; j++) {
+            MAT_AT(result, i, j) = read_le_double(src, little_endian);
+            src += sizeof(double);
+        }
+    }
+    return result;
+}
+
+/* Points past the value of key (quoted) in a .npy header dict, or NULL if it is absent */
+static const char *npy_field(const char *p, const char *end, const char *key) {
+    size_t len;
+
+    len = strlen(key);
+    for (; p + len <= end; p++) {
+        if (memcmp(p, key, len) == 0) {
+            for (p += len; p < end && (IS_BLANK(*p) || *p == ':'); p++) {
+            }
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Parses a shape tuple of one or two dimensions; a 1-D array is one column */
+static int npy_shape(const char *p, const char *end, int *rows, int *cols) {
+    long dims[2];
+    int ndim;
+
+    if (p == NULL || p == end || *p != '(')
+        return 1;
+    ndim = 0;
+    for (p++; p < end && *p != ')'; p++) {
+        if (IS_DIGIT(*p)) {
+            if (ndim == 2)
+                return 1;
+            for (dims[ndim] = 0; p < end && IS_DIGIT(*p); p++) {
+                dims[ndim] = dims[ndim] * 10 + (*p - '0');
+                if (dims[ndim] > INT_MAX)
+                    return 1;
+            }
+            ndim++;
+            p--;
+        } else if (*p != ',' && !IS_BLANK(*p)) {
+            return 1;
+        }
+    }
+    if (p == end || ndim == 0)
+        return 1;
+
+    *rows = (int)dims[0];
+    *cols = ndim == 2 ? (int)dims[1] : 1;
+    return 0;
+}
+
+/* Reads a .npy file of little-endian float64 in C order */
+static matrix *read_npy(struct input_buffer *buf) {
+    const unsigned char *bytes;
+    const char *header, *end, *value;
+    size_t header_len, offset;
+    int rows, cols;
+
+    bytes = (const unsigned char *)buf->data;
+    if (buf->size < NPY_MAGIC_LEN + 4)
+        return NULL;
+    if (bytes[NPY_MAGIC_LEN] == 1) {
+        header_len = (size_t)bytes[8] | (size_t)bytes[9] << 8;
+        offset = 10;
+    } else if ((bytes[NPY_MAGIC_LEN] == 2 || bytes[NPY_MAGIC_LEN] == 3) && buf->size >= 12) {
+        header_len = read_le32(bytes + 8);
+        offset = 12;
+    } else {
+        return NULL;
+    }
+    if (header_len > buf->size - offset)
+        return NULL;
+    header = buf->data + offset;
+    end = header + header_len;
+
+    value = npy_field(header, end, "'descr'");
+    if (value == NULL || end - value < 5 || memcmp(value, "'<f8'", 5) != 0)
+        return NULL;
+    value = npy_field(header, end, "'fortran_order'");
+    if (value == NULL || end - value < 5 || memcmp(value, "False", 5) != 0)
+        return NULL;
+    if (npy_shape(npy_field(header, end, "'shape'"), end, &rows, &cols) != 0)
+        return NULL;
+
+    return binary_matrix(buf, offset + header_len, rows, cols);
+}
+
+/* Reads a raw file: RAW_MAGIC, rows and cols as little-endian uint32, then the values */
+static matrix *read_raw(struct input_buffer *buf) {
+    const unsigned char *bytes;
+    unsigned long rows, cols;
+
+    bytes = (const unsigned char *)buf->data;
+    rows = read_le32(bytes + 8);
+    cols = read_le32(bytes + 12);
+    if (rows > INT_MAX || cols > INT_MAX)
+        return NULL;
+
+    return binary_matrix(buf, RAW_HEADER, (int)rows, (int)cols);
+}
+
+/*
+ * ============================================================================
+ * Parsing
+ * ============================================================================
+ */
+
+/* Copies the characters a number may span into a terminated token and parses it with strtod */
+static const char *parse_slow(const char *s, const char *end, double *value) {
+    char token[TOKEN_MAX + 1], *stop;
+    size_t len;
+
+    len = 0;
+    while (s + len < end && len < TOKEN_MAX &&
+           (IS_DIGIT(s[len]) || s[len] == '.' || s[len] == '+' || s[len] == '-' ||
+            (s[len] >= 'a' && s[len] <= 'z') || (s[len] >= 'A' && s[len] <= 'Z'))) {
+        token[len] = s[len];
+        len++;
+    }
+    token[len] = '\0';
+
+    *value = strtod(token, &stop);
+    if (stop == token)
+        return NULL;
+    return s + (stop - token);
+}
+
+const char *parse_double(const char *s, const char *end, double *value) {
+    const char *p;
+    double mantissa;
+    int negative, digits, seen, exp10, exp_value, exp_negative, exp_digits;
+
+    p = s;
+    negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    /* Digits before and after the point, leading zeros not counted as significant */
+    mantissa = 0.0;
+    digits = 0;
+    seen = 0;
+    exp10 = 0;
+    for (; p < end && IS_DIGIT(*p); p++) {
+        seen = 1;
+        if (digits > 0 || *p != '0')
+            ADD_DIGIT(*p);
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && IS_DIGIT(*p); p++) {
+            seen = 1;
+            if (digits > 0 || *p != '0')
+                ADD_DIGIT(*p);
+            exp10--;
+        }
+    }
+    if (!seen)
+        return parse_slow(s, end, value); /* inf, nan, or not a number */
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        exp_negative = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        exp_value = 0;
+        exp_digits = 0;
+        for (; p < end && IS_DIGIT(*p); p++) {
+            if (exp_digits < 6)
+                exp_value = exp_value * 10 + (*p - '0');
+            exp_digits++;
+        }
+        if (exp_digits == 0 || exp_digits >= 6)
+            return parse_slow(s, end, value);
+        exp10 += exp_negative ? -exp_value : exp_value;
+    }
+
+    /* Hex floats and other suffixes are strtod's business */
+    if (p < end && (*p == '.' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')))
+        return parse_slow(s, end, value);
+
+    if (digits > FAST_DIGITS || exp10 < -FAST_EXP || exp10 > FAST_EXP) {
+        if (digits == 0) {
+            *value = negative ? -0.0 : 0.0;
+            return p;
+        }
+        return parse_slow(s, end, value);
+    }
+
+    /* Below 10^15 the mantissa is exact, so the single rounding of the product or quotient is the correct one */
+    mantissa = exp10 < 0 ? mantissa / exact_pow10[-exp10] : mantissa * exact_pow10[exp10];
+    *value = negative ? -mantissa : mantissa;
+    return p;
+}
+
+/* Whether the line starting at p holds only blanks */
+static int line_blank(const char *p, const char *end) {
+    while (p < end && IS_BLANK(*p)) {
+        p++;
+    }
+    return p == end || *p == '\n';
+}
+
+/* Rows are the non-blank lines; columns are the commas of the first row, plus one */
+static int count_shape(const char *data, const char *end, int *rows, int *cols) {
+    const char *p, *eol;
+    long n;
+
+    n = 0;
+    *cols = 0;
+    for (p = data; p < end; p = eol < end ? eol + 1 : end) {
+        eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        if (line_blank(p, eol))
+            continue;
+        if (n == 0) {
+            *cols = 1;
+            for (; p < eol; p++) {
+                *cols += *p == ',';
+            }
+        }
+        n++;
+        if (n > 2147483647L)
+            return 1;
+    }
+
+    *rows = (int)n;
+    return n == 0;
+}
+
+/* Parses rows lines of cols values into mat; returns 1 on a malformed or ragged row */
+static int parse_rows(const char *p, const char *end, matrix *mat) {
+    double *row;
+    int i, j;
+
+    for (i = 0; i < mat->rows; i++) {
+        while (line_blank(p, end)) {
+            p = (const char *)memchr(p, '\n', end - p) + 1;
+        }
+
+        row = MAT_ROW(mat, i);
+        for (j = 0; j < mat->cols; j++) {
+            while (p < end && IS_BLANK(*p)) {
+                p++;
+            }
+            p = parse_double(p, end, &row[j]);
+            if (p == NULL)
+                return 1;
+            while (p < end && IS_BLANK(*p)) {
+                p++;
+            }
+            if (j < mat->cols - 1) {
+                if (p == end || *p != ',')
+                    return 1;
+                p++;
+            }
+        }
+
+        if (p < end) {
+            if (*p != '\n')
+                return 1;
+            p++;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+matrix *read_input(const char *file_name) {
+    struct input_buffer buf;
+    matrix *result;
+    int rows, cols;
+
+    if (buffer_open(file_name, &buf) != 0)
+        return NULL;
+
+    result = NULL;
+    if (buf.size >= NPY_MAGIC_LEN && memcmp(buf.data, NPY_MAGIC, NPY_MAGIC_LEN) == 0) {
+        result = read_npy(&buf);
+    } else if (buf.size >= RAW_HEADER && memcmp(buf.data, RAW_MAGIC, strlen(RAW_MAGIC)) == 0) {
+        result = read_raw(&buf);
+    } else if (count_shape(buf.data, buf.data + buf.size, &rows, &cols) == 0) {
+        result = matrix_init(rows, cols);
+        if (result != NULL && parse_rows(buf.data, buf.data + buf.size, result) != 0) {
+            free_matrix(result);
+            result = NULL;
+        }
+    }
+
+    buffer_close(&buf);
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef READER_H
+#define READER_H
+
+#include "symnmf.h"
+
+/*
+ * ============================================================================
+ * Input Reader Function Prototypes
+ * ============================================================================
+ */
+
+/* Magic of the raw binary format: then rows and cols as little-endian uint32, then the values */
+#define RAW_MAGIC "SYMNMFLE"
+
+/* Bytes of the raw header; the values that follow stay 8-byte aligned */
+#define RAW_HEADER 16
+
+/**
+ * @brief Reads a file of points, one per row, into a matrix.
+ * The format is told by the leading bytes: a .npy array of little-endian
+ * float64 in C order (1-D or 2-D), the raw format (RAW_MAGIC, rows, cols,
+ * then rows * cols little-endian float64), or else comma-separated text.
+ * Binary files are memory-mapped and the matrix views the mapping with
+ * unpadded rows, so nothing is parsed or copied; where the values cannot be
+ * viewed in place (misaligned, or a big-endian host) they are decoded into
+ * a new matrix. Text is memory-mapped, or read whole when it cannot be
+ * mapped; one scan for line ends and the commas of the first row gives the
+ * shape, and a second parses the values straight into the rows of the
+ * matrix. Blank lines are skipped, and the last row needs no line end.
+ * @param file_name name of the file.
+ * @return A matrix of the points, one per row, or NULL if the file cannot be
+ *         read, holds no rows, has a malformed or ragged row, or is a binary
+ *         file of another dtype, order or size than its header promises.
+ */
+matrix *read_input(const char *file_name);
+
+/**
+ * @brief Parses one decimal number, correctly rounded like strtod.
+ * Mantissas of up to 15 digits with a decimal exponent within +-22 take one
+ * exact multiplication or division by a power of ten (Clinger's fast path);
+ * anything else is copied out and handed to strtod.
+ * @param s Start of the number.
+ * @param end End of the buffer; the number needs no terminator.
+ * @param value Output value.
+ * @return Pointer just past the number, or NULL if s does not start with one.
+ */
+const char *parse_double(const char *s, const char *end, double *value);
+
+#endif
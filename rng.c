@@ -0,0 +1,69 @@
+#include "rng.h"
+
+/* Twist parameters of MT19937 */
+#define RNG_SHIFT 397
+#define RNG_MATRIX 0x9908b0dfUL
+#define RNG_UPPER 0x80000000UL
+#define RNG_LOWER 0x7fffffffUL
+#define RNG_MASK 0xffffffffUL
+
+/*
+ * ============================================================================
+ * Generator Internals
+ * ============================================================================
+ */
+
+/* Regenerates all RNG_WORDS words of state */
+static void rng_twist(rng_state *rng) {
+    unsigned long y;
+    int i;
+
+    for (i = 0; i < RNG_WORDS; i++) {
+        y = (rng->mt[i] & RNG_UPPER) | (rng->mt[(i + 1) % RNG_WORDS] & RNG_LOWER);
+        rng->mt[i] = rng->mt[(i + RNG_SHIFT) % RNG_WORDS] ^ (y >> 1) ^ (y & 1UL ? RNG_MATRIX : 0UL);
+    }
+    rng->pos = 0;
+}
+
+/* Next tempered 32-bit output */
+static unsigned long rng_next(rng_state *rng) {
+    unsigned long y;
+
+    if (rng->pos == RNG_WORDS)
+        rng_twist(rng);
+
+    y = rng->mt[rng->pos++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= y >> 18;
+    return y & RNG_MASK;
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+void rng_seed(rng_state *rng, unsigned long seed) {
+    int i;
+
+    rng->mt[0] = seed & RNG_MASK;
+    for (i = 1; i < RNG_WORDS; i++) {
+        rng->mt[i] = (1812433253UL * (rng->mt[i - 1] ^ (rng->mt[i - 1] >> 30)) + (unsigned long)i) & RNG_MASK;
+    }
+    rng->pos = RNG_WORDS;
+}
+
+double rng_double(rng_state *rng) {
+    unsigned long a, b;
+
+    a = rng_next(rng) >> 5;
+    b = rng_next(rng) >> 6;
+    return ((double)a * 67108864.0 + (double)b) / 9007199254740992.0;
+}
+
+double rng_uniform(rng_state *rng, double low, double high) {
+    return low + (high - low) * rng_double(rng);
+}
@@ -0,0 +1,48 @@
+#ifndef RNG_H
+#define RNG_H
+
+/* Words of Mersenne Twister state */
+#define RNG_WORDS 624
+
+/**
+ * @brief State of a 32-bit Mersenne Twister (MT19937).
+ * Seeded the way numpy.random.seed seeds its legacy generator from an integer,
+ * so rng_uniform reproduces numpy.random.uniform draw for draw.
+ */
+struct rng_state {
+    unsigned long mt[RNG_WORDS];
+    int pos;
+};
+
+typedef struct rng_state rng_state;
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Seeds the generator.
+ * @param rng The state to fill.
+ * @param seed The seed; only its low 32 bits are used.
+ */
+void rng_seed(rng_state *rng, unsigned long seed);
+
+/**
+ * @brief Draws a double uniformly from [0, 1) with 53 random bits, from two 32-bit outputs.
+ * @param rng The state.
+ * @return The draw.
+ */
+double rng_double(rng_state *rng);
+
+/**
+ * @brief Draws a double uniformly from [low, high), as low + (high - low) * rng_double.
+ * @param rng The state.
+ * @param low Lower bound.
+ * @param high Upper bound.
+ * @return The draw.
+ */
+double rng_uniform(rng_state *rng, double low, double high);
+
+#endif
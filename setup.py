@@ -1,6 +1,6 @@
 from setuptools import Extension, setup
 
-module = Extension("mysymnmf", sources=["symnmfmodule.c", "symnmf.c"])
+module = Extension("mysymnmf", sources=["symnmfmodule.c", "symnmf.c", "gemm.c", "parallel.c", "sparse.c", "kdtree.c", "vmath.c", "packed.c", "half.c", "reader.c", "writer.c", "rng.c", "batch.c", "incremental.c", "stats.c"])
 setup(
     name="mysymnmf",
     version="1.0",
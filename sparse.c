@@ -0,0 +1,409 @@
+#include "sparse.h"
+#include "kdtree.h"
+#include "parallel.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One stored entry while rows are being assembled */
+struct csr_entry {
+    int col;
+    double value;
+};
+
+/* Shared state of the sparse construction and row loops */
+struct sparse_job {
+    const matrix *points;
+    kdtree *tree;
+    csr_matrix *A;
+    const csr_matrix *B;
+    const matrix *H;
+    matrix *out;
+    double *vec;
+    int *nbr_idx;
+    int *scratch;
+    double *nbr_dist;
+    size_t *counts;
+    struct csr_entry *entries;
+    size_t *entry_ptr;
+    int knn;
+    double radius2;
+    double threshold;
+};
+
+/*
+ * ============================================================================
+ * Neighbour Search
+ * ============================================================================
+ */
+
+/* k nearest neighbours of every point in a PAR_ROWS block */
+static void knn_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    int i, end;
+
+    job = arg;
+    (void)worker;
+    end = (task + 1) * PAR_ROWS < job->points->rows ? (task + 1) * PAR_ROWS : job->points->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        kdtree_knn(job->tree, i, job->knn, job->nbr_dist + (size_t)i * job->knn, job->nbr_idx + (size_t)i * job->knn);
+    }
+}
+
+/* Counts (A == NULL) or writes the entries of a block of rows of the threshold graph */
+static void radius_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    const matrix *X;
+    double value;
+    size_t p, q, found;
+    int *cand, i, j, end;
+
+    job = arg;
+    X = job->points;
+    cand = job->scratch + (size_t)worker * X->rows;
+    end = (task + 1) * PAR_ROWS < X->rows ? (task + 1) * PAR_ROWS : X->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        /* The tree returns a slight superset; keep the pairs the affinity itself admits */
+        found = kdtree_radius(job->tree, i, job->radius2, cand);
+        p = job->A ? job->A->row_ptr[i] : 0;
+        for (q = 0; q < found; q++) {
+            j = cand[q];
+            value = exp(-0.5 * euclidean_distance(MAT_ROW(X, i), MAT_ROW(X, j), X->cols));
+            if (value < job->threshold)
+                continue;
+            if (job->A) {
+                job->A->col_idx[p] = j;
+                job->A->values[p] = value;
+            }
+            p++;
+        }
+        if (job->A == NULL)
+            job->counts[i] = p;
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const struct csr_entry *x, *y;
+
+    x = a;
+    y = b;
+    return (x->col > y->col) - (x->col < y->col);
+}
+
+/* Sorts a block of assembled rows by column and drops duplicates and sub-threshold entries */
+static void dedupe_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    struct csr_entry *row;
+    size_t len, out, q;
+    int i, end, n;
+
+    job = arg;
+    (void)worker;
+    n = job->points->rows;
+    end = (task + 1) * PAR_ROWS < n ? (task + 1) * PAR_ROWS : n;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        row = job->entries + job->entry_ptr[i];
+        len = job->entry_ptr[i + 1] - job->entry_ptr[i];
+        qsort(row, len, sizeof(struct csr_entry), compare_entries);
+
+        out = 0;
+        for (q = 0; q < len; q++) {
+            if (out > 0 && row[out - 1].col == row[q].col)
+                continue;
+            if (row[q].value < job->threshold)
+                continue;
+            row[out++] = row[q];
+        }
+        job->counts[i] = out;
+    }
+}
+
+/*
+ * ============================================================================
+ * Row Loops
+ * ============================================================================
+ */
+
+/* degrees[i] = sum of the stored entries of row i */
+static void rowsum_sparse_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    double sum;
+    size_t p;
+    int i, end;
+
+    job = arg;
+    (void)worker;
+    end = (task + 1) * PAR_ROWS < job->B->rows ? (task + 1) * PAR_ROWS : job->B->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        sum = 0.0;
+        for (p = job->B->row_ptr[i]; p < job->B->row_ptr[i + 1]; p++) {
+            sum += job->B->values[p];
+        }
+        job->vec[i] = sum;
+    }
+}
+
+/* A_ij <- d_i * A_ij * d_j for the stored entries */
+static void norm_sparse_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    double scale;
+    size_t p;
+    int i, end;
+
+    job = arg;
+    (void)worker;
+    end = (task + 1) * PAR_ROWS < job->A->rows ? (task + 1) * PAR_ROWS : job->A->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        scale = job->vec[i];
+        for (p = job->A->row_ptr[i]; p < job->A->row_ptr[i + 1]; p++) {
+            job->A->values[p] = scale * job->A->values[p] * job->vec[job->A->col_idx[p]];
+        }
+    }
+}
+
+/* out[i] = sum over stored A_ij of A_ij * H[j] */
+static void spmm_task(void *arg, int task, int worker) {
+    struct sparse_job *job;
+    const double *h;
+    double *o, a;
+    size_t p;
+    int i, c, k, end;
+
+    job = arg;
+    (void)worker;
+    k = job->H->cols;
+    end = (task + 1) * PAR_ROWS < job->B->rows ? (task + 1) * PAR_ROWS : job->B->rows;
+    for (i = task * PAR_ROWS; i < end; i++) {
+        o = MAT_ROW(job->out, i);
+        for (c = 0; c < k; c++) {
+            o[c] = 0.0;
+        }
+        for (p = job->B->row_ptr[i]; p < job->B->row_ptr[i + 1]; p++) {
+            a = job->B->values[p];
+            h = MAT_ROW(job->H, job->B->col_idx[p]);
+            for (c = 0; c < k; c++) {
+                o[c] += a * h[c];
+            }
+        }
+    }
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+csr_matrix *csr_init(int rows, int cols, size_t nnz) {
+    csr_matrix *mat;
+
+    mat = malloc(sizeof(csr_matrix));
+    if (mat == NULL)
+        return NULL;
+
+    mat->rows = rows;
+    mat->cols = cols;
+    mat->nnz = nnz;
+    mat->row_ptr = calloc((size_t)rows + 1, sizeof(size_t));
+    mat->col_idx = malloc((nnz + 1) * sizeof(int));
+    mat->values = malloc((nnz + 1) * sizeof(double));
+    if (!mat->row_ptr || !mat->col_idx || !mat->values) {
+        free_csr(mat);
+        return NULL;
+    }
+
+    return mat;
+}
+
+void free_csr(csr_matrix *mat) {
+    if (mat != NULL) {
+        free(mat->row_ptr);
+        free(mat->col_idx);
+        free(mat->values);
+        free(mat);
+    }
+}
+
+/* Symmetrises per-point neighbour lists by union into a CSR matrix */
+static csr_matrix *knn_to_csr(struct sparse_job *job, int n, int threads) {
+    csr_matrix *A;
+    size_t *fill, total, p;
+    int i, t, j, q;
+
+    /* Every kNN pair (i, j) lands in row i and in row j */
+    job->entry_ptr = calloc((size_t)n + 1, sizeof(size_t));
+    fill = calloc((size_t)n + 1, sizeof(size_t));
+    if (!job->entry_ptr || !fill) {
+        free(fill);
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        for (t = 0; t < job->knn; t++) {
+            job->entry_ptr[i + 1]++;
+            job->entry_ptr[job->nbr_idx[(size_t)i * job->knn + t] + 1]++;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        job->entry_ptr[i + 1] += job->entry_ptr[i];
+    }
+
+    job->entries = malloc((job->entry_ptr[n] + 1) * sizeof(struct csr_entry));
+    if (!job->entries) {
+        free(fill);
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        for (t = 0; t < job->knn; t++) {
+            j = job->nbr_idx[(size_t)i * job->knn + t];
+            p = job->entry_ptr[i] + fill[i]++;
+            job->entries[p].col = j;
+            job->entries[p].value = exp(-0.5 * job->nbr_dist[(size_t)i * job->knn + t]);
+            p = job->entry_ptr[j] + fill[j]++;
+            job->entries[p].col = i;
+            job->entries[p].value = job->entries[job->entry_ptr[i] + fill[i] - 1].value;
+        }
+    }
+    free(fill);
+
+    parallel_for(threads, (n + PAR_ROWS - 1) / PAR_ROWS, dedupe_task, job);
+
+    total = 0;
+    for (i = 0; i < n; i++) {
+        total += job->counts[i];
+    }
+    A = csr_init(n, n, total);
+    if (A == NULL)
+        return NULL;
+
+    for (i = 0; i < n; i++) {
+        A->row_ptr[i + 1] = A->row_ptr[i] + job->counts[i];
+        for (q = 0; q < (int)job->counts[i]; q++) {
+            A->col_idx[A->row_ptr[i] + q] = job->entries[job->entry_ptr[i] + q].col;
+            A->values[A->row_ptr[i] + q] = job->entries[job->entry_ptr[i] + q].value;
+        }
+    }
+
+    return A;
+}
+
+csr_matrix *calc_sym_sparse(const matrix *points, int knn, double threshold, int threads) {
+    struct sparse_job job;
+    csr_matrix *A;
+    size_t total;
+    int i, n, ntasks;
+
+    n = points->rows;
+    ntasks = (n + PAR_ROWS - 1) / PAR_ROWS;
+    memset(&job, 0, sizeof(job));
+    job.points = points;
+    job.knn = knn < n - 1 ? knn : n - 1;
+    job.threshold = threshold;
+    /*
+     * exp(-0.5 * dist) >= threshold  <=>  dist <= -2 ln(threshold). The search
+     * radius is widened by a rounding margin and candidates are checked exactly.
+     */
+    if (threshold > 0) {
+        job.radius2 = -2.0 * log(threshold);
+        job.radius2 += job.radius2 * 1e-9 + 1e-12;
+    }
+    job.counts = malloc(((size_t)n + 1) * sizeof(size_t));
+    job.tree = kdtree_build(points);
+    if (job.counts == NULL || job.tree == NULL) {
+        free(job.counts);
+        kdtree_free(job.tree);
+        return NULL;
+    }
+
+    if (knn > 0) {
+        /* kNN graph */
+        job.nbr_idx = malloc(((size_t)n * job.knn + 1) * sizeof(int));
+        job.nbr_dist = malloc(((size_t)n * job.knn + 1) * sizeof(double));
+        if (!job.nbr_idx || !job.nbr_dist) {
+            A = NULL;
+        } else {
+            parallel_for(threads, ntasks, knn_task, &job);
+            A = knn_to_csr(&job, n, threads);
+        }
+        free(job.nbr_idx);
+        free(job.nbr_dist);
+        free(job.entries);
+        free(job.entry_ptr);
+    } else {
+        /* Threshold graph: count each row, then fill it in place */
+        job.scratch = malloc(((size_t)(threads > 0 ? threads : 1) * n + 1) * sizeof(int));
+        A = NULL;
+        if (job.scratch != NULL) {
+            parallel_for(threads, ntasks, radius_task, &job);
+            total = 0;
+            for (i = 0; i < n; i++) {
+                total += job.counts[i];
+            }
+            A = csr_init(n, n, total);
+        }
+        if (A != NULL) {
+            for (i = 0; i < n; i++) {
+                A->row_ptr[i + 1] = A->row_ptr[i] + job.counts[i];
+            }
+            job.A = A;
+            parallel_for(threads, ntasks, radius_task, &job);
+        }
+        free(job.scratch);
+    }
+
+    free(job.counts);
+    kdtree_free(job.tree);
+
+    return A;
+}
+
+double *calc_ddg_sparse(const csr_matrix *A, int threads) {
+    struct sparse_job job;
+
+    memset(&job, 0, sizeof(job));
+    job.B = A;
+    job.vec = malloc((A->rows > 0 ? A->rows : 1) * sizeof(double));
+    if (job.vec == NULL)
+        return NULL;
+
+    parallel_for(threads, (A->rows + PAR_ROWS - 1) / PAR_ROWS, rowsum_sparse_task, &job);
+
+    return job.vec;
+}
+
+void calc_norm_sparse(csr_matrix *A, double *degrees, int threads) {
+    struct sparse_job job;
+
+    inv_root(degrees, A->rows); /* D <- D^-0.5 */
+
+    memset(&job, 0, sizeof(job));
+    job.A = A;
+    job.vec = degrees;
+    parallel_for(threads, (A->rows + PAR_ROWS - 1) / PAR_ROWS, norm_sparse_task, &job);
+}
+
+void csr_multiply(const csr_matrix *A, const matrix *H, matrix *out, int threads) {
+    struct sparse_job job;
+
+    memset(&job, 0, sizeof(job));
+    job.B = A;
+    job.H = H;
+    job.out = out;
+    parallel_for(threads, (A->rows + PAR_ROWS - 1) / PAR_ROWS, spmm_task, &job);
+}
+
+void print_csr(const csr_matrix *A, out_writer *out) {
+    size_t p;
+    int i, j;
+
+    for (i = 0; i < A->rows; i++) {
+        p = A->row_ptr[i];
+        for (j = 0; j < A->cols; j++) {
+            if (p < A->row_ptr[i + 1] && A->col_idx[p] == j) {
+                writer_value(out, A->values[p++]);
+            } else {
+                writer_value(out, 0.0);
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "symnmf.h"
+
+/*
+ * ============================================================================
+ * Sparse Affinity Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Allocates an empty CSR matrix with room for nnz entries.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param nnz The number of stored entries.
+ * @return A pointer to the matrix, or NULL on allocation failure.
+ */
+csr_matrix *csr_init(int rows, int cols, size_t nnz);
+
+/**
+ * @brief Frees a CSR matrix.
+ * @param mat The matrix to free (may be NULL).
+ */
+void free_csr(csr_matrix *mat);
+
+/**
+ * @brief Builds a sparse similarity matrix A in CSR form.
+ * With knn > 0 each point keeps its knn nearest neighbours and the graph is
+ * symmetrised by union; otherwise every pair with A_ij >= threshold is kept.
+ * When both are given, kNN entries below the threshold are dropped as well.
+ * Neighbours come from a k-d tree over the points, so only nearby pairs are
+ * ever measured; the result equals that of an exhaustive search.
+ * @param points The n x d matrix of data points.
+ * @param knn Neighbours per point, or 0 for a pure threshold graph.
+ * @param threshold Smallest affinity kept, or 0 to keep all kNN entries.
+ * @param threads Number of worker threads.
+ * @return A pointer to the n x n similarity matrix with sorted columns per row, or NULL on allocation failure.
+ */
+csr_matrix *calc_sym_sparse(const matrix *points, int knn, double threshold, int threads);
+
+/**
+ * @brief Calculates the row degrees of a sparse similarity matrix.
+ * @param A The sparse similarity matrix.
+ * @param threads Number of worker threads.
+ * @return A pointer to the allocated vector of n degrees, or NULL on allocation failure.
+ */
+double *calc_ddg_sparse(const csr_matrix *A, int threads);
+
+/**
+ * @brief Turns a sparse A into W = D^-0.5*A*D^-0.5 in place.
+ * @param A The sparse similarity matrix, overwritten by W.
+ * @param degrees The degree vector (replaced by D^-0.5).
+ * @param threads Number of worker threads.
+ */
+void calc_norm_sparse(csr_matrix *A, double *degrees, int threads);
+
+/**
+ * @brief Writes the sparse-times-dense product A * H into out.
+ * @param A The n x n sparse matrix.
+ * @param H The n x k dense matrix.
+ * @param out The n x k output.
+ * @param threads Number of worker threads.
+ */
+void csr_multiply(const csr_matrix *A, const matrix *H, matrix *out, int threads);
+
+/**
+ * @brief Prints a CSR matrix densely, one row at a time, through a writer.
+ * @param A The matrix to print.
+ * @param out A writer opened for rows x cols values.
+ */
+void print_csr(const csr_matrix *A, out_writer *out);
+
+#endif
@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const stage_names[STAGE_COUNT] = {"read", "sym", "ddg", "norm", "init", "solve", "write"};
+
+/* A JSON array of count doubles */
+static void print_array(const double *values, int count, FILE *out) {
+    int i;
+
+    fputc('[', out);
+    for (i = 0; i < count; i++) {
+        fprintf(out, i > 0 ? ", %.17g" : "%.17g", values[i]);
+    }
+    fputc(']', out);
+}
+
+int stats_enabled(void) {
+    const char *env;
+
+    env = getenv(STATS_ENV);
+    return env != NULL && env[0] != '\0' && strcmp(env, "0") != 0;
+}
+
+void stats_reset(symnmf_stats *stats) {
+    memset(stats, 0, sizeof(symnmf_stats));
+}
+
+double stats_start(const symnmf_stats *stats) {
+    struct timespec now;
+
+    if (stats == NULL || clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+        return 0.0;
+    return (double)now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void stats_stop(symnmf_stats *stats, int stage, double start) {
+    if (stats != NULL)
+        stats->seconds[stage] += stats_start(stats) - start;
+}
+
+const char *stage_name(int stage) {
+    return stage_names[stage];
+}
+
+size_t stats_peak_rss(void) {
+    char line[256];
+    unsigned long kb;
+    FILE *status;
+
+    kb = 0;
+    status = fopen("/proc/self/status", "r");
+    if (status == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0 && sscanf(line + 6, "%lu", &kb) == 1)
+            break;
+    }
+    fclose(status);
+    return (size_t)kb * 1024;
+}
+
+void stats_print(const symnmf_stats *stats, FILE *out) {
+    int s;
+
+    fputs("{\"seconds\": {", out);
+    for (s = 0; s < STAGE_COUNT; s++) {
+        fprintf(out, s > 0 ? ", \"%s\": %.17g" : "\"%s\": %.17g", stage_names[s], stats->seconds[s]);
+    }
+    fprintf(out, "}, \"affinity_bytes\": %lu, \"workspace_bytes\": %lu, \"peak_rss_bytes\": %lu, \"iterations\": %d",
+            (unsigned long)stats->affinity_bytes, (unsigned long)stats->workspace_bytes,
+            (unsigned long)stats_peak_rss(), stats->iterations);
+    fputs(", \"update_seconds\": ", out);
+    print_array(stats->update_seconds, stats->iterations, out);
+    fputs(", \"residual\": ", out);
+    print_array(stats->residual, stats->iterations, out);
+    fputs(", \"objective\": ", out);
+    print_array(stats->objective, stats->iterations, out);
+    fputs("}\n", out);
+}
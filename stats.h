@@ -0,0 +1,64 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "symnmf.h"
+#include <stdio.h>
+
+/* Environment variable that turns instrumentation on in the CLI */
+#define STATS_ENV "SYMNMF_STATS"
+
+/*
+ * ============================================================================
+ * Instrumentation Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Whether STATS_ENV asks for instrumentation: set, non-empty and not "0".
+ * @return 1 if so, 0 otherwise.
+ */
+int stats_enabled(void);
+
+/**
+ * @brief Clears a stats record.
+ * @param stats The record.
+ */
+void stats_reset(symnmf_stats *stats);
+
+/**
+ * @brief Reads the monotonic clock at the start of a stage.
+ * @param stats The record, or NULL when instrumentation is off.
+ * @return Seconds on the monotonic clock, or 0 without reading it when stats is NULL.
+ */
+double stats_start(const symnmf_stats *stats);
+
+/**
+ * @brief Charges the time since start to a stage.
+ * @param stats The record, or NULL when instrumentation is off.
+ * @param stage The STAGE_ value.
+ * @param start The value stats_start returned.
+ */
+void stats_stop(symnmf_stats *stats, int stage, double start);
+
+/**
+ * @brief Name of a stage, as used in the JSON output.
+ * @param stage The STAGE_ value.
+ * @return "read", "sym", "ddg", "norm", "init", "solve" or "write".
+ */
+const char *stage_name(int stage);
+
+/**
+ * @brief Peak resident set size of the calling process, from VmHWM in /proc/self/status.
+ * Unlike getrusage's ru_maxrss, it leaves out the pages the process held before its exec.
+ * @return The peak in bytes, or 0 where /proc is not available.
+ */
+size_t stats_peak_rss(void);
+
+/**
+ * @brief Writes a stats record, and the peak RSS of the process so far, as one JSON object and a newline.
+ * @param stats The record.
+ * @param out The stream.
+ */
+void stats_print(const symnmf_stats *stats, FILE *out);
+
+#endif
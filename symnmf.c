@@ -1,11 +1,30 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "symnmf.h"
+#include "gemm.h"
+#include "half.h"
+#include "packed.h"
+#include "parallel.h"
+#include "reader.h"
+#include "rng.h"
+#include "sparse.h"
+#include "stats.h"
+#include "vmath.h"
+#include "writer.h"
+#include <errno.h>
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+
+/* The dense kernels of each precision: calc_sym, ... for double and calc_sym_f, ... for float */
+#define REAL_TEMPLATE "symnmf_real.inc"
+#include "precision.h"
 
-int global_n;
-int global_d;
+/* Record behind opts->stats when the CLI is instrumented */
+static symnmf_stats cli_stats;
 
 /*
  * ============================================================================
@@ -15,466 +34,776 @@ int global_d;
 
 int main(int argc, char *argv[]) {
     char *goal, *file_name;
-    double **data_points;
+    matrix *data_points;
+    symnmf_opts opts;
+    double start;
 
-    /* Check correct number of arguments */
-    if (argc != 3)
-        handle_error();
+    /* Pick the SIMD kernels once, before any worker can race to */
+    gemm_kernel_init();
+    vexp_kernel_name();
+    half_kernel_name();
 
-    /* Read arguments */
-    goal = argv[1];
-    file_name = argv[2];
+    /* Read arguments: [--option=value ...] goal file_name */
+    if (parse_args(argc, argv, &opts, &goal, &file_name) != 0)
+        handle_error();
 
     /* Read file */
+    start = stats_start(opts.stats);
     data_points = read_input(file_name);
     if (data_points == NULL)
         handle_error();
+    stats_stop(opts.stats, STAGE_READ, start);
 
-    run_goal(goal, data_points);
+    run_goal(goal, data_points, &opts);
 
+    if (opts.stats != NULL)
+        stats_print(opts.stats, stderr);
     return 0;
 }
 
-double **read_input(char *file_name) {
-    vector *head_vec, *curr_vec;
-    cord *head_cord, *curr_cord;
-    int rows, err;
-    FILE *fp;
-
-    head_vec = (vector *)malloc(sizeof(vector));
-    curr_vec = head_vec;
-    head_cord = (cord *)malloc(sizeof(cord));
-    curr_cord = head_cord;
-    rows = 0;
-    err = 0;
+int parse_args(int argc, char *argv[], symnmf_opts *opts, char **goal, char **file_name) {
+    char *end;
+    long value;
+    int i, positional;
+
+    opts->threads = default_threads();
+    opts->knn = 0;
+    opts->threshold = 0.0;
+    opts->packed = 0;
+    opts->float32 = 0;
+    opts->half = -1;
+    opts->output = NULL;
+    opts->k = 0;
+    opts->seed = SYMNMF_SEED;
+    opts->method = METHOD_MU;
+    opts->scratch = NULL;
+    opts->stats = stats_enabled() ? &cli_stats : NULL;
+    stats_reset(&cli_stats);
+    positional = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            value = strtol(argv[i] + 10, &end, 10);
+            if (*end != '\0' || value < 1 || value > THREADS_MAX)
+                return 1;
+            opts->threads = (int)value;
+        } else if (strncmp(argv[i], "--knn=", 6) == 0) {
+            value = strtol(argv[i] + 6, &end, 10);
+            if (*end != '\0' || end == argv[i] + 6 || value < 1 || value > 2147483647L)
+                return 1;
+            opts->knn = (int)value;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            opts->threshold = strtod(argv[i] + 12, &end);
+            if (*end != '\0' || end == argv[i] + 12 || !(opts->threshold > 0.0 && opts->threshold <= 1.0))
+                return 1;
+        } else if (strcmp(argv[i], "--packed") == 0) {
+            opts->packed = 1;
+        } else if (strcmp(argv[i], "--float32") == 0) {
+            opts->float32 = 1;
+        } else if (strncmp(argv[i], "--half=", 7) == 0) {
+            opts->half = half_format_from_name(argv[i] + 7);
+            if (opts->half < 0)
+                return 1;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            if (argv[i][9] == '\0')
+                return 1;
+            opts->output = argv[i] + 9;
+        } else if (strncmp(argv[i], "--k=", 4) == 0) {
+            value = strtol(argv[i] + 4, &end, 10);
+            if (*end != '\0' || end == argv[i] + 4 || value < 1 || value > 2147483647L)
+                return 1;
+            opts->k = (int)value;
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            /* Any 32-bit seed, as numpy.random.seed takes */
+            opts->seed = strtoul(argv[i] + 7, &end, 10);
+            if (*end != '\0' || end == argv[i] + 7 || argv[i][7] == '-' || opts->seed > 0xffffffffUL)
+                return 1;
+        } else if (strncmp(argv[i], "--method=", 9) == 0) {
+            opts->method = method_from_name(argv[i] + 9);
+            if (opts->method < 0)
+                return 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            opts->stats = &cli_stats;
+        } else if (strncmp(argv[i], "--scratch=", 10) == 0) {
+            /* Out of core: the packed tiles live in a file */
+            if (argv[i][10] == '\0')
+                return 1;
+            opts->scratch = argv[i] + 10;
+            opts->packed = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            /* Unknown option */
+            return 1;
+        } else if (positional == 0) {
+            *goal = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            *file_name = argv[i];
+            positional++;
+        } else {
+            return 1;
+        }
+    }
 
-    fp = fopen(file_name, "r");
-    if (fp == NULL || head_cord == NULL || head_vec == NULL)
-        return free_read(curr_vec, curr_cord, fp);
+    /* The sparse and packed formats hold doubles */
+    if ((opts->float32 || opts->half >= 0) && (opts->knn > 0 || opts->threshold > 0.0 || opts->packed))
+        return 1;
 
-    err = parse_row(fp, &head_cord, &curr_cord, &curr_vec, &rows);
-    free_cords(head_cord);
-    fclose(fp);
+    return positional == 2 ? 0 : 1;
+}
 
-    if (err)
-        return free_read(head_vec, head_cord, fp);
+out_writer *open_output(const symnmf_opts *opts, int rows, int cols) {
+    out_writer *out;
 
-    return vec_to_mat(head_vec, rows);
+    out = writer_open(opts->output, rows, cols);
+    if (out == NULL)
+        handle_error();
+    return out;
 }
 
-double **vec_to_mat(vector *head_vec, int rows) {
-    vector *curr_vec;
-    cord *curr_cord;
-    double **matrix;
-    int d, i, j;
+void close_output(out_writer *out) {
+    if (writer_close(out) != 0)
+        handle_error();
+}
 
-    curr_vec = head_vec;
-    curr_cord = head_vec->cords;
+void run_goal(const char *goal, matrix *data_points, const symnmf_opts *opts) {
+    out_writer *out;
+    matrix *sym_matrix;
+    double *degrees, start;
+    int n;
 
-    /* Read dimention */
-    d = 0;
-    while (curr_cord != NULL) {
-        d++;
-        curr_cord = curr_cord->next;
+    if (strcmp(goal, "symnmf") == 0) {
+        run_symnmf_goal(data_points, opts);
+        return;
     }
-
-    matrix = matrix_init(rows, d);
-    if (matrix == NULL) {
-        free_vectors(head_vec);
-        return NULL;
+    if (opts->knn > 0 || opts->threshold > 0.0) {
+        run_sparse_goal(goal, data_points, opts);
+        return;
     }
-
-    /* Copy data to matrix */
-    for (i = 0; i < rows; i++) {
-        curr_cord = curr_vec->cords;
-        for (j = 0; j < d; j++) {
-            matrix[i][j] = curr_cord->value;
-            curr_cord = curr_cord->next;
-        }
-        curr_vec = curr_vec->next;
+    if (opts->packed) {
+        run_packed_goal(goal, data_points, opts);
+        return;
+    }
+    if (opts->float32) {
+        run_single_goal(goal, data_points, opts);
+        return;
     }
 
-    free_vectors(head_vec);
-    global_n = rows;
-    global_d = d;
-
-    return matrix;
-}
-
-double **free_read(vector *head_vec, cord *head_cord, FILE *fp) {
-    /* Free used memory */
-    free_vectors(head_vec);
-    free_cords(head_cord);
-
-    /* Close file access */
-    if (fp != NULL)
-        fclose(fp);
-
-    return NULL;
-}
-
-void run_goal(const char *goal, double **data_points) {
-    double **sym_matrix, **ddg_matrix, **result_matrix;
-
+    n = data_points->rows;
     if (strcmp(goal, "sym") == 0) {
         /* Sym */
-        result_matrix = calc_sym(data_points, global_n, global_d);
+        start = stats_start(opts->stats);
+        sym_matrix = calc_sym(data_points, opts->threads);
+        free_matrix(data_points);
+        if (sym_matrix == NULL)
+            handle_error();
+        stats_stop(opts->stats, STAGE_SYM, start);
+        start = stats_start(opts->stats);
+        out = open_output(opts, n, n);
+        print_matrix(sym_matrix, out);
+        close_output(out);
+        stats_stop(opts->stats, STAGE_WRITE, start);
 
     } else if (strcmp(goal, "ddg") == 0) {
-        /* ddg */
-        sym_matrix = calc_sym(data_points, global_n, global_d);
-        result_matrix = calc_ddg(sym_matrix, global_n);
-        free_matrix(sym_matrix, global_n);
+        /* ddg: degrees are summed while A is built */
+        degrees = malloc((n > 0 ? n : 1) * sizeof(double));
+        if (degrees == NULL) {
+            free_matrix(data_points);
+            handle_error();
+        }
+        start = stats_start(opts->stats);
+        sym_matrix = calc_sym_ddg(data_points, degrees, opts->threads);
+        free_matrix(data_points);
+        if (sym_matrix == NULL)
+            handle_error();
+        free_matrix(sym_matrix);
+        sym_matrix = NULL;
+        stats_stop(opts->stats, STAGE_SYM, start);
+        start = stats_start(opts->stats);
+        out = open_output(opts, n, n);
+        print_diag(degrees, n, out);
+        close_output(out);
+        stats_stop(opts->stats, STAGE_WRITE, start);
+        free(degrees);
 
     } else if (strcmp(goal, "norm") == 0) {
         /* norm */
-        sym_matrix = calc_sym(data_points, global_n, global_d);
-        ddg_matrix = calc_ddg(sym_matrix, global_n);
-        result_matrix = calc_norm(sym_matrix, ddg_matrix, global_n);
-        free_matrix(sym_matrix, global_n);
-        free_matrix(ddg_matrix, global_n);
+        start = stats_start(opts->stats);
+        sym_matrix = calc_fused_norm(data_points, opts->threads);
+        free_matrix(data_points);
+        if (sym_matrix == NULL)
+            handle_error();
+        stats_stop(opts->stats, STAGE_SYM, start);
+        start = stats_start(opts->stats);
+        out = open_output(opts, n, n);
+        print_matrix(sym_matrix, out);
+        close_output(out);
+        stats_stop(opts->stats, STAGE_WRITE, start);
 
     } else {
         /* Invalid goal */
+        free_matrix(data_points);
         handle_error();
+        return;
     }
 
-    free_matrix(data_points, global_n);
-    print_matrix(result_matrix, global_n, global_n);
-    free_matrix(result_matrix, global_n);
-}
-
-int parse_row(FILE *fp, cord **head_cord, cord **curr_cord, vector **curr_vec, int *rows) {
-    double n;
-    char c;
-
-    while (fscanf(fp, "%lf%c", &n, &c) == 2) {
-        /* Read value */
-        (*curr_cord)->value = n;
-        if (c == '\n') {
-            /* Line end */
-            (*rows)++;
-            (*curr_vec)->cords = *head_cord;
-
-            /* Allocate next vec */
-            (*curr_vec)->next = (vector *)malloc(sizeof(vector));
-            *curr_vec = (*curr_vec)->next;
-            (*curr_vec)->cords = NULL;
-            (*curr_vec)->next = NULL;
-            *head_cord = (cord *)malloc(sizeof(cord));
-            *curr_cord = *head_cord;
-            (*curr_cord)->next = NULL;
-            if (*curr_cord == NULL || *curr_vec == NULL)
-                return 1;
-        } else {
-            /* Allocate next cord */
-            (*curr_cord)->next = (cord *)malloc(sizeof(cord));
-            *curr_cord = (*curr_cord)->next;
-            if (*curr_cord == NULL)
-                return 1;
-            (*curr_cord)->next = NULL;
-        }
-    }
-
-    return 0;
+    free_matrix(sym_matrix);
 }
 
-/*
- * ============================================================================
- * Core Algorithm Implementations
- * ============================================================================
- */
+void run_packed_goal(const char *goal, matrix *data_points, const symnmf_opts *opts) {
+    out_writer *out;
+    sym_packed *A;
+    double *degrees, start;
+    int n;
 
-double **calc_sym(double **points, int n, int d) {
-    double dist, sym, **matrix;
-    int i, j;
-
-    matrix = matrix_init(n, n);
-    if (matrix == NULL) {
+    if (strcmp(goal, "sym") != 0 && strcmp(goal, "ddg") != 0 && strcmp(goal, "norm") != 0) {
+        /* Invalid goal */
+        free_matrix(data_points);
         handle_error();
     }
 
-    for (i = 0; i < n; i++) {
-        matrix[i][i] = 0.0;
-        for (j = i + 1; j < n; j++) {
-            dist = euclidean_distance(points[i], points[j], d);
-            sym = exp(-0.5 * dist);
-            matrix[i][j] = sym;
-            matrix[j][i] = sym;
-        }
+    n = data_points->rows;
+    degrees = malloc((n > 0 ? n : 1) * sizeof(double));
+    if (degrees == NULL) {
+        free_matrix(data_points);
+        handle_error();
     }
+    start = stats_start(opts->stats);
+    A = calc_sym_packed(data_points, degrees, opts->scratch, opts->threads);
+    free_matrix(data_points);
+    if (A == NULL)
+        handle_error();
+    stats_stop(opts->stats, STAGE_SYM, start);
+    if (strcmp(goal, "norm") == 0) {
+        start = stats_start(opts->stats);
+        calc_norm_packed(A, degrees, opts->threads);
+        stats_stop(opts->stats, STAGE_NORM, start);
+    }
+    start = stats_start(opts->stats);
+    out = open_output(opts, n, n);
+    if (strcmp(goal, "ddg") == 0) {
+        print_diag(degrees, n, out);
+    } else {
+        print_packed(A, out);
+    }
+    close_output(out);
+    stats_stop(opts->stats, STAGE_WRITE, start);
 
-    return matrix;
+    free(degrees);
+    free_packed(A);
 }
 
-double **calc_ddg(double **similarity_matrix, int n) {
-    double sum, **matrix;
-    int i, j;
+void run_sparse_goal(const char *goal, matrix *data_points, const symnmf_opts *opts) {
+    out_writer *out;
+    csr_matrix *A;
+    double *degrees, start;
 
-    matrix = matrix_init(n, n);
-    if (matrix == NULL) {
+    if (strcmp(goal, "sym") != 0 && strcmp(goal, "ddg") != 0 && strcmp(goal, "norm") != 0) {
+        /* Invalid goal */
+        free_matrix(data_points);
         handle_error();
     }
 
-    for (i = 0; i < n; i++) {
-        sum = 0.0;
-        for (j = 0; j < n; j++) {
-            sum += similarity_matrix[i][j];
-        }
-        matrix[i][i] = sum;
+    start = stats_start(opts->stats);
+    A = calc_sym_sparse(data_points, opts->knn, opts->threshold, opts->threads);
+    free_matrix(data_points);
+    if (A == NULL)
+        handle_error();
+    stats_stop(opts->stats, STAGE_SYM, start);
+    degrees = NULL;
+    if (strcmp(goal, "sym") != 0) {
+        start = stats_start(opts->stats);
+        degrees = calc_ddg_sparse(A, opts->threads);
+        if (degrees == NULL)
+            handle_error();
+        stats_stop(opts->stats, STAGE_DDG, start);
+    }
+    if (strcmp(goal, "norm") == 0) {
+        start = stats_start(opts->stats);
+        calc_norm_sparse(A, degrees, opts->threads);
+        stats_stop(opts->stats, STAGE_NORM, start);
+    }
+    start = stats_start(opts->stats);
+    out = open_output(opts, A->rows, A->rows);
+    if (strcmp(goal, "ddg") == 0) {
+        print_diag(degrees, A->rows, out);
+    } else {
+        print_csr(A, out);
     }
+    close_output(out);
+    stats_stop(opts->stats, STAGE_WRITE, start);
+    free(degrees);
 
-    return matrix;
+    free_csr(A);
 }
 
-double **calc_norm(double **similarity_matrix, double **ddg_matrix, int n) {
-    double **tmp, **result;
-
-    inv_root(ddg_matrix, n); /* D <- D^-0.5 */
+void run_single_goal(const char *goal, matrix *data_points, const symnmf_opts *opts) {
+    out_writer *out;
+    matrix_f *points, *sym_matrix;
+    float *degrees;
+    double start;
+    int n;
 
-    tmp = matrix_multiply(ddg_matrix, similarity_matrix, n, n, n); /* D^-0.5*A */
-    if (tmp == NULL) {
+    if (strcmp(goal, "sym") != 0 && strcmp(goal, "ddg") != 0 && strcmp(goal, "norm") != 0) {
+        /* Invalid goal */
+        free_matrix(data_points);
         handle_error();
     }
 
-    result = matrix_multiply(tmp, ddg_matrix, n, n, n); /* D^-0.5*A*D^-0.5 */
+    n = data_points->rows;
+    points = matrix_to_f(data_points);
+    free_matrix(data_points);
+    degrees = malloc((n > 0 ? n : 1) * sizeof(float));
+    if (points == NULL || degrees == NULL) {
+        free_matrix_f(points);
+        free(degrees);
+        handle_error();
+    }
 
-    free_matrix(tmp, n);
-    if (result == NULL) {
+    start = stats_start(opts->stats);
+    sym_matrix = calc_sym_ddg_f(points, degrees, opts->threads);
+    free_matrix_f(points);
+    if (sym_matrix == NULL)
         handle_error();
+    stats_stop(opts->stats, STAGE_SYM, start);
+    if (strcmp(goal, "norm") == 0) {
+        start = stats_start(opts->stats);
+        calc_norm_f(sym_matrix, degrees, opts->threads);
+        stats_stop(opts->stats, STAGE_NORM, start);
     }
+    start = stats_start(opts->stats);
+    out = open_output(opts, n, n);
+    if (strcmp(goal, "ddg") == 0) {
+        print_diag_f(degrees, n, out);
+    } else {
+        print_matrix_f(sym_matrix, out);
+    }
+    close_output(out);
+    stats_stop(opts->stats, STAGE_WRITE, start);
 
-    return result;
+    free(degrees);
+    free_matrix_f(sym_matrix);
 }
 
-double **calc_symnmf(double **W, double **H, int n, int k) {
-    double **H_new, **H_prev;
-    int i;
+void run_symnmf_goal(matrix *data_points, const symnmf_opts *opts) {
+    out_writer *out;
+    matrix *H;
+    double start;
 
-    H_new = NULL;
-    H_prev = H;
-    for (i = 0; i < MAX_ITER; i++) {
-        H_new = H_update(W, H_prev, n, n, n, k);
-        if (H_new == NULL) {
-            if (H_prev != H) {
-                free_matrix(H_prev, n);
-            }
-            return NULL;
-        }
+    H = calc_symnmf_points(data_points, opts);
+    if (H == NULL)
+        handle_error();
 
-        /* Check convergence */
-        if (frobenius_norm(H_prev, H_new, n, k) < EPS) {
-            break;
-        } else {
-            free_matrix(H_prev, n);
-            H_prev = H_new;
-        }
-    }
+    start = stats_start(opts->stats);
+    out = open_output(opts, H->rows, H->cols);
+    print_matrix(H, out);
+    close_output(out);
+    stats_stop(opts->stats, STAGE_WRITE, start);
 
-    free_matrix(H_prev, n);
-    return H_new;
+    free_matrix(H);
 }
 
 /*
  * ============================================================================
- * Helper Function Implementations
+ * Storage-Specific Implementations
  * ============================================================================
  */
 
-void print_matrix(double **matrix, int rows, int cols) {
-    int i, j;
+sym_packed *calc_sym_packed(const matrix *points, double *degrees, const char *scratch, int threads) {
+    sym_packed *result;
 
-    for (i = 0; i < rows; i++) {
-        for (j = 0; j < cols; j++) {
-            printf("%.4f", matrix[i][j]);
-            if (j < cols - 1) {
-                printf(",");
-            }
-        }
-        printf("\n");
+    result = scratch ? packed_init_mapped(points->rows, scratch) : packed_init(points->rows);
+    if (result != NULL && sym_build(points, NULL, result->data, degrees, threads) != 0) {
+        free_packed(result);
+        errno = ENOMEM;
+        return NULL;
     }
+    if (result == NULL && scratch == NULL)
+        errno = ENOMEM;
+    return result;
 }
 
-void free_matrix(double **matrix, int rows) {
-    int i;
+matrix *calc_symnmf_points(matrix *points, const symnmf_opts *opts) {
+    matrix *H;
+    matrix_f *points_f, *W_f, *H_f;
+    affinity W;
+    affinity_f W_single;
+    double start;
+    int n, status;
+
+    n = points->rows;
+    if (opts->k < 1 || opts->k >= n) {
+        free_matrix(points);
+        return NULL;
+    }
 
-    if (matrix != NULL) {
-        /* Free matrix rows */
-        for (i = 0; i < rows; i++) {
-            free(matrix[i]);
+    if (opts->float32) {
+        /* Single precision: W and H in float, H widened at the end */
+        W_f = NULL;
+        W.half = NULL;
+        if (opts->half >= 0) {
+            /* A 16-bit W is narrowed from the double one, as symnmf(..., half=, float32=True) narrows it */
+            if (calc_affinity(points, opts, &W) != 0)
+                return NULL;
+        } else {
+            start = stats_start(opts->stats);
+            points_f = matrix_to_f(points);
+            free_matrix(points);
+            W_f = points_f ? calc_fused_norm_f(points_f, opts->threads) : NULL;
+            free_matrix_f(points_f);
+            if (W_f == NULL)
+                return NULL;
+            stats_stop(opts->stats, STAGE_SYM, start);
         }
-        /* Free matrix pointer */
-        free(matrix);
+        W_single.format = W_f != NULL ? AFFINITY_DENSE : AFFINITY_HALF;
+        W_single.dense = W_f;
+        W_single.csr = NULL;
+        W_single.packed = NULL;
+        W_single.half = W.half;
+        W_single.scale = NULL;
+        if (opts->stats != NULL)
+            opts->stats->affinity_bytes = affinity_bytes_f(&W_single, n);
+        start = stats_start(opts->stats);
+        H_f = init_H_f(&W_single, n, opts->k, opts->seed, opts->threads);
+        stats_stop(opts->stats, STAGE_INIT, start);
+        H_f = H_f ? calc_symnmf_f(&W_single, H_f, opts->threads, opts->method, opts->stats) : NULL;
+        free_matrix_f(W_f);
+        free_half((half_matrix *)W.half);
+        H = H_f ? matrix_from_f(H_f) : NULL;
+        free_matrix_f(H_f);
+        return H;
     }
-}
 
-void handle_error() {
-    printf("An Error Has Occurred\n");
-    exit(1);
-}
+    /* W in the format the options select; a scratch file failure keeps its errno */
+    status = calc_affinity(points, opts, &W);
+    if (status != 0) {
+        if (status != AFFINITY_SCRATCH_ERROR)
+            errno = ENOMEM;
+        return NULL;
+    }
 
-double euclidean_distance(double *vec1, double *vec2, int dim) {
-    double sum, temp;
-    int i;
+    start = stats_start(opts->stats);
+    H = init_H(&W, n, opts->k, opts->seed, opts->threads);
+    stats_stop(opts->stats, STAGE_INIT, start);
+    H = H ? calc_symnmf(&W, H, opts->threads, opts->method, opts->stats) : NULL;
 
-    sum = 0.0;
-    for (i = 0; i < dim; i++) {
-        temp = vec1[i] - vec2[i];
-        temp *= temp;
-        sum += temp;
+    free_affinity(&W);
+    if (H == NULL)
+        errno = ENOMEM;
+    return H;
+}
+
+int calc_affinity(matrix *points, const symnmf_opts *opts, affinity *W) {
+    matrix *W_dense;
+    csr_matrix *W_csr;
+    sym_packed *W_packed;
+    half_matrix *W_half;
+    double *degrees, start;
+    int n, scratch_failed;
+
+    n = points->rows;
+    scratch_failed = 0;
+    W_dense = NULL;
+    W_csr = NULL;
+    W_packed = NULL;
+    W_half = NULL;
+    degrees = NULL;
+    start = stats_start(opts->stats);
+    if (opts->knn > 0 || opts->threshold > 0.0) {
+        W_csr = calc_sym_sparse(points, opts->knn, opts->threshold, opts->threads);
+        stats_stop(opts->stats, STAGE_SYM, start);
+        start = stats_start(opts->stats);
+        degrees = W_csr ? calc_ddg_sparse(W_csr, opts->threads) : NULL;
+        stats_stop(opts->stats, STAGE_DDG, start);
+        start = stats_start(opts->stats);
+        if (degrees != NULL) {
+            calc_norm_sparse(W_csr, degrees, opts->threads);
+        } else {
+            free_csr(W_csr);
+            W_csr = NULL;
+        }
+        stats_stop(opts->stats, STAGE_NORM, start);
+        W->format = AFFINITY_CSR;
+    } else if (opts->packed) {
+        degrees = malloc((n > 0 ? n : 1) * sizeof(double));
+        W_packed = degrees ? calc_sym_packed(points, degrees, opts->scratch, opts->threads) : NULL;
+        scratch_failed = W_packed == NULL && degrees != NULL && opts->scratch != NULL && errno != ENOMEM;
+        stats_stop(opts->stats, STAGE_SYM, start);
+        start = stats_start(opts->stats);
+        if (W_packed != NULL)
+            calc_norm_packed(W_packed, degrees, opts->threads);
+        stats_stop(opts->stats, STAGE_NORM, start);
+        W->format = AFFINITY_PACKED;
+    } else {
+        W_dense = calc_fused_norm(points, opts->threads);
+        W->format = AFFINITY_DENSE;
+        if (W_dense != NULL && opts->half >= 0) {
+            /* W is only read by W * H from here on: keep it in 16 bits */
+            W_half = half_from_matrix(W_dense, opts->half, opts->threads);
+            free_matrix(W_dense);
+            W_dense = NULL;
+            W->format = AFFINITY_HALF;
+        }
+        stats_stop(opts->stats, STAGE_SYM, start);
     }
+    free_matrix(points);
+    free(degrees);
+    W->dense = W_dense;
+    W->csr = W_csr;
+    W->packed = W_packed;
+    W->half = W_half;
+    W->scale = NULL;
+    if (opts->stats != NULL)
+        opts->stats->affinity_bytes = affinity_bytes(W, n);
+
+    if (scratch_failed)
+        return AFFINITY_SCRATCH_ERROR;
+    return W_dense == NULL && W_csr == NULL && W_packed == NULL && W_half == NULL;
+}
 
-    return sum;
+void free_affinity(affinity *W) {
+    /* The views are const for the kernels; the blocks belong to whoever built them */
+    free_matrix((matrix *)W->dense);
+    free_csr((csr_matrix *)W->csr);
+    free_packed((sym_packed *)W->packed);
+    free_half((half_matrix *)W->half);
+    W->dense = NULL;
+    W->csr = NULL;
+    W->packed = NULL;
+    W->half = NULL;
 }
 
-double frobenius_norm(double **matrix1, double **matrix2, int rows, int cols) {
-    double sum, diff;
+/* W * H for W = diag(s) * A * diag(s): A * (s o H) with the rows of the product scaled by s */
+static int scaled_multiply(const affinity *W, const matrix *H, matrix *result, double *work, int threads) {
+    matrix scaled;
     int i, j;
 
-    sum = 0.0;
-    for (i = 0; i < rows; i++) {
-        for (j = 0; j < cols; j++) {
-            diff = matrix1[i][j] - matrix2[i][j];
-            sum += diff * diff;
+    /* s o H is kept unpadded at the head of the workspace, the GEMM scratch after it */
+    scaled.data = work;
+    scaled.rows = H->rows;
+    scaled.cols = H->cols;
+    scaled.stride = H->cols;
+    scaled.map = NULL;
+    scaled.map_size = 0;
+    for (i = 0; i < H->rows; i++) {
+        for (j = 0; j < H->cols; j++) {
+            MAT_AT(&scaled, i, j) = W->scale[i] * MAT_AT(H, i, j);
         }
     }
 
-    return sum;
+    if (matrix_multiply(W->dense, &scaled, result, work + (size_t)H->rows * H->cols, threads) != 0)
+        return 1;
+    for (i = 0; i < result->rows; i++) {
+        for (j = 0; j < result->cols; j++) {
+            MAT_AT(result, i, j) *= W->scale[i];
+        }
+    }
+    return 0;
 }
 
-double **matrix_multiply(double **matrix1, double **matrix2, int row1, int cols1, int cols2) {
-    double **result;
-    int i, j, k;
-
-    result = matrix_init(row1, cols2);
-    if (result == NULL) {
-        handle_error();
+int affinity_multiply(const affinity *W, const matrix *H, matrix *result, double *work, int threads) {
+    if (W->format == AFFINITY_CSR) {
+        csr_multiply(W->csr, H, result, threads);
+        return 0;
     }
+    if (W->format == AFFINITY_PACKED)
+        return symm(W->packed, H, result, work, threads);
+    if (W->format == AFFINITY_HALF)
+        return half_multiply(W->half, H, result, work, threads);
+    if (W->format == AFFINITY_SCALED)
+        return scaled_multiply(W, H, result, work, threads);
+    return matrix_multiply(W->dense, H, result, work, threads);
+}
 
-    for (i = 0; i < row1; i++) {
-        for (j = 0; j < cols2; j++) {
-            for (k = 0; k < cols1; k++) {
-                result[i][j] += matrix1[i][k] * matrix2[k][j];
-            }
-        }
-    }
+int affinity_multiply_f(const affinity_f *W, const matrix_f *H, matrix_f *result, float *work, int threads) {
+    if (W->format == AFFINITY_HALF)
+        return half_multiply_f(W->half, H, result, work, threads);
 
-    return result;
+    /* The sparse and packed formats hold doubles, so the float solver takes a dense or 16-bit W only */
+    if (W->format != AFFINITY_DENSE)
+        return 1;
+    return matrix_multiply_f(W->dense, H, result, work, threads);
 }
 
-double **H_multiply(double **matrix, int rows, int cols) {
-    double **HHt, sum;
-    int i, j, m;
+size_t affinity_workspace_size(const affinity *W, int n, int k, int threads) {
+    /* The multiplies run inline below one thread, but still take one slice */
+    if (threads < 1)
+        threads = 1;
+    /* A packed W's slices are fixed by n, not threads: up to SYMM_SLICES copies of the n x k product */
+    if (W->format == AFFINITY_PACKED)
+        return symm_workspace_size(n, k);
+    if (W->format == AFFINITY_HALF)
+        return (size_t)threads * half_workspace_size(k);
+    if (W->format == AFFINITY_SCALED)
+        return (size_t)n * k + (size_t)threads * gemm_workspace_size(k);
+    return (size_t)threads * gemm_workspace_size(k);
+}
 
-    HHt = matrix_init(rows, rows);
-    if (HHt == NULL) {
-        handle_error();
-    }
+size_t affinity_workspace_size_f(const affinity_f *W, int n, int k, int threads) {
+    (void)n;
+    if (threads < 1)
+        threads = 1;
+    if (W->format == AFFINITY_HALF)
+        return (size_t)threads * half_workspace_size_f(k);
+    return (size_t)threads * gemm_workspace_size_f(k);
+}
+
+double affinity_norm2(const affinity *W, int n) {
+    const double *row;
+    double sum, value;
+    size_t p;
+    int i, j;
 
-    for (i = 0; i < rows; i++) {
-        for (j = i; j < rows; j++) {
-            sum = 0.0;
-            for (m = 0; m < cols; m++) {
-                sum += matrix[i][m] * matrix[j][m];
+    sum = 0.0;
+    if (W->format == AFFINITY_CSR) {
+        for (p = 0; p < W->csr->row_ptr[n]; p++) {
+            sum += W->csr->values[p] * W->csr->values[p];
+        }
+    } else if (W->format == AFFINITY_PACKED) {
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < n; j++) {
+                value = packed_at(W->packed, i, j);
+                sum += value * value;
+            }
+        }
+    } else if (W->format == AFFINITY_HALF) {
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < n; j++) {
+                value = half_to_float(W->half->data[(size_t)i * W->half->stride + j], W->half->format);
+                sum += value * value;
+            }
+        }
+    } else if (W->format == AFFINITY_SCALED) {
+        for (i = 0; i < n; i++) {
+            row = MAT_ROW(W->dense, i);
+            for (j = 0; j < n; j++) {
+                value = W->scale[i] * row[j] * W->scale[j];
+                sum += value * value;
+            }
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            row = MAT_ROW(W->dense, i);
+            for (j = 0; j < n; j++) {
+                sum += row[j] * row[j];
             }
-            HHt[i][j] = sum;
-            HHt[j][i] = sum;
         }
     }
 
-    return HHt;
+    return sum;
 }
 
-double **H_update(double **matrix_W, double **matrix_H, int row_W, int row_H, int cols_W, int cols_H) {
-    double **HHt, **WH, **HHtH, **H_new;
+double affinity_norm2_f(const affinity_f *W, int n) {
+    const float *row;
+    double sum, value;
     int i, j;
 
-    HHt = H_multiply(matrix_H, row_H, cols_H); /* H * H^T */
-    if (HHt == NULL)
-        handle_error();
-
-    WH = matrix_multiply(matrix_W, matrix_H, row_W, cols_W, cols_H); /* W * H */
-    if (WH == NULL) {
-        free_matrix(HHt, row_H);
-        handle_error();
+    sum = 0.0;
+    for (i = 0; i < n; i++) {
+        row = W->format == AFFINITY_DENSE ? MAT_ROW(W->dense, i) : NULL;
+        for (j = 0; j < n; j++) {
+            if (row != NULL)
+                value = row[j];
+            else
+                value = half_to_float(W->half->data[(size_t)i * W->half->stride + j], W->half->format);
+            sum += value * value;
+        }
     }
 
-    HHtH = matrix_multiply(HHt, matrix_H, row_H, row_H, cols_H); /* H * H^T * H */
-    if (HHtH == NULL) {
-        free_matrix(HHt, row_H);
-        free_matrix(WH, row_W);
-        handle_error();
-    }
+    return sum;
+}
 
-    H_new = matrix_init(row_H, cols_H);
-    if (H_new == NULL) {
-        free_matrix(HHt, row_H);
-        free_matrix(WH, row_W);
-        free_matrix(HHtH, row_W);
-        handle_error();
-    }
-    for (i = 0; i < row_H; i++) {
-        for (j = 0; j < cols_H; j++) {
-            H_new[i][j] = matrix_H[i][j] * (1 - BETA + BETA * (WH[i][j] / (HHtH[i][j] + DELTA)));
-        }
-    }
+size_t affinity_bytes(const affinity *W, int n) {
+    size_t tiles;
 
-    free_matrix(HHt, row_H);
-    free_matrix(WH, row_W);
-    free_matrix(HHtH, row_W);
+    if (W->format == AFFINITY_CSR && W->csr != NULL)
+        return ((size_t)n + 1) * sizeof(size_t) + W->csr->nnz * (sizeof(int) + sizeof(double));
+    if (W->format == AFFINITY_PACKED && W->packed != NULL) {
+        tiles = (size_t)W->packed->nblocks * (W->packed->nblocks + 1) / 2;
+        return tiles * SYM_TILE * SYM_TILE * sizeof(double);
+    }
+    if (W->format == AFFINITY_HALF && W->half != NULL)
+        return (size_t)n * W->half->stride * sizeof(unsigned short);
+    if (W->format == AFFINITY_SCALED)
+        return (size_t)n * W->dense->stride * sizeof(double) + (size_t)n * sizeof(double);
+    if (W->dense != NULL)
+        return (size_t)n * W->dense->stride * sizeof(double);
+    return 0;
+}
 
-    return H_new;
+size_t affinity_bytes_f(const affinity_f *W, int n) {
+    if (W->format == AFFINITY_HALF)
+        return (size_t)n * W->half->stride * sizeof(unsigned short);
+    return (size_t)n * W->dense->stride * sizeof(float);
 }
 
-double **matrix_init(int rows, int cols) {
-    double **matrix;
-    int i, r;
+matrix_f *matrix_to_f(const matrix *mat) {
+    matrix_f *result;
+    int i, j;
 
-    matrix = malloc(rows * sizeof(double *));
-    if (!matrix)
+    result = matrix_init_f(mat->rows, mat->cols);
+    if (result == NULL)
         return NULL;
 
-    for (i = 0; i < rows; i++) {
-        matrix[i] = calloc(cols, sizeof(double));
-        if (!matrix[i]) {
-            /* free previously allocated rows and the array */
-            for (r = 0; r < i; r++) {
-                free(matrix[r]);
-            }
-            free(matrix);
-            return NULL;
+    for (i = 0; i < mat->rows; i++) {
+        for (j = 0; j < mat->cols; j++) {
+            /* Values below the float range round to zero rather than to subnormals */
+            MAT_AT(result, i, j) = fabs(MAT_AT(mat, i, j)) < FLT_MIN ? 0.0f : (float)MAT_AT(mat, i, j);
         }
     }
-    return matrix;
+
+    return result;
 }
 
-void inv_root(double **matrix, int n) {
-    int i;
+matrix *matrix_from_f(const matrix_f *mat) {
+    matrix *result;
+    int i, j;
 
-    for (i = 0; i < n; i++) {
-        if (matrix[i][i] != 0) {
-            matrix[i][i] = 1 / sqrt(matrix[i][i]);
+    result = matrix_init(mat->rows, mat->cols);
+    if (result == NULL)
+        return NULL;
+
+    for (i = 0; i < mat->rows; i++) {
+        for (j = 0; j < mat->cols; j++) {
+            MAT_AT(result, i, j) = MAT_AT(mat, i, j);
         }
     }
+
+    return result;
 }
 
-void free_cords(cord *head) {
-    cord *temp;
+/*
+ * ============================================================================
+ * Helper Function Implementations
+ * ============================================================================
+ */
 
-    while (head != NULL) {
-        temp = head;
-        head = head->next;
-        free(temp);
-    }
+void handle_error() {
+    printf("An Error Has Occurred\n");
+    exit(1);
 }
 
-void free_vectors(vector *vec) {
-    vector *temp;
+double euclidean_distance(const double *vec1, const double *vec2, int dim) {
+    double sum, temp;
+    int i;
 
-    while (vec != NULL) {
-        temp = vec;
-        free_cords(vec->cords);
-        vec = vec->next;
-        free(temp);
+    sum = 0.0;
+    for (i = 0; i < dim; i++) {
+        temp = vec1[i] - vec2[i];
+        temp *= temp;
+        sum += temp;
     }
+
+    return sum;
+}
+
+int method_from_name(const char *name) {
+    if (strcmp(name, "mu") == 0)
+        return METHOD_MU;
+    if (strcmp(name, "nesterov") == 0)
+        return METHOD_NESTEROV;
+    if (strcmp(name, "hals") == 0)
+        return METHOD_HALS;
+    if (strcmp(name, "anls") == 0)
+        return METHOD_ANLS;
+    return -1;
 }
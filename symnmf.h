@@ -6,6 +6,20 @@
 #define BETA 0.5
 #define DELTA 0.000000001
 
+/* Weight of the H = G coupling of the HALS and ANLS engines; a normalized W has spectral norm at most 1 */
+#define SPLIT_LAMBDA 1.0
+
+/* Coordinate-descent sweeps per row, and the squared change that ends them, of the ANLS engine */
+#define ANLS_SWEEPS 50
+#define ANLS_TOL 1e-12
+
+/* Side of the square tiles the affinity kernels work on */
+#define SYM_TILE 64
+
+/* calc_affinity's result when the scratch file of an out-of-core W cannot be created or reserved */
+#define AFFINITY_SCRATCH_ERROR 2
+
+#include "writer.h"
 #include <stdio.h>
 
 /*
@@ -14,222 +28,297 @@
  * ============================================================================
  */
 
-struct cord {
-    double value;
-    struct cord *next;
-};
+/* Byte alignment of matrix blocks and rows (one cache line) */
+#define MATRIX_ALIGN 64
 
-struct vector {
-    struct cord *cords;
-    struct vector *next;
+/**
+ * @brief A sparse matrix in compressed sparse row form.
+ * The entries of row i are values[row_ptr[i] .. row_ptr[i + 1]), with their
+ * column indices, in increasing order, at the same positions of col_idx.
+ */
+struct csr_matrix {
+    int rows;
+    int cols;
+    size_t nnz;
+    size_t *row_ptr;
+    int *col_idx;
+    double *values;
 };
 
-typedef struct cord cord;
-typedef struct vector vector;
+typedef struct csr_matrix csr_matrix;
 
-/*
- * ============================================================================
- * Command Line Execution Helper Function Prototypes
- * ============================================================================
+/**
+ * @brief A symmetric n x n matrix stored as its upper triangle of SYM_TILE x SYM_TILE tiles.
+ * Tile (bi, bj), bi <= bj, is a dense row-major block at PACKED_TILE(p, bi, bj);
+ * diagonal tiles are stored in full, and entries past row or column n are zero.
+ * An out-of-core matrix keeps its tiles in a shared mapping of map_size bytes
+ * of an unlinked scratch file; map_size is 0 for a matrix that owns its block.
  */
+struct sym_packed {
+    int n;
+    int nblocks;
+    double *data;
+    size_t map_size;
+};
 
-/**
- * @brief Reads points from a txt file.
- * @param file_name name of the file.
- * @return A 2D matrix of doubles
- **/
-double **read_input(char *file_name);
+typedef struct sym_packed sym_packed;
 
-/**
- * @brief Converts a linked list of vectors to a 2D matrix.
- * @param head_vec Pointer to the head of the vector linked list.
- * @param rows Number of rows (vectors) in the list.
- * @return A pointer to the allocated 2D matrix.
- */
-double **vec_to_mat(vector *head_vec, int rows);
+/* Element formats of a half_matrix: IEEE binary16 and bfloat16 */
+enum half_format { HALF_FP16, HALF_BF16 };
 
 /**
- * @brief Frees memory allocated for vectors and cords during file read, closes file, and returns NULL.
- * @param head_vec Pointer to the head of the vector linked list.
- * @param head_cord Pointer to the head of the cord linked list.
- * @param fp Pointer to the open file (can be NULL if file read failed).
- * @return Always returns NULL for error handling.
+ * @brief A dense row-major matrix of 16-bit floats, widened to float or double on use.
+ * Rows are laid out as in a matrix: row i starts at data + i * stride, on a
+ * MATRIX_ALIGN boundary, and padding entries are zero.
  */
-double **free_read(vector *head_vec, cord *head_cord, FILE *fp);
+struct half_matrix {
+    unsigned short *data;
+    int rows;
+    int cols;
+    int stride;
+    int format;
+};
+
+typedef struct half_matrix half_matrix;
+
+/* Solver engines of calc_symnmf */
+enum symnmf_method { METHOD_MU, METHOD_NESTEROV, METHOD_HALS, METHOD_ANLS };
+
+/* Stages timed by a symnmf_stats */
+enum symnmf_stage { STAGE_READ, STAGE_SYM, STAGE_DDG, STAGE_NORM, STAGE_INIT, STAGE_SOLVE, STAGE_WRITE, STAGE_COUNT };
 
 /**
- * @brief Parses a row from a file and builds linked lists of cords and vectors.
- * @param fp Pointer to the open file.
- * @param head_cord Pointer to the head of the cord linked list.
- * @param curr_cord Pointer to the current cord node.
- * @param curr_vec Pointer to the current vector node.
- * @param rows Pointer to the row count variable.
- * @return 0 on success, 1 on allocation error.
+ * @brief Instrumentation of one run, filled only where a caller passes one in.
+ * seconds holds the monotonic time of each stage; a kernel that fuses stages is
+ * charged to the first of them. affinity_bytes and workspace_bytes are the blocks
+ * allocated for W and for the solver. Iteration t took update_seconds[t], changed
+ * H by residual[t] and started from an H with objective[t] = ||W - H H^T||_F^2.
+ * For the Nesterov engine that H is the extrapolated point, not the last iterate,
+ * so its objective need not fall monotonically.
  */
-int parse_row(FILE *fp, cord **head_cord, cord **curr_cord, vector **curr_vec, int *rows);
+struct symnmf_stats {
+    double seconds[STAGE_COUNT];
+    size_t affinity_bytes;
+    size_t workspace_bytes;
+    int iterations;
+    double update_seconds[MAX_ITER];
+    double residual[MAX_ITER];
+    double objective[MAX_ITER];
+};
+
+typedef struct symnmf_stats symnmf_stats;
+
+/* Storage formats of an affinity matrix */
+enum affinity_format { AFFINITY_DENSE, AFFINITY_CSR, AFFINITY_PACKED, AFFINITY_HALF, AFFINITY_SCALED };
+
+/* Dense matrices, affinity views, SymNMF workspaces and kernels of each precision */
+#define REAL_TEMPLATE "symnmf_real.h"
+#include "precision.h"
 
 /**
- * @brief Executes the specified goal using the provided data points and prints the result.
- * @param goal The goal string ("sym", "ddg", or "norm").
- * @param data_points The input data points matrix.
+ * @brief Command line options, filled by parse_args.
  */
-void run_goal(const char *goal, double **data_points);
+struct symnmf_opts {
+    int threads;
+    int knn;
+    double threshold;
+    int packed;
+    int float32;
+    int half;
+    char *output;
+    int k;
+    unsigned long seed;
+    int method;
+    symnmf_stats *stats;
+    char *scratch;
+};
+
+typedef struct symnmf_opts symnmf_opts;
+
+/* Seed of the initial H, as in symnmf.py */
+#define SYMNMF_SEED 1234
+
+/* Pointer to the first element of row i */
+#define MAT_ROW(m, i) ((m)->data + (size_t)(i) * (size_t)(m)->stride)
+
+/* Element (i, j) as an lvalue */
+#define MAT_AT(m, i, j) (MAT_ROW(m, i)[j])
+
+/* Index of tile (bi, bj), bi <= bj, in row-major order of the upper triangle */
+#define PACKED_INDEX(p, bi, bj) ((size_t)(bi) * (p)->nblocks - (size_t)(bi) * ((bi) - 1) / 2 + (size_t)((bj) - (bi)))
+
+/* First element of tile (bi, bj), bi <= bj */
+#define PACKED_TILE(p, bi, bj) ((p)->data + PACKED_INDEX(p, bi, bj) * SYM_TILE * SYM_TILE)
 
 /*
  * ============================================================================
- * Function Prototypes
+ * Command Line Execution Helper Function Prototypes
  * ============================================================================
  */
 
 /**
- * @brief Calculates the similarity matrix A from a set of data points X.
- * @param points An array of data points.
- * @param n Number of data points.
- * @param d Dimension of each data point.
- * @return A pointer to the allocated similarity matrix.
+ * @brief Parses the command line: [--threads=N] [--knn=K] [--threshold=T] [--packed] [--float32]
+ *        [--half=F] [--output=FILE] [--k=K] [--seed=S] [--method=M] [--stats] [--scratch=DIR]
+ *        goal file_name.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param opts Output options; unset ones take their defaults (threads from SYMNMF_THREADS,
+ *             dense affinities when neither knn nor threshold is given, double precision,
+ *             text on standard output unless --output names a .npy file to write).
+ *             --float32 applies to dense affinities only, as does --half (fp16 or bf16),
+ *             which stores the W of the symnmf goal in 16 bits; half is -1 without it.
+ *             The symnmf goal needs --k,
+ *             and its initial H is drawn with seed SYMNMF_SEED unless --seed is given;
+ *             --method picks its solver engine (mu by default, nesterov, hals or anls).
+ *             --stats, or a SYMNMF_STATS other than 0, points stats at a record the
+ *             CLI prints as JSON on standard error; it is NULL otherwise. --scratch
+ *             implies --packed and keeps the tiles of A and W in a file under DIR
+ *             instead of memory, for n whose W does not fit in RAM.
+ * @param goal Output goal string.
+ * @param file_name Output input file name.
+ * @return 0 on success, 1 on invalid arguments.
  */
-double **calc_sym(double **points, int n, int d);
+int parse_args(int argc, char *argv[], symnmf_opts *opts, char **goal, char **file_name);
 
 /**
- * @brief Calculates the Diagonal Degree Matrix D from the similarity matrix A.
- * @param similarity_matrix The similarity matrix A.
- * @param n The number of data points.
- * @return A pointer to the allocated diagonal degree matrix.
+ * @brief Opens the writer for a rows x cols result: the --output file, or standard output.
+ * Exits with the error message if it cannot be opened.
+ * @param opts The command line options.
+ * @param rows Number of rows of the result.
+ * @param cols Number of columns of the result.
+ * @return The writer.
  */
-double **calc_ddg(double **similarity_matrix, int n);
+out_writer *open_output(const symnmf_opts *opts, int rows, int cols);
 
 /**
- * @brief Calculates the normalized similarity matrix W.
- * @param similarity_matrix The similarity matrix A.
- * @param ddg_matrix The diagonal degree matrix D.
- * @param n The number of data points.
- * @return A pointer to the allocated normalized similarity matrix.
+ * @brief Flushes and closes a writer from open_output, exiting with the error message if a write failed.
+ * @param out The writer.
  */
-double **calc_norm(double **similarity_matrix, double **ddg_matrix, int n);
+void close_output(out_writer *out);
 
 /**
- * @brief Performs the symmetric Non-negative Matrix Factorization optimization.
- * @param W The normalized similarity matrix.
- * @param H The initial H matrix.
- * @param n The number of data points.
- * @param k The number of clusters.
- * @return A pointer to the final optimized H matrix.
+ * @brief Executes the specified goal using the provided data points and prints the result.
+ * @param goal The goal string ("sym", "ddg", "norm", or "symnmf").
+ * @param data_points The input data points matrix.
+ * @param opts The command line options.
  */
-double **calc_symnmf(double **W, double **H, int n, int k);
+void run_goal(const char *goal, matrix *data_points, const symnmf_opts *opts);
 
-/*
- * ============================================================================
- * Helper Function Prototypes
- * ============================================================================
+/**
+ * @brief Executes a goal on a sparse kNN or threshold affinity graph and prints the result densely.
+ * @param goal The goal string ("sym", "ddg", or "norm").
+ * @param data_points The input data points matrix (freed here).
+ * @param opts The command line options, with knn or threshold set.
  */
+void run_sparse_goal(const char *goal, matrix *data_points, const symnmf_opts *opts);
 
 /**
- * @brief Prints a matrix to standard output in the required format.
- * @param matrix The matrix to print.
- * @param rows The number of rows in the matrix.
- * @param cols The number of columns in the matrix.
+ * @brief Executes a goal with A held in packed symmetric storage and prints the result in full.
+ * @param goal The goal string ("sym", "ddg", or "norm").
+ * @param data_points The input data points matrix (freed here).
+ * @param opts The command line options.
  */
-void print_matrix(double **matrix, int rows, int cols);
+void run_packed_goal(const char *goal, matrix *data_points, const symnmf_opts *opts);
 
 /**
- * @brief Frees the memory allocated for a 2D matrix.
- * @param matrix The matrix to free.
- * @param rows The number of rows in the matrix.
+ * @brief Executes a goal in single precision and prints the result.
+ * @param goal The goal string ("sym", "ddg", or "norm").
+ * @param data_points The input data points matrix (freed here).
+ * @param opts The command line options.
  */
-void free_matrix(double **matrix, int rows);
+void run_single_goal(const char *goal, matrix *data_points, const symnmf_opts *opts);
 
 /**
- * @brief Handles errors by printing a standard message and exiting.
+ * @brief Executes the symnmf goal: prints the n x k H found from the points.
+ * @param data_points The input data points matrix (freed here).
+ * @param opts The command line options, with k set.
  */
-void handle_error();
+void run_symnmf_goal(matrix *data_points, const symnmf_opts *opts);
 
-/**
- * @brief calculates squared Euclidean distance of two vectors.
- * @param vec1 The first vector.
- * @param vec2 The second vector.
- * @param dim The vectors size.
- * @return Euclidean distance.
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
  */
-double euclidean_distance(double *vec1, double *vec2, int dim);
 
 /**
- * @brief calculates squared Frobenius norm of a 2D matrix.
- * @param matrix1 The matrix to calculate.
- * @param matrix2 The matrix to calculate.
- * @param rows The number of rows in the matrix.
- * @param cols The number of columns in the matrix.
- * @param dim the vector dimansion.
- * @return Frobenius norm.
+ * @brief Calculates the similarity matrix A into packed symmetric storage, and optionally its degrees.
+ * @param points The n x d matrix of data points.
+ * @param degrees Output vector of n degrees, or NULL to skip them.
+ * @param scratch Directory of the file that holds the tiles out of core, or NULL to keep them in memory.
+ * @param threads Number of worker threads.
+ * @return A pointer to the packed n x n similarity matrix, or NULL with errno set on allocation
+ *         (ENOMEM) or scratch file failure.
  */
-double frobenius_norm(double **matrix1, double **matrix2, int rows, int cols);
+sym_packed *calc_sym_packed(const matrix *points, double *degrees, const char *scratch, int threads);
 
 /**
- * @brief Returns the multiplication of two matrixes.
- * @param matrix1 The  first matrix.
- * @param matrix2 The  second matrix.
- * @param row1 The first matrix number of rows.
- * @param cols1 The first matrix number of columns.
- * @param cols2 The second matrix number of columns.
- * @returns a pointer to the caluclated matrix.
+ * @brief End-to-end SymNMF from the points: builds W in the storage format opts selects,
+ * draws the initial H with init_H and solves, so W never leaves C.
+ * @param points The n x d matrix of data points (freed here).
+ * @param opts Thread count, affinity format and precision, k (1 <= k < n) and seed.
+ * @return A pointer to the n x k H matrix in double, or NULL on invalid k or failure; errno is
+ *         then ENOMEM, or the error of the scratch file when it could not be created or reserved.
  */
-double **matrix_multiply(double **matrix1, double **matrix2, int row1, int cols1, int cols2);
+matrix *calc_symnmf_points(matrix *points, const symnmf_opts *opts);
 
 /**
- * @brief Calculates H * H^T (Matrix multiplication)
- * @param matrix The matrix to calculate.
- * @param rows The number of rows in the matrix.
- * @param cols The number of columns in the matrix.
- * @returns pointer to a new H*H^T matrix.
+ * @brief Builds the normalized similarity matrix W of the points, in double, dense or in the
+ * packed or CSR (knn / threshold) format opts selects; a dense W is narrowed to 16 bits when
+ * opts->half is set.
+ * @param points The n x d matrix of data points (freed here).
+ * @param opts Thread count and affinity format.
+ * @param W Output view of W; release it with free_affinity.
+ * @return 0 on success, 1 on allocation failure, or AFFINITY_SCRATCH_ERROR with errno set when
+ *         the scratch file of an out-of-core W cannot be created or reserved.
  */
-double **H_multiply(double **matrix, int rows, int cols);
+int calc_affinity(matrix *points, const symnmf_opts *opts, affinity *W);
 
 /**
- * @brief Returns the subtraction of two matrixes.
- * @param matrix1 The first matrix.
- * @param matrix2 The second matrix.
- * @param rows The matrix number of rows.
- * @param cols The first  number of columns.
- * @returns a pointer to the caluclated matrix.
+ * @brief Frees the storage behind an affinity view built by calc_affinity.
+ * @param W The view; its pointers are reset to NULL.
  */
-double **matrix_subtract(double **matrix1, double **matrix2, int rows, int cols);
+void free_affinity(affinity *W);
 
 /**
- * @brief Returns the next iteration of H
- * @param matrix_W The W matrix.
- * @param matrix_H The H matrix.
- * @param row_W The W matrix number of rows.
- * @param row_H The H matrix number of columns.
- * @param cols_W The W matrix number of columns.
- * @param cols_H The H matrix number of columns.
- * @returns a pointer to the caluclated matrix.
+ * @brief Rounds a double matrix to a new float matrix.
+ * @param mat The matrix to convert.
+ * @return The float copy, or NULL on allocation failure.
  */
-double **H_update(double **matrix_W, double **matrix_H, int row_W, int row_H, int cols_W, int cols_H);
+matrix_f *matrix_to_f(const matrix *mat);
 
 /**
- * @brief initilize a matrix full of 0.0
- * @param rows The number of rows in the matrix.
- * @param cols The number of columns in the matrix.
- * @returns a pointer to the matrix
+ * @brief Widens a float matrix to a new double matrix.
+ * @param mat The matrix to convert.
+ * @return The double copy, or NULL on allocation failure.
+ */
+matrix *matrix_from_f(const matrix_f *mat);
+
+/*
+ * ============================================================================
+ * Helper Function Prototypes
+ * ============================================================================
  */
-double **matrix_init(int rows, int cols);
 
 /**
- * @brief changes the degree matrix D into D^(-0.5).
- * @param D pointer to matrix D.
- * @param n the size of the matrix.
+ * @brief Handles errors by printing a standard message and exiting.
  */
-void inv_root(double **matrix, int n);
+void handle_error();
 
 /**
- * @brief Frees the memory allocated for a cord structure.
- * @param cor The cord to free.
+ * @brief calculates squared Euclidean distance of two vectors.
+ * @param vec1 The first vector.
+ * @param vec2 The second vector.
+ * @param dim The vectors size.
+ * @return Euclidean distance.
  */
-void free_cords(cord *cor);
+double euclidean_distance(const double *vec1, const double *vec2, int dim);
 
 /**
- * @brief Frees the memory allocated for a vector structure.
- * @param vec The vec to free.
+ * @brief Looks up a solver engine by name.
+ * @param name "mu", "nesterov", "hals" or "anls".
+ * @return The METHOD_ value, or -1 for an unknown name.
  */
-void free_vectors(vector *vec);
+int method_from_name(const char *name);
 
 #endif
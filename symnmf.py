@@ -3,7 +3,7 @@ import numpy as np
 import mysymnmf as symnmf
 
 
-def print_matrix(matrix: list[list[float]]):
+def print_matrix(matrix: np.ndarray):
     """
     Prints a matrix with 4 decimal places, comma-separated.
     Each row is printed on a new line.
@@ -29,37 +29,37 @@ def init_H(w_matrix: np.ndarray, k: int) -> np.ndarray:
     return np.random.uniform(0.0, 2.0 * np.sqrt(m / float(k)), size=(len(w_matrix), k)).astype(np.float64, copy=False)
 
 
-def run_symnmf(k: int, goal: str, file_name: str) -> list[list[float]]:
+def run_symnmf(k: int, goal: str, file_name: str, output: str | None = None) -> np.ndarray | tuple[int, int]:
     """
     Main execution function for SymNMF goals. Reads input data and executes the requested goal.
     
     Args:
         k (int): Number of clusters/components.
         goal (str): The goal to execute ("sym", "ddg", "norm", "symnmf").
-        file_name (str): Path to the input data file.
+        file_name (str): Path to the input data file: comma-separated text, .npy, or raw binary.
+        output (str): Optional .npy file the module writes the result to instead of returning it.
     Returns:
-        list: Resulting matrix as a list of lists.
+        np.ndarray: Resulting matrix, or its (rows, cols) shape when output is given.
     """
     try:
-        data_points = np.loadtxt(file_name, delimiter=",")
-        data_points_list = data_points.tolist()
-        n, d = data_points.shape
+        # The module reads the file with the CLI's reader: text is parsed, .npy and raw files are mapped.
+        # Results come back as numpy arrays over the C buffers, and go back in without a copy
+        data_points = symnmf.read(file_name)
         result_matrix = None
 
-        if (k >= n): 
+        if (k >= len(data_points)):
             handle_error()
 
         match goal:
             case "sym":
-                result_matrix = symnmf.sym(data_points_list, n, d)
+                result_matrix = symnmf.sym(data_points, output=output)
             case "ddg":
-                result_matrix = symnmf.ddg(data_points_list, n, d)
+                result_matrix = symnmf.ddg(data_points, output=output)
             case "norm":
-                result_matrix = symnmf.norm(data_points_list, n, d)
+                result_matrix = symnmf.norm(data_points, output=output)
             case "symnmf":
-                w_matrix = symnmf.norm(data_points_list, n, d)
-                h_init = init_H(w_matrix, k)
-                result_matrix = symnmf.symnmf(w_matrix, h_init.tolist(), n, k)
+                # W is built, H drawn as init_H draws it, and the solve run in C; only H comes back
+                result_matrix = symnmf.fit(data_points, k, output=output)
 
         if result_matrix is None:
             raise RuntimeError
@@ -76,15 +76,25 @@ def handle_error():
     print("An Error Has Occurred")
     sys.exit(1)
 
-def parse_args(args: list[str]) -> tuple[int, str, str]:
+def parse_args(args: list[str]) -> tuple[int, str, str, str | None]:
     """
-    Parses and validates command-line arguments.
+    Parses and validates command-line arguments: k goal file_name, plus an optional --output=FILE
+    that writes the result to a .npy file instead of printing it.
     
     Args:
         args (list): List of command-line arguments.
     Returns:
-        tuple: (k, goal, file_name)
+        tuple: (k, goal, file_name, output)
     """
+    # Take out the output option
+    output = None
+    for arg in args[1:]:
+        if arg.startswith("--output="):
+            output = arg[len("--output="):]
+            if not output:
+                handle_error()
+    args = [arg for arg in args if not arg.startswith("--output=")]
+
     # Check correct number of arguments
     if len(args) != 4:
         handle_error()
@@ -110,8 +120,10 @@ def parse_args(args: list[str]) -> tuple[int, str, str]:
     except Exception:
         handle_error()
         
-    return k, goal, file_name
+    return k, goal, file_name, output
 
 if __name__ == "__main__":
-    k, goal, file_name = parse_args(sys.argv)
-    print_matrix(run_symnmf(k, goal, file_name))
+    k, goal, file_name, output = parse_args(sys.argv)
+    result = run_symnmf(k, goal, file_name, output)
+    if output is None:
+        print_matrix(result)
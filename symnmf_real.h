@@ -0,0 +1,323 @@
+/*
+ * Dense SymNMF types and kernels for one precision; instantiated through
+ * precision.h, so matrix, calc_sym, ... are double and matrix_f, calc_sym_f,
+ * ... are float. The algorithms are identical; only the element type differs.
+ */
+
+/*
+ * ============================================================================
+ * Struct definitions
+ * ============================================================================
+ */
+
+/**
+ * @brief A dense row-major matrix stored in one aligned block.
+ * Row i starts at data + i * stride. The stride is padded so that every row
+ * begins on a MATRIX_ALIGN boundary; padding entries are kept at zero.
+ * A matrix read from a binary file instead views the read-only mapping map
+ * of map_size bytes, with unpadded rows (stride == cols); map is NULL for a
+ * matrix that owns its block.
+ */
+struct R(matrix) {
+    REAL *data;
+    int rows;
+    int cols;
+    int stride;
+    void *map;
+    size_t map_size;
+};
+
+typedef struct R(matrix) R(matrix);
+
+/**
+ * @brief A borrowed view of the affinity matrix W in any storage format.
+ * Exactly one of dense, csr, packed and half is set, as selected by format; the
+ * sparse and packed formats hold doubles and are used by the double solver only,
+ * while a 16-bit W serves both precisions. A scaled W is diag(scale) * dense *
+ * diag(scale), with dense holding A and scale D^-0.5, so W is never formed; it
+ * is used by the double solver only.
+ */
+struct R(affinity) {
+    int format;
+    const R(matrix) *dense;
+    const csr_matrix *csr;
+    const sym_packed *packed;
+    const half_matrix *half;
+    const REAL *scale;
+};
+
+typedef struct R(affinity) R(affinity);
+
+/**
+ * @brief Workspace for the SymNMF iterations, allocated once per solve.
+ * H[cur] holds the current iterate and H[1 - cur] receives the next one;
+ * work is the GEMM packing scratch of every worker, and the partial arrays
+ * hold one Gram matrix and one residual per PAR_ROWS block of H.
+ * method selects the engine. The HALS and ANLS engines split H into the pair
+ * H, G, coupled by SPLIT_LAMBDA, and keep the second factor in G; the Nesterov
+ * engine keeps its last unextrapolated iterate in prev, with the steps since
+ * its last restart in momentum. G and prev are NULL for the engines without them.
+ * bytes counts every block the workspace allocated.
+ */
+struct R(symnmf_ctx) {
+    const R(affinity) *W;
+    R(matrix) *H[2];
+    R(matrix) *WH;
+    R(matrix) *HtH;
+    R(matrix) *HHtH;
+    R(matrix) *G;
+    R(matrix) *prev;
+    REAL *work;
+    REAL *gram_partial;
+    double *res_partial;
+    double last_residual;
+    size_t bytes;
+    int threads;
+    int cur;
+    int method;
+    int momentum;
+};
+
+typedef struct R(symnmf_ctx) R(symnmf_ctx);
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Calculates the similarity matrix A from a set of data points X.
+ * @param points The n x d matrix of data points.
+ * @param threads Number of worker threads.
+ * @return A pointer to the allocated n x n similarity matrix, or NULL on allocation failure.
+ */
+R(matrix) *R(calc_sym)(const R(matrix) *points, int threads);
+
+/**
+ * @brief Builds the similarity matrix A tile by tile, summing row degrees as tiles are produced.
+ * The degrees are reduced in a fixed tile order, so they do not depend on traversal order.
+ * @param points The n x d matrix of data points.
+ * @param degrees Output vector of n degrees, or NULL to skip the sums.
+ * @param threads Number of worker threads.
+ * @return A pointer to the allocated n x n similarity matrix, or NULL on allocation failure.
+ */
+R(matrix) *R(calc_sym_ddg)(const R(matrix) *points, REAL *degrees, int threads);
+
+/**
+ * @brief Fused sym -> ddg -> norm: builds W from the points with one pass writing A
+ * and its degrees and a second pass applying the D^-0.5 scaling in place.
+ * @param points The n x d matrix of data points.
+ * @param threads Number of worker threads.
+ * @return A pointer to the allocated n x n normalized similarity matrix, or NULL on allocation failure.
+ */
+R(matrix) *R(calc_fused_norm)(const R(matrix) *points, int threads);
+
+/**
+ * @brief Calculates the diagonal of the Degree Matrix D from the similarity matrix A.
+ * @param similarity_matrix The similarity matrix A.
+ * @param threads Number of worker threads.
+ * @return A pointer to the allocated vector of n row degrees, or NULL on allocation failure.
+ */
+REAL *R(calc_ddg)(const R(matrix) *similarity_matrix, int threads);
+
+/**
+ * @brief Turns the similarity matrix A into the normalized matrix W = D^-0.5*A*D^-0.5 in place.
+ * Diagonal scaling is elementwise, so this is O(n^2) and needs no temporary.
+ * @param similarity_matrix The similarity matrix A, overwritten by W.
+ * @param degrees The degree vector (replaced by D^-0.5).
+ * @param threads Number of worker threads.
+ */
+void R(calc_norm)(R(matrix) *similarity_matrix, REAL *degrees, int threads);
+
+/**
+ * @brief Calculates mean(W), the sum of its entries over n^2, from the row sums W * 1.
+ * @param W The n x n normalized similarity matrix, in any storage format.
+ * @param n Number of points.
+ * @param threads Number of worker threads.
+ * @return The mean, or -1 on failure.
+ */
+double R(affinity_mean)(const R(affinity) *W, int n, int threads);
+
+/**
+ * @brief Draws the initial H uniformly from [0, 2 * sqrt(mean(W) / k)].
+ * The draws repeat those of numpy.random.uniform after numpy.random.seed(seed).
+ * @param W The n x n normalized similarity matrix, in any storage format.
+ * @param n Number of points.
+ * @param k Number of clusters.
+ * @param seed Seed of the generator.
+ * @param threads Number of worker threads used for mean(W).
+ * @return A pointer to the n x k H matrix, or NULL on failure.
+ */
+R(matrix) *R(init_H)(const R(affinity) *W, int n, int k, unsigned long seed, int threads);
+
+/**
+ * @brief Performs the symmetric Non-negative Matrix Factorization optimization.
+ * @param W The n x n normalized similarity matrix, in any storage format.
+ * @param H The initial n x k H matrix. Ownership passes to this function.
+ * @param threads Number of worker threads.
+ * @param method The solver engine, METHOD_MU for the multiplicative update of symnmf.py.
+ * @param stats Record of the solve time, workspace and iterations, or NULL. The objective
+ *              trajectory costs one pass over W up front and O(nk) per iteration.
+ * @return A pointer to the final optimized H matrix, or NULL on failure.
+ */
+R(matrix) *R(calc_symnmf)(const R(affinity) *W, R(matrix) *H, int threads, int method, symnmf_stats *stats);
+
+/**
+ * @brief Prints a matrix in the required format, or as .npy, through a writer.
+ * @param mat The matrix to print.
+ * @param out A writer opened for mat->rows x mat->cols values.
+ */
+void R(print_matrix)(const R(matrix) *mat, out_writer *out);
+
+/**
+ * @brief Prints a diagonal matrix, given its diagonal, in full through a writer.
+ * @param diag The diagonal entries.
+ * @param n The size of the matrix.
+ * @param out A writer opened for n x n values.
+ */
+void R(print_diag)(const REAL *diag, int n, out_writer *out);
+
+/**
+ * @brief Frees the memory allocated for a matrix.
+ * @param mat The matrix to free (may be NULL).
+ */
+void R(free_matrix)(R(matrix) *mat);
+
+/**
+ * @brief Number of elements of per-worker scratch sym_tile needs.
+ * @param d Dimension of the points.
+ * @return The workspace size, in elements.
+ */
+size_t R(sym_tile_workspace)(int d);
+
+/**
+ * @brief Computes one SYM_TILE x SYM_TILE tile of A and writes it with its mirror image.
+ * Distances come from a GEMM of the two point blocks and the squared norms,
+ * and the exponentials from the vectorized vexp.
+ * @param points The n x d matrix of data points (centred by the caller).
+ * @param norms The n squared norms of the points.
+ * @param A The n x n similarity matrix being built, or NULL to leave the result in tile.
+ * @param i0 First row of the tile.
+ * @param j0 First column of the tile (j0 >= i0).
+ * @param tile SYM_TILE x SYM_TILE output block, zero past row or column n.
+ * @param scratch Scratch buffer of sym_tile_workspace(d) - SYM_TILE * SYM_TILE elements.
+ * @param partial Per-row, per-tile-column sums (n x nblocks), or NULL.
+ * @param nblocks Number of tile columns.
+ */
+void R(sym_tile)(const R(matrix) *points, const REAL *norms, R(matrix) *A, int i0, int j0, REAL *tile, REAL *scratch,
+                 REAL *partial, int nblocks);
+
+/**
+ * @brief Writes the multiplication of two matrixes into result using the blocked GEMM kernel.
+ * @param matrix1 The first matrix.
+ * @param matrix2 The second matrix (matrix1->cols rows).
+ * @param result The matrix1->rows x matrix2->cols output.
+ * @param work GEMM scratch of threads * gemm_workspace_size(matrix2->cols) elements, or NULL.
+ * @param threads Number of worker threads, each taking PAR_ROWS rows at a time.
+ * @return 0 on success, 1 if work was NULL and a block could not allocate its own scratch.
+ */
+int R(matrix_multiply)(const R(matrix) *matrix1, const R(matrix) *matrix2, R(matrix) *result, REAL *work,
+                       int threads);
+
+/**
+ * @brief Writes W * H into result, dispatching on the storage format of W.
+ * @param W The n x n affinity matrix.
+ * @param H The n x k matrix.
+ * @param result The n x k output.
+ * @param work Scratch of affinity_workspace_size elements.
+ * @param threads Number of worker threads.
+ * @return 0 on success, 1 on allocation failure or a format this precision cannot multiply.
+ */
+int R(affinity_multiply)(const R(affinity) *W, const R(matrix) *H, R(matrix) *result, REAL *work, int threads);
+
+/**
+ * @brief Calculates ||W||_F^2, one row at a time.
+ * @param W The n x n affinity matrix.
+ * @param n Number of points.
+ * @return The squared Frobenius norm.
+ */
+double R(affinity_norm2)(const R(affinity) *W, int n);
+
+/**
+ * @brief Number of bytes the blocks of W take, padding included.
+ * @param W The n x n affinity matrix.
+ * @param n Number of points.
+ * @return The size, in bytes.
+ */
+size_t R(affinity_bytes)(const R(affinity) *W, int n);
+
+/**
+ * @brief Number of elements of scratch affinity_multiply needs for an n x k H.
+ * @param W The n x n affinity matrix.
+ * @param n Rows of H.
+ * @param k Columns of H.
+ * @param threads Number of worker threads.
+ * @return The workspace size, in elements: per thread for most formats, but fixed by n for a
+ *         packed W, whose symm_workspace_size takes up to SYMM_SLICES n x k accumulators.
+ */
+size_t R(affinity_workspace_size)(const R(affinity) *W, int n, int k, int threads);
+
+/**
+ * @brief Calculates the k x k Gram matrix H^T * H of the current H into ctx->HtH.
+ * Partial sums per PAR_ROWS block are added in block order, independent of the thread count.
+ * @param ctx The SymNMF workspace.
+ */
+void R(gram_matrix)(R(symnmf_ctx) *ctx);
+
+/**
+ * @brief Calculates ||W - H H^T||_F^2 as ||W||^2 - 2 tr(H^T W H) + ||H^T H||^2, clamped at 0.
+ * @param ctx The SymNMF workspace, with ctx->WH = W * H and ctx->HtH = H^T * H.
+ * @param H The n x k H the two products were taken at.
+ * @param w_norm2 ||W||_F^2, from affinity_norm2.
+ * @return The objective.
+ */
+double R(objective_at)(const R(symnmf_ctx) *ctx, const R(matrix) *H, double w_norm2);
+
+/**
+ * @brief Allocates the SymNMF workspace for a given W and initial H.
+ * @param W The n x n normalized similarity matrix, in any storage format; borrowed for the solve.
+ * @param H The initial n x k H matrix. Owned by the workspace on success.
+ * @param threads Number of worker threads used by every iteration.
+ * @param method The solver engine H_update runs.
+ * @returns a pointer to the workspace, or NULL on allocation failure.
+ */
+R(symnmf_ctx) *R(symnmf_ctx_init)(const R(affinity) *W, R(matrix) *H, int threads, int method);
+
+/**
+ * @brief Frees the SymNMF workspace and the H buffers it still owns.
+ * @param ctx The workspace (may be NULL).
+ */
+void R(symnmf_ctx_free)(R(symnmf_ctx) *ctx);
+
+/**
+ * @brief Computes the next iteration of H into the spare buffer and makes it current.
+ * The denominator is evaluated as H * (H^T * H), so no n x n temporary is formed.
+ * The Nesterov engine then extrapolates H[cur] along the last step; the HALS and
+ * ANLS engines instead update H and G by coordinate descent, two products by W each.
+ * @param ctx The SymNMF workspace.
+ * @returns the squared Frobenius norm of the change in H, or -1 if a product fails.
+ */
+double R(H_update)(R(symnmf_ctx) *ctx);
+
+/**
+ * @brief H_update with W * H already in ctx->WH, as a batch of solves sharing W provides it.
+ * @param ctx The SymNMF workspace.
+ * @returns the squared Frobenius norm of the change in H, or -1 if a product fails.
+ */
+double R(H_step)(R(symnmf_ctx) *ctx);
+
+/**
+ * @brief initilize a matrix full of 0.0 in a single aligned block.
+ * @param rows The number of rows in the matrix.
+ * @param cols The number of columns in the matrix.
+ * @returns a pointer to the matrix, or NULL on allocation failure.
+ */
+R(matrix) *R(matrix_init)(int rows, int cols);
+
+/**
+ * @brief changes the degree vector D into D^(-0.5).
+ * @param degrees The diagonal of D.
+ * @param n the size of the vector.
+ */
+void R(inv_root)(REAL *degrees, int n);
@@ -1,7 +1,52 @@
 #define PY_SSIZE_T_CLEAN
 #include "symnmfmodule.h"
+#include "batch.h"
+#include "gemm.h"
+#include "incremental.h"
+#include "half.h"
+#include "packed.h"
+#include "parallel.h"
+#include "reader.h"
+#include "sparse.h"
+#include "stats.h"
 #include "symnmf.h"
+#include "vmath.h"
+#include "writer.h"
 #include <Python.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+/* A C result exported through the buffer protocol; it owns its block and releases it when collected */
+typedef struct {
+    PyObject_HEAD
+    void *owner;
+    void (*release)(void *owner);
+    char *data;
+    const char *format;
+    int ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+    int writable;
+} c_array;
+
+static int c_array_getbuffer(PyObject *obj, Py_buffer *view, int flags);
+static void c_array_dealloc(PyObject *obj);
+
+static PyType_Slot c_array_slots[] = {
+    {Py_tp_dealloc, (void *)c_array_dealloc},
+    {Py_bf_getbuffer, (void *)c_array_getbuffer},
+    {Py_tp_doc, (void *)"A SymNMF result block owned by C, shared with numpy through the buffer protocol."},
+    {0, NULL},
+};
+
+static PyType_Spec c_array_spec = {"mysymnmf.CArray", sizeof(c_array), 0, Py_TPFLAGS_DEFAULT, c_array_slots};
+
+/* The result array type, created at module initialization */
+static PyTypeObject *c_array_type;
+
+/* numpy.asarray, looked up on first use; Py_None when numpy is missing */
+static PyObject *numpy_asarray;
 
 /*
  * ============================================================================
@@ -11,29 +56,108 @@
 
 /* Method definition object for this extension, mapping python method names to C functions */
 static PyMethodDef symnmf_methods[] = {
+    {
+        "read",
+        (PyCFunction)read_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("read(file_name) -> points; the points of a text, .npy or raw file as the CLI reads them, as a "
+                  "numpy array (a read-only view of the mapping for .npy and raw files)."),
+    },
     {
         "sym",
         (PyCFunction)sym_wrapper,
-        METH_VARARGS,
-        PyDoc_STR("Calculate the similarity matrix."),
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("sym(points, n, d, *, threads, knn, threshold, float32, output) -> similarity matrix; "
+                  "points may be a float64 buffer or a file name, with n and d then optional, and the result is "
+                  "then a numpy array; output names a .npy file to write the result to instead, returning its shape."),
     },
     {
         "ddg",
         (PyCFunction)ddg_wrapper,
-        METH_VARARGS,
-        PyDoc_STR("Calculate the diagonal degree matrix."),
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("ddg(points, n, d, *, threads, knn, threshold, float32, output) -> diagonal degree matrix; "
+                  "points may be a float64 buffer or a file name, with n and d then optional, and the result is "
+                  "then a numpy array; output names a .npy file to write the result to instead, returning its shape."),
     },
     {
         "norm",
         (PyCFunction)norm_wrapper,
-        METH_VARARGS,
-        PyDoc_STR("Calculate the normalized similarity matrix."),
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("norm(points, n, d, *, threads, knn, threshold, float32, output) -> normalized similarity matrix; "
+                  "points may be a float64 buffer or a file name, with n and d then optional, and the result is "
+                  "then a numpy array; output names a .npy file to write the result to instead, returning its shape."),
     },
     {
         "symnmf",
         (PyCFunction)symnmf_wrapper,
-        METH_VARARGS,
-        PyDoc_STR("Perform the symNMF optimization."),
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("symnmf(W, H_init, n, k, *, threads, packed=False, float32=False, half=None, output=None, "
+                  "method='mu', stats=False) -> optimized H; W and H_init may be float64 buffers (H then comes back "
+                  "as a numpy array), W a CSR triple, half='fp16' or 'bf16' stores a dense W in 16 bits, method "
+                  "picks the solver ('mu', 'nesterov', 'hals' or 'anls'), output names a .npy file to write H to "
+                  "instead, returning its shape, and stats=True returns (H, stats) with the timings, bytes and "
+                  "per-iteration residual and objective."),
+    },
+    {
+        "fit",
+        (PyCFunction)fit_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("fit(points, k, n, d, *, seed=1234, threads, knn, threshold, packed=False, float32=False, "
+                  "output=None, method='mu', stats=False, scratch=None, half=None) -> optimized H, or (H, stats) as "
+                  "for symnmf; builds W from the points, draws H as symnmf.py's init_H does and solves without "
+                  "returning W to Python. points may be a float64 buffer or a file name, with n and d then optional, "
+                  "and H is then a numpy array; output names a .npy file to write H to. scratch names a directory to "
+                  "keep the packed tiles of W in a file under, for a W larger than memory (OSError when the file "
+                  "cannot be created or reserved there); half='fp16' or 'bf16' stores a dense W in 16 bits, as for "
+                  "symnmf."),
+    },
+    {
+        "fit_batch",
+        (PyCFunction)fit_batch_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("fit_batch(points, runs, n, d, *, threads, knn, threshold, packed=False, scratch=None, half=None) "
+                  "-> [(H, objective), ...]; builds W once and solves every (k, seed) pair of runs against it, "
+                  "reading W once per iteration for all of them; objective is ||W - H H^T||_F^2. points, scratch and "
+                  "half are taken as for fit."),
+    },
+    {
+        "fit_incremental",
+        (PyCFunction)fit_incremental_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("fit_incremental(points, k, n, d, *, seed=1234, threads) -> (state, H); fits the points as fit "
+                  "does and keeps A and its degrees in state for append_points. points is taken as for fit."),
+    },
+    {
+        "append_points",
+        (PyCFunction)append_points_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("append_points(state, points, m, d, *, threads) -> H; adds m points to a fit_incremental state, "
+                  "computing only their rows of A, and refits from the previous H. A state is used by one call "
+                  "at a time."),
+    },
+    {
+        "state_affinity",
+        (PyCFunction)state_affinity_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("state_affinity(state) -> (W, D); the normalized similarity and diagonal degree matrices of the "
+                  "points of a fit_incremental state, as norm and ddg give them, built from the A and degrees it "
+                  "keeps."),
+    },
+    {
+        "to_half",
+        (PyCFunction)to_half_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("to_half(values, *, half='fp16') -> bits; the 16-bit encodings a dense W is stored in for "
+                  "half='fp16' or 'bf16', of a float64 buffer with one or two dimensions, as an n x d uint16 "
+                  "numpy array."),
+    },
+    {
+        "write",
+        (PyCFunction)write_wrapper,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("write(values, *, output=None); writes a float64 buffer with one or two dimensions through the "
+                  "writer the goals use: as the CLI prints a result to standard output, or to the .npy file "
+                  "output names, returning its (rows, cols) shape."),
     },
     {NULL, NULL, 0, NULL},
 };
@@ -56,21 +180,242 @@ static struct PyModuleDef symnmf_module = {
  * ============================================================================
  */
 PyMODINIT_FUNC PyInit_mysymnmf(void) {
+    c_array_type = (PyTypeObject *)PyType_FromSpec(&c_array_spec);
+    if (!c_array_type)
+        return NULL;
+    /* Pick the SIMD kernels once, before any call can release the GIL and race to */
+    gemm_kernel_init();
+    vexp_kernel_name();
+    half_kernel_name();
     return PyModule_Create(&symnmf_module);
 }
 
+/*
+ * ============================================================================
+ * Result Arrays
+ * ============================================================================
+ */
+
+static int c_array_getbuffer(PyObject *obj, Py_buffer *view, int flags) {
+    c_array *self;
+    Py_ssize_t itemsize;
+    int contiguous, wants_contiguous, wants_fortran;
+
+    self = (c_array *)obj;
+    itemsize = self->strides[self->ndim - 1];
+    contiguous = self->ndim == 1 || self->shape[0] <= 1 || self->strides[0] == self->shape[1] * itemsize;
+    wants_contiguous = (flags & PyBUF_STRIDES) != PyBUF_STRIDES || (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS ||
+                       (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS;
+    wants_fortran = (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS;
+
+    /* A block viewing a read-only mapping cannot be handed out for writing */
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE && !self->writable) {
+        PyErr_SetString(PyExc_BufferError, "the result views a read-only mapping");
+        return -1;
+    }
+
+    /* Padded rows can only be described with strides, and the block is never column-major */
+    if ((!contiguous && wants_contiguous) ||
+        (wants_fortran && self->ndim == 2 && self->shape[0] > 1 && self->shape[1] > 1)) {
+        PyErr_SetString(PyExc_BufferError, "the result has padded row-major rows");
+        return -1;
+    }
+
+    view->obj = obj;
+    Py_INCREF(obj);
+    view->buf = self->data;
+    view->len = self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1) * itemsize;
+    view->readonly = !self->writable;
+    view->itemsize = itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+    view->ndim = (flags & PyBUF_ND) == PyBUF_ND ? self->ndim : 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    return 0;
+}
+
+static void c_array_dealloc(PyObject *obj) {
+    PyTypeObject *type;
+    c_array *self;
+
+    self = (c_array *)obj;
+    type = Py_TYPE(obj);
+    self->release(self->owner);
+    type->tp_free(obj);
+    Py_DECREF(type);
+}
+
+static void release_matrix(void *owner) {
+    free_matrix(owner);
+}
+
+static void release_matrix_f(void *owner) {
+    free_matrix_f(owner);
+}
+
+/* Wraps a C array in a numpy.ndarray sharing its block; the C array itself is handed back when numpy is missing */
+static PyObject *array_wrap(PyObject *carray) {
+    PyObject *numpy, *array;
+
+    if (!numpy_asarray) {
+        /* Looked up on first use, so the module does not need numpy */
+        numpy = PyImport_ImportModule("numpy");
+        if (numpy) {
+            numpy_asarray = PyObject_GetAttrString(numpy, "asarray");
+            Py_DECREF(numpy);
+        }
+        if (!numpy_asarray) {
+            PyErr_Clear();
+            Py_INCREF(Py_None);
+            numpy_asarray = Py_None;
+        }
+    }
+    if (numpy_asarray == Py_None)
+        return carray;
+
+    array = PyObject_CallOneArg(numpy_asarray, carray);
+    Py_DECREF(carray);
+    return array;
+}
+
+PyObject *array_from_c(void *owner, void (*release)(void *), void *data, const char *format, Py_ssize_t itemsize,
+                       int ndim, Py_ssize_t rows, Py_ssize_t cols, Py_ssize_t stride, int writable) {
+    c_array *self;
+
+    self = PyObject_New(c_array, c_array_type);
+    if (!self) {
+        release(owner);
+        return NULL;
+    }
+
+    self->owner = owner;
+    self->release = release;
+    self->data = data;
+    self->format = format;
+    self->ndim = ndim;
+    self->shape[0] = rows;
+    self->shape[1] = ndim == 2 ? cols : 1;
+    self->strides[0] = ndim == 2 ? stride * itemsize : itemsize;
+    self->strides[1] = itemsize;
+    self->writable = writable;
+
+    return array_wrap((PyObject *)self);
+}
+
+PyObject *matrix_c_to_array(matrix *c_matrix) {
+    return array_from_c(c_matrix, release_matrix, c_matrix->data, "d", sizeof(double), 2, c_matrix->rows,
+                        c_matrix->cols, c_matrix->stride, c_matrix->map == NULL);
+}
+
+PyObject *matrix_c_to_array_f(matrix_f *c_matrix) {
+    return array_from_c(c_matrix, release_matrix_f, c_matrix->data, "f", sizeof(float), 2, c_matrix->rows,
+                        c_matrix->cols, c_matrix->stride, c_matrix->map == NULL);
+}
+
+PyObject *diag_c_to_array(const double *diag, int n) {
+    matrix *c_matrix;
+    int i;
+
+    c_matrix = matrix_init(n, n);
+    if (!c_matrix)
+        return PyErr_NoMemory();
+    for (i = 0; i < n; i++) {
+        MAT_AT(c_matrix, i, i) = diag[i];
+    }
+
+    return matrix_c_to_array(c_matrix);
+}
+
+PyObject *csr_c_to_array(csr_matrix *c_csr) {
+    PyObject *values, *col_idx, *row_ptr;
+
+    /* Each array takes over one block of the CSR matrix */
+    values = array_from_c(c_csr->values, free, c_csr->values, "d", sizeof(double), 1, (Py_ssize_t)c_csr->nnz, 1, 1, 1);
+    col_idx = array_from_c(c_csr->col_idx, free, c_csr->col_idx, "i", sizeof(int), 1, (Py_ssize_t)c_csr->nnz, 1, 1, 1);
+    row_ptr = array_from_c(c_csr->row_ptr, free, c_csr->row_ptr, sizeof(size_t) == sizeof(unsigned long) ? "L" : "Q",
+                           sizeof(size_t), 1, (Py_ssize_t)c_csr->rows + 1, 1, 1, 1);
+    free(c_csr);
+    if (!values || !col_idx || !row_ptr) {
+        Py_XDECREF(values);
+        Py_XDECREF(col_idx);
+        Py_XDECREF(row_ptr);
+        return NULL;
+    }
+
+    /* Steals the three references */
+    return Py_BuildValue("(NNN)", values, col_idx, row_ptr);
+}
+
+int matrix_py_view(PyObject *py_matrix, int *n, int *m, Py_buffer *buf, matrix *view) {
+    Py_ssize_t rows, cols, row_bytes;
+    const char *format;
+    int is_double, is_rows, in_shape;
+
+    if (PyObject_GetBuffer(py_matrix, buf, PyBUF_RECORDS_RO) != 0)
+        return 1;
+
+    /* Native float64, one or two dimensions, unit stride along a row */
+    format = buf->format ? buf->format : "B";
+    rows = buf->ndim >= 1 ? buf->shape[0] : 0;
+    cols = buf->ndim == 2 ? buf->shape[1] : 1;
+    row_bytes = buf->ndim == 2 && rows > 1 ? buf->strides[0] : cols * (Py_ssize_t)sizeof(double);
+    is_double = buf->itemsize == sizeof(double) && (size_t)buf->buf % sizeof(double) == 0 &&
+                (strcmp(format, "d") == 0 || strcmp(format, "@d") == 0 || strcmp(format, "=d") == 0 ||
+                 strcmp(format, PY_LITTLE_ENDIAN ? "<d" : ">d") == 0);
+    is_rows = (buf->ndim == 1 && buf->strides[0] == sizeof(double)) ||
+              (buf->ndim == 2 && (cols <= 1 || buf->strides[1] == sizeof(double)) &&
+               row_bytes >= cols * (Py_ssize_t)sizeof(double) && row_bytes % sizeof(double) == 0);
+    in_shape = rows <= INT_MAX && cols <= INT_MAX && (*n < 0 || *n == rows) && (*m < 0 || *m == cols);
+    if (!is_double || !is_rows || !in_shape) {
+        PyBuffer_Release(buf);
+        PyErr_Format(PyExc_ValueError, "expected a %d x %d float64 array with unit stride along rows", *n, *m);
+        return 1;
+    }
+
+    *n = (int)rows;
+    *m = (int)cols;
+    view->data = buf->buf;
+    view->rows = (int)rows;
+    view->cols = (int)cols;
+    view->stride = (int)(row_bytes / sizeof(double));
+    view->map = NULL;
+    view->map_size = 0;
+
+    return 0;
+}
+
 /*
  * ============================================================================
  * Matrix c/py Convertion Functions
  * ============================================================================
  */
 
-double **matrix_py_to_c(PyObject *py_matrix, int n, int m) {
+matrix *matrix_py_to_c(PyObject *py_matrix, int n, int m) {
     Py_ssize_t i, j;
     PyObject *row, *item;
-    double **c_matrix;
+    matrix *c_matrix, view;
+    Py_buffer buf;
+    double *c_row;
+
+    if (!PyList_Check(py_matrix) && PyObject_CheckBuffer(py_matrix)) {
+        /* Copy the rows of the buffer */
+        if (matrix_py_view(py_matrix, &n, &m, &buf, &view) != 0)
+            return NULL;
+        c_matrix = matrix_init(n, m);
+        for (i = 0; c_matrix && i < n; i++) {
+            memcpy(MAT_ROW(c_matrix, i), MAT_ROW(&view, i), (size_t)m * sizeof(double));
+        }
+        PyBuffer_Release(&buf);
+        return c_matrix ? c_matrix : (matrix *)PyErr_NoMemory();
+    }
+
+    if (!PyList_Check(py_matrix) || PyList_Size(py_matrix) != n)
+        return NULL;
 
-    c_matrix = (double **)malloc((n) * sizeof(double *));
+    c_matrix = matrix_init(n, m);
     if (!c_matrix)
         return NULL;
 
@@ -78,22 +423,17 @@ double **matrix_py_to_c(PyObject *py_matrix, int n, int m) {
         /* Read rows */
         row = PyList_GetItem(py_matrix, i);
         if (!PyList_Check(row) || PyList_Size(row) != m) {
-            free_matrix(c_matrix, i);
-            return NULL;
-        }
-
-        c_matrix[i] = (double *)malloc((m) * sizeof(double));
-        if (!c_matrix[i]) {
-            free_matrix(c_matrix, i);
+            free_matrix(c_matrix);
             return NULL;
         }
 
+        c_row = MAT_ROW(c_matrix, i);
         for (j = 0; j < m; j++) {
             /* Read columns */
             item = PyList_GetItem(row, j);
-            c_matrix[i][j] = PyFloat_AsDouble(item);
+            c_row[j] = PyFloat_AsDouble(item);
             if (PyErr_Occurred()) {
-                free_matrix(c_matrix, i);
+                free_matrix(c_matrix);
                 return NULL;
             }
         }
@@ -102,33 +442,57 @@ double **matrix_py_to_c(PyObject *py_matrix, int n, int m) {
     return c_matrix;
 }
 
-PyObject *matrix_c_to_py(double **c_matrix, int n, int m) {
+matrix_f *matrix_py_to_c_f(PyObject *py_matrix, int n, int m) {
+    matrix *c_matrix, view;
+    matrix_f *c_single;
+    Py_buffer buf;
+
+    if (!PyList_Check(py_matrix) && PyObject_CheckBuffer(py_matrix)) {
+        /* Round the buffer in place, without a double copy */
+        if (matrix_py_view(py_matrix, &n, &m, &buf, &view) != 0)
+            return NULL;
+        c_single = matrix_to_f(&view);
+        PyBuffer_Release(&buf);
+        return c_single;
+    }
+
+    c_matrix = matrix_py_to_c(py_matrix, n, m);
+    if (!c_matrix)
+        return NULL;
+
+    c_single = matrix_to_f(c_matrix);
+    free_matrix(c_matrix);
+
+    return c_single;
+}
+
+PyObject *matrix_c_to_py(const matrix *c_matrix) {
     PyObject *py_matrix, *row_list, *num;
+    const double *c_row;
     int i, j;
 
     if (!c_matrix)
         return NULL;
 
-    py_matrix = PyList_New(n);
+    py_matrix = PyList_New(c_matrix->rows);
     if (!py_matrix)
         return NULL;
 
-    for (i = 0; i < n; i++) {
+    for (i = 0; i < c_matrix->rows; i++) {
         /* Read rows */
-        row_list = PyList_New(m);
+        row_list = PyList_New(c_matrix->cols);
         if (!row_list) {
             Py_DECREF(py_matrix);
-            free_matrix(c_matrix, n);
             return NULL;
         }
 
-        for (j = 0; j < m; j++) {
+        c_row = MAT_ROW(c_matrix, i);
+        for (j = 0; j < c_matrix->cols; j++) {
             /* Read columns */
-            num = PyFloat_FromDouble(c_matrix[i][j]);
+            num = PyFloat_FromDouble(c_row[j]);
             if (!num) {
                 Py_DECREF(row_list);
                 Py_DECREF(py_matrix);
-                free_matrix(c_matrix, n);
                 return NULL;
             }
 
@@ -141,152 +505,1485 @@ PyObject *matrix_c_to_py(double **c_matrix, int n, int m) {
     return py_matrix;
 }
 
-/*
- * ============================================================================
- * Wrapper Function Implementations
- * ============================================================================
- */
+PyObject *matrix_c_to_py_f(const matrix_f *c_matrix) {
+    matrix *c_double;
+    PyObject *py_matrix;
+
+    if (!c_matrix)
+        return NULL;
 
-double **_sym_wrapper(PyObject *points_py, int n, int d) {
-    double **points_c, **sym_c;
+    c_double = matrix_from_f(c_matrix);
+    py_matrix = matrix_c_to_py(c_double);
+    free_matrix(c_double);
 
-    /* Translate point matrix to C */
-    points_c = matrix_py_to_c(points_py, n, d);
-    if (!points_c)
+    return py_matrix;
+}
+
+PyObject *diag_c_to_py(const double *diag, int n) {
+    PyObject *py_matrix, *row_list, *num;
+    int i, j;
+
+    if (!diag)
         return NULL;
 
-    /* Calculate sym matrix */
-    sym_c = calc_sym(points_c, n, d);
-    free_matrix(points_c, n);
+    py_matrix = PyList_New(n);
+    if (!py_matrix)
+        return NULL;
 
-    return sym_c;
+    for (i = 0; i < n; i++) {
+        row_list = PyList_New(n);
+        if (!row_list) {
+            Py_DECREF(py_matrix);
+            return NULL;
+        }
+
+        for (j = 0; j < n; j++) {
+            num = PyFloat_FromDouble(i == j ? diag[i] : 0.0);
+            if (!num) {
+                Py_DECREF(row_list);
+                Py_DECREF(py_matrix);
+                return NULL;
+            }
+
+            PyList_SET_ITEM(row_list, j, num);
+        }
+
+        PyList_SET_ITEM(py_matrix, i, row_list);
+    }
+
+    return py_matrix;
 }
 
-static PyObject *sym_wrapper(PyObject *self, PyObject *args) {
-    PyObject *points_py, *sym_py;
-    int n, d;
-    double **sym_c;
+static PyObject *list_from_doubles(const double *values, size_t len) {
+    PyObject *list, *num;
+    size_t i;
 
-    if (!PyArg_ParseTuple(args, "Oii", &points_py, &n, &d))
+    list = PyList_New((Py_ssize_t)len);
+    if (!list)
         return NULL;
 
-    /* Calculate sym matrix*/
-    sym_c = _sym_wrapper(points_py, n, d);
-    if (!sym_c)
+    for (i = 0; i < len; i++) {
+        num = PyFloat_FromDouble(values[i]);
+        if (!num) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, num);
+    }
+
+    return list;
+}
+
+static PyObject *list_from_indices(const int *col_idx, const size_t *row_ptr, size_t len) {
+    PyObject *list, *num;
+    size_t i;
+
+    list = PyList_New((Py_ssize_t)len);
+    if (!list)
         return NULL;
 
-    /* Translate matrix to Python*/
-    sym_py = matrix_c_to_py(sym_c, n, n);
-    free_matrix(sym_c, n);
+    for (i = 0; i < len; i++) {
+        num = col_idx ? PyLong_FromLong(col_idx[i]) : PyLong_FromSize_t(row_ptr[i]);
+        if (!num) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, num);
+    }
 
-    return sym_py;
+    return list;
 }
 
-double **_dgg_wrapper(PyObject *points_py, int n, int d) {
-    double **sym_c, **dgg_c;
+PyObject *csr_c_to_py(const csr_matrix *c_csr) {
+    PyObject *values, *col_idx, *row_ptr;
 
-    /* Calculate sym matrix */
-    sym_c = _sym_wrapper(points_py, n, d);
-    if (!sym_c)
+    if (!c_csr)
+        return NULL;
+
+    values = list_from_doubles(c_csr->values, c_csr->nnz);
+    col_idx = list_from_indices(c_csr->col_idx, NULL, c_csr->nnz);
+    row_ptr = list_from_indices(NULL, c_csr->row_ptr, (size_t)c_csr->rows + 1);
+    if (!values || !col_idx || !row_ptr) {
+        Py_XDECREF(values);
+        Py_XDECREF(col_idx);
+        Py_XDECREF(row_ptr);
         return NULL;
+    }
+
+    /* Steals the three references */
+    return Py_BuildValue("(NNN)", values, col_idx, row_ptr);
+}
 
-    /* Calculate ddg matrix */
-    dgg_c = calc_ddg(sym_c, n);
-    free_matrix(sym_c, n);
+/* Opens a .npy writer for a rows x cols result, or sets OSError */
+static out_writer *npy_open(const char *path, int rows, int cols) {
+    out_writer *out;
 
-    return dgg_c;
+    out = writer_open(path, rows, cols);
+    if (!out)
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    return out;
 }
 
-static PyObject *ddg_wrapper(PyObject *self, PyObject *args) {
-    PyObject *points_py, *dgg_py;
-    int n, d;
-    double **dgg_c;
+/* Closes a .npy writer and gives the shape written, or sets OSError */
+static PyObject *npy_close(out_writer *out, const char *path, int rows, int cols) {
+    int failed;
+
+    Py_BEGIN_ALLOW_THREADS
+    failed = writer_close(out);
+    Py_END_ALLOW_THREADS
+    if (failed)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    return Py_BuildValue("(ii)", rows, cols);
+}
+
+PyObject *matrix_c_to_npy(const matrix *c_matrix, const char *path) {
+    out_writer *out;
 
-    if (!PyArg_ParseTuple(args, "Oii", &points_py, &n, &d))
+    if (!c_matrix || !(out = npy_open(path, c_matrix->rows, c_matrix->cols)))
         return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    print_matrix(c_matrix, out);
+    Py_END_ALLOW_THREADS
+    return npy_close(out, path, c_matrix->rows, c_matrix->cols);
+}
 
-    /* Calculate dgg matrix */
-    dgg_c = _dgg_wrapper(points_py, n, d);
-    if (!dgg_c)
+PyObject *matrix_c_to_npy_f(const matrix_f *c_matrix, const char *path) {
+    out_writer *out;
+
+    if (!c_matrix || !(out = npy_open(path, c_matrix->rows, c_matrix->cols)))
         return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    print_matrix_f(c_matrix, out);
+    Py_END_ALLOW_THREADS
+    return npy_close(out, path, c_matrix->rows, c_matrix->cols);
+}
 
-    /* Translate matrix to Python */
-    dgg_py = matrix_c_to_py(dgg_c, n, n);
-    free_matrix(dgg_c, n);
+PyObject *diag_c_to_npy(const double *diag, int n, const char *path) {
+    out_writer *out;
 
-    return dgg_py;
+    if (!diag || !(out = npy_open(path, n, n)))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    print_diag(diag, n, out);
+    Py_END_ALLOW_THREADS
+    return npy_close(out, path, n, n);
 }
 
-double **_norm_wrapper(PyObject *points_py, int n, int d) {
-    double **sym_c, **dgg_c, **norm_c;
+PyObject *csr_c_to_npy(const csr_matrix *c_csr, const char *path) {
+    out_writer *out;
 
-    /* Calculate sym matrix */
-    sym_c = _sym_wrapper(points_py, n, d);
-    if (!sym_c)
+    if (!c_csr || !(out = npy_open(path, c_csr->rows, c_csr->cols)))
         return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    print_csr(c_csr, out);
+    Py_END_ALLOW_THREADS
+    return npy_close(out, path, c_csr->rows, c_csr->cols);
+}
 
-    /* Calculate ddg matrix */
-    dgg_c = calc_ddg(sym_c, n);
-    if (!dgg_c) {
-        free_matrix(sym_c, n);
+/* Builds the n x n CSR matrix of three fast sequences, checking every index */
+static csr_matrix *csr_from_sequences(PyObject *values, PyObject *col_idx, PyObject *row_ptr, int n) {
+    csr_matrix *c_csr;
+    Py_ssize_t i, nnz, entry;
+    size_t ptr;
+    long col;
+
+    if (PySequence_Fast_GET_SIZE(row_ptr) != (Py_ssize_t)n + 1 ||
+        PySequence_Fast_GET_SIZE(col_idx) != PySequence_Fast_GET_SIZE(values)) {
+        PyErr_SetString(PyExc_ValueError, "W must be a (values, col_idx, row_ptr) CSR triple of n x n");
         return NULL;
     }
 
-    /* Calculate norm matrix */
-    norm_c = calc_norm(sym_c, dgg_c, n);
-    free_matrix(sym_c, n);
-    free_matrix(dgg_c, n);
+    nnz = PySequence_Fast_GET_SIZE(values);
+    c_csr = csr_init(n, n, (size_t)nnz);
+    if (!c_csr)
+        return (csr_matrix *)PyErr_NoMemory();
 
-    return norm_c;
+    for (i = 0; i < nnz; i++) {
+        c_csr->values[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(values, i));
+        col = PyLong_AsLong(PySequence_Fast_GET_ITEM(col_idx, i));
+        if (PyErr_Occurred() || col < 0 || col >= n)
+            break;
+        c_csr->col_idx[i] = (int)col;
+    }
+    for (ptr = 0; i == nnz && ptr <= (size_t)n; ptr++) {
+        entry = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(row_ptr, (Py_ssize_t)ptr), NULL);
+        if (PyErr_Occurred() || entry < 0 || entry > nnz)
+            break;
+        c_csr->row_ptr[ptr] = (size_t)entry;
+        if (ptr > 0 && c_csr->row_ptr[ptr] < c_csr->row_ptr[ptr - 1])
+            break;
+    }
+    if (i != nnz || ptr != (size_t)n + 1 || c_csr->row_ptr[n] != (size_t)nnz) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "malformed CSR triple");
+        free_csr(c_csr);
+        return NULL;
+    }
+
+    return c_csr;
 }
 
-static PyObject *norm_wrapper(PyObject *self, PyObject *args) {
-    PyObject *points_py, *norm_py;
-    int n, d;
-    double **norm_c;
+csr_matrix *csr_py_to_c(PyObject *py_csr, int n) {
+    PyObject *parts[3], *view;
+    csr_matrix *c_csr;
+    int p;
 
-    if (!PyArg_ParseTuple(args, "Oii", &points_py, &n, &d))
+    if (!PyArg_ParseTuple(py_csr, "OOO", &parts[0], &parts[1], &parts[2]))
         return NULL;
 
-    /* Calculate norm matrix */
-    norm_c = _norm_wrapper(points_py, n, d);
-    if (!norm_c)
-        return NULL;
+    /* Lists, or the arrays sym and norm return in array mode, read through a memoryview */
+    for (p = 0; p < 3; p++) {
+        view = NULL;
+        if (PyObject_CheckBuffer(parts[p]) && !(view = PyMemoryView_FromObject(parts[p])))
+            PyErr_Clear();
+        parts[p] = PySequence_Fast(view ? view : parts[p], "W must be a (values, col_idx, row_ptr) CSR triple");
+        Py_XDECREF(view);
+        if (!parts[p]) {
+            while (p > 0) {
+                Py_DECREF(parts[--p]);
+            }
+            return NULL;
+        }
+    }
 
-    /* Translate matrix to Python*/
-    norm_py = matrix_c_to_py(norm_c, n, n);
-    free_matrix(norm_c, n);
+    c_csr = csr_from_sequences(parts[0], parts[1], parts[2], n);
+    for (p = 0; p < 3; p++) {
+        Py_DECREF(parts[p]);
+    }
 
-    return norm_py;
+    return c_csr;
 }
 
-static PyObject *symnmf_wrapper(PyObject *self, PyObject *args) {
-    PyObject *W_py, *H_init_py, *H_py;
-    double **W_c, **H_init_c, **H_c;
-    int n, k;
+sym_packed *packed_py_to_c(PyObject *py_matrix, int n) {
+    PyObject *row;
+    sym_packed *c_packed;
+    matrix view;
+    Py_buffer buf;
+    double *tile;
+    int i, j, bi, bj;
+
+    if (!PyList_Check(py_matrix) && PyObject_CheckBuffer(py_matrix)) {
+        /* Read the upper triangle of tiles straight from the buffer */
+        if (matrix_py_view(py_matrix, &n, &n, &buf, &view) != 0)
+            return NULL;
+        c_packed = packed_init(n);
+        for (i = 0; c_packed && i < n; i++) {
+            bi = i / SYM_TILE;
+            for (j = bi * SYM_TILE; j < n; j++) {
+                bj = j / SYM_TILE;
+                tile = PACKED_TILE(c_packed, bi, bj);
+                tile[(i % SYM_TILE) * SYM_TILE + j % SYM_TILE] = MAT_AT(&view, i, j);
+            }
+        }
+        PyBuffer_Release(&buf);
+        return c_packed ? c_packed : (sym_packed *)PyErr_NoMemory();
+    }
 
-    if (!PyArg_ParseTuple(args, "OOii", &W_py, &H_init_py, &n, &k))
+    if (!PyList_Check(py_matrix) || PyList_Size(py_matrix) != n)
         return NULL;
 
-    /* Translate W matrix to C */
-    W_c = matrix_py_to_c(W_py, n, n);
-    if (!W_c)
+    c_packed = packed_init(n);
+    if (!c_packed)
         return NULL;
 
-    /* Translate initial H matrix to C */
-    H_init_c = matrix_py_to_c(H_init_py, n, k);
-    if (!H_init_c) {
-        free_matrix(W_c, n);
+    for (i = 0; i < n; i++) {
+        /* Read rows, keeping the upper triangle of tiles */
+        row = PyList_GetItem(py_matrix, i);
+        if (!PyList_Check(row) || PyList_Size(row) != n) {
+            free_packed(c_packed);
+            return NULL;
+        }
+
+        bi = i / SYM_TILE;
+        for (j = bi * SYM_TILE; j < n; j++) {
+            bj = j / SYM_TILE;
+            tile = PACKED_TILE(c_packed, bi, bj);
+            tile[(i % SYM_TILE) * SYM_TILE + j % SYM_TILE] = PyFloat_AsDouble(PyList_GetItem(row, j));
+            if (PyErr_Occurred()) {
+                free_packed(c_packed);
+                return NULL;
+            }
+        }
+    }
+
+    return c_packed;
+}
+
+half_matrix *half_py_to_c(PyObject *py_matrix, int n, int format, int threads) {
+    matrix *c_matrix, view;
+    half_matrix *c_half;
+    Py_buffer buf;
+
+    if (!PyList_Check(py_matrix) && PyObject_CheckBuffer(py_matrix)) {
+        /* Narrow the buffer in place */
+        if (matrix_py_view(py_matrix, &n, &n, &buf, &view) != 0)
+            return NULL;
+        Py_BEGIN_ALLOW_THREADS
+        c_half = half_from_matrix(&view, format, threads);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        return c_half;
+    }
+
+    c_matrix = matrix_py_to_c(py_matrix, n, n);
+    if (!c_matrix)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    c_half = half_from_matrix(c_matrix, format, threads);
+    free_matrix(c_matrix);
+    Py_END_ALLOW_THREADS
+
+    return c_half;
+}
+
+matrix *points_py_to_c(PyObject *points_py, int *n, int *d) {
+    PyObject *path;
+    matrix *c_matrix;
+
+    if (!PyUnicode_Check(points_py) && !PyBytes_Check(points_py)) {
+        if (!PyList_Check(points_py) && PyObject_CheckBuffer(points_py)) {
+            /* The shape comes with the buffer; the points are copied, as the kernels centre a copy anyway */
+            c_matrix = matrix_py_to_c(points_py, *n, *d);
+            if (c_matrix) {
+                *n = c_matrix->rows;
+                *d = c_matrix->cols;
+            }
+            return c_matrix;
+        }
+        if (*n < 0 || *d < 0) {
+            PyErr_SetString(PyExc_TypeError, "n and d are required when points is a list");
+            return NULL;
+        }
+        return matrix_py_to_c(points_py, *n, *d);
+    }
+
+    /* A file name: the CLI reader, so .npy and raw files are mapped rather than parsed */
+    if (!PyUnicode_FSConverter(points_py, &path))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    c_matrix = read_input(PyBytes_AS_STRING(path));
+    Py_END_ALLOW_THREADS
+    Py_DECREF(path);
+    if (!c_matrix) {
+        PyErr_SetString(PyExc_ValueError, "cannot read points from the file");
+        return NULL;
+    }
+    if ((*n >= 0 && *n != c_matrix->rows) || (*d >= 0 && *d != c_matrix->cols)) {
+        free_matrix(c_matrix);
+        PyErr_SetString(PyExc_ValueError, "n and d do not match the shape of the file");
         return NULL;
     }
 
-    /* Calculate H matrix */
-    H_c = calc_symnmf(W_c, H_init_c, n, k);
-    free_matrix(W_c, n);
+    *n = c_matrix->rows;
+    *d = c_matrix->cols;
+    return c_matrix;
+}
+
+/*
+ * ============================================================================
+ * Wrapper Function Implementations
+ * ============================================================================
+ */
+
+/* Rejects the thread counts parse_args rejects: the workspaces are sized per thread */
+static int check_threads(int threads) {
+    if (threads < 1 || threads > THREADS_MAX) {
+        PyErr_Format(PyExc_ValueError, "threads must be between 1 and %d", THREADS_MAX);
+        return 1;
+    }
+    return 0;
+}
+
+/* Rejects the graph options parse_args rejects: knn of at least 1 and a threshold in (0, 1], each 0 when unset */
+static int check_graph_opts(const symnmf_opts *opts) {
+    if (opts->knn < 0) {
+        PyErr_SetString(PyExc_ValueError, "knn must be positive");
+        return 1;
+    }
+    if (!(opts->threshold >= 0.0 && opts->threshold <= 1.0)) {
+        PyErr_SetString(PyExc_ValueError, "threshold must be in (0, 1]");
+        return 1;
+    }
+    return 0;
+}
+
+/* Sets opts->half from its name, or -1 for none; a 16-bit W is dense, as for symnmf(..., half=) */
+static int check_half_opts(const char *half_name, symnmf_opts *opts) {
+    opts->half = -1;
+    if (!half_name)
+        return 0;
+    opts->half = half_format_from_name(half_name);
+    if (opts->half < 0) {
+        PyErr_SetString(PyExc_ValueError, "half must be 'fp16' or 'bf16'");
+        return 1;
+    }
+    if (opts->knn > 0 || opts->threshold > 0.0 || opts->packed) {
+        PyErr_SetString(PyExc_ValueError, "half supports dense affinities only");
+        return 1;
+    }
+    return 0;
+}
 
-    /* Translate H matrix to Python*/
-    H_py = matrix_c_to_py(H_c, n, k);
-    free_matrix(H_c, n);
+/* Hands a dense result back: written to output, as an array that takes it over, or as lists; it is consumed */
+static PyObject *matrix_result(matrix *c_matrix, const char *output, int as_array) {
+    PyObject *result_py;
 
-    return H_py;
-}
\ No newline at end of file
+    if (!c_matrix)
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    if (as_array && !output)
+        return matrix_c_to_array(c_matrix);
+
+    result_py = output ? matrix_c_to_npy(c_matrix, output) : matrix_c_to_py(c_matrix);
+    free_matrix(c_matrix);
+    return result_py;
+}
+
+static PyObject *matrix_result_f(matrix_f *c_matrix, const char *output, int as_array) {
+    PyObject *result_py;
+
+    if (!c_matrix)
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    if (as_array && !output)
+        return matrix_c_to_array_f(c_matrix);
+
+    result_py = output ? matrix_c_to_npy_f(c_matrix, output) : matrix_c_to_py_f(c_matrix);
+    free_matrix_f(c_matrix);
+    return result_py;
+}
+
+static PyObject *diag_result(double *diag, int n, const char *output, int as_array) {
+    PyObject *result_py;
+
+    if (!diag)
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+
+    result_py = output ? diag_c_to_npy(diag, n, output) : as_array ? diag_c_to_array(diag, n) : diag_c_to_py(diag, n);
+    free(diag);
+    return result_py;
+}
+
+static PyObject *csr_result(csr_matrix *c_csr, const char *output, int as_array) {
+    PyObject *result_py;
+
+    if (!c_csr)
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    if (as_array && !output)
+        return csr_c_to_array(c_csr);
+
+    result_py = output ? csr_c_to_npy(c_csr, output) : csr_c_to_py(c_csr);
+    free_csr(c_csr);
+    return result_py;
+}
+
+/* A stats record as a dict, keyed as the CLI's JSON */
+static PyObject *stats_c_to_py(const symnmf_stats *stats) {
+    PyObject *dict, *seconds, *value;
+    int s, failed;
+
+    dict = PyDict_New();
+    seconds = PyDict_New();
+    failed = !dict || !seconds;
+    for (s = 0; !failed && s < STAGE_COUNT; s++) {
+        value = PyFloat_FromDouble(stats->seconds[s]);
+        failed = !value || PyDict_SetItemString(seconds, stage_name(s), value) != 0;
+        Py_XDECREF(value);
+    }
+    failed = failed || PyDict_SetItemString(dict, "seconds", seconds) != 0;
+    Py_XDECREF(seconds);
+    if (failed) {
+        Py_XDECREF(dict);
+        return NULL;
+    }
+
+    /* The remaining entries, in the order of the JSON object */
+    value = PyLong_FromSize_t(stats->affinity_bytes);
+    failed = !value || PyDict_SetItemString(dict, "affinity_bytes", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : PyLong_FromSize_t(stats->workspace_bytes);
+    failed = !value || PyDict_SetItemString(dict, "workspace_bytes", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : PyLong_FromSize_t(stats_peak_rss());
+    failed = !value || PyDict_SetItemString(dict, "peak_rss_bytes", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : PyLong_FromLong(stats->iterations);
+    failed = !value || PyDict_SetItemString(dict, "iterations", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : list_from_doubles(stats->update_seconds, stats->iterations);
+    failed = !value || PyDict_SetItemString(dict, "update_seconds", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : list_from_doubles(stats->residual, stats->iterations);
+    failed = !value || PyDict_SetItemString(dict, "residual", value) != 0;
+    Py_XDECREF(value);
+    value = failed ? NULL : list_from_doubles(stats->objective, stats->iterations);
+    failed = !value || PyDict_SetItemString(dict, "objective", value) != 0;
+    Py_XDECREF(value);
+    if (failed) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+
+    return dict;
+}
+
+/* Pairs a result with its stats as (result, stats) when stats were asked for; the result is consumed */
+static PyObject *stats_result(PyObject *result_py, const symnmf_stats *stats) {
+    PyObject *stats_py;
+
+    if (!result_py || !stats)
+        return result_py;
+
+    stats_py = stats_c_to_py(stats);
+    if (!stats_py) {
+        Py_DECREF(result_py);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", result_py, stats_py);
+}
+
+matrix *_sym_wrapper(matrix *points_c, int threads) {
+    matrix *sym_c;
+
+    /* Calculate sym matrix */
+    Py_BEGIN_ALLOW_THREADS
+    sym_c = calc_sym(points_c, threads);
+    free_matrix(points_c);
+    Py_END_ALLOW_THREADS
+
+    return sym_c;
+}
+
+csr_matrix *_sym_sparse_wrapper(matrix *points_c, const symnmf_opts *opts) {
+    csr_matrix *sym_c;
+
+    /* Calculate the sparse kNN / threshold graph */
+    Py_BEGIN_ALLOW_THREADS
+    sym_c = calc_sym_sparse(points_c, opts->knn, opts->threshold, opts->threads);
+    free_matrix(points_c);
+    Py_END_ALLOW_THREADS
+
+    return sym_c;
+}
+
+PyObject *_single_wrapper(const char *goal, matrix *points, int threads, const char *output, int as_array) {
+    matrix_f *points_c, *sym_c;
+    float *dgg_c;
+    double *diag;
+    int i, n;
+
+    n = points->rows;
+    Py_BEGIN_ALLOW_THREADS
+    /* Round the points to float */
+    points_c = matrix_to_f(points);
+    free_matrix(points);
+    dgg_c = malloc((n > 0 ? n : 1) * sizeof(float));
+
+    /* A and its degrees in one sweep, as for double */
+    sym_c = points_c && dgg_c ? calc_sym_ddg_f(points_c, dgg_c, threads) : NULL;
+    free_matrix_f(points_c);
+    if (sym_c && strcmp(goal, "norm") == 0)
+        calc_norm_f(sym_c, dgg_c, threads);
+    Py_END_ALLOW_THREADS
+
+    if (!sym_c) {
+        free(dgg_c);
+        return PyErr_NoMemory();
+    }
+    if (strcmp(goal, "ddg") == 0) {
+        free_matrix_f(sym_c);
+        diag = malloc((n > 0 ? n : 1) * sizeof(double));
+        for (i = 0; diag && i < n; i++) {
+            diag[i] = dgg_c[i];
+        }
+        free(dgg_c);
+        return diag_result(diag, n, output, as_array);
+    }
+
+    free(dgg_c);
+    return matrix_result_f(sym_c, output, as_array);
+}
+
+static PyObject *read_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"file_name", NULL};
+    PyObject *file_py;
+    matrix *points_c;
+    int n, d;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &file_py))
+        return NULL;
+    if (!PyUnicode_Check(file_py) && !PyBytes_Check(file_py)) {
+        PyErr_SetString(PyExc_TypeError, "file_name must be a str or bytes path");
+        return NULL;
+    }
+
+    /* The reader's matrix itself, mapped or parsed, handed over to the array; a mapping stays read-only */
+    n = -1;
+    d = -1;
+    points_c = points_py_to_c(file_py, &n, &d);
+    if (!points_c)
+        return NULL;
+    return matrix_result(points_c, NULL, 1);
+}
+
+static PyObject *sym_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "n", "d", "threads", "knn", "threshold", "float32", "output", NULL};
+    PyObject *points_py;
+    matrix *points_c;
+    symnmf_opts opts;
+    csr_matrix *csr_c;
+    int n, d, as_array;
+    matrix *sym_c;
+
+    n = -1;
+    d = -1;
+    opts.threads = default_threads();
+    opts.knn = 0;
+    opts.threshold = 0.0;
+    opts.float32 = 0;
+    opts.half = -1;
+    opts.output = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii$iidpz", kwlist, &points_py, &n, &d, &opts.threads, &opts.knn,
+                                     &opts.threshold, &opts.float32, &opts.output))
+        return NULL;
+    if (check_threads(opts.threads) || check_graph_opts(&opts))
+        return NULL;
+    if (opts.float32 && (opts.knn > 0 || opts.threshold > 0.0)) {
+        /* Single precision; the sparse graphs hold doubles */
+        PyErr_SetString(PyExc_ValueError, "float32 supports dense affinities only");
+        return NULL;
+    }
+
+    /* Translate point matrix to C, from a list, a buffer or a file; only lists get lists back */
+    as_array = !PyList_Check(points_py);
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c)
+        return NULL;
+
+    if (opts.float32) {
+        return _single_wrapper("sym", points_c, opts.threads, opts.output, as_array);
+    }
+
+    if (opts.knn > 0 || opts.threshold > 0.0) {
+        /* Sparse graph as a (values, col_idx, row_ptr) triple */
+        csr_c = _sym_sparse_wrapper(points_c, &opts);
+        return csr_result(csr_c, opts.output, as_array);
+    }
+
+    /* Calculate sym matrix*/
+    sym_c = _sym_wrapper(points_c, opts.threads);
+
+    /* Translate matrix to Python*/
+    return matrix_result(sym_c, opts.output, as_array);
+}
+
+double *_dgg_wrapper(matrix *points_c, int threads) {
+    matrix *sym_c;
+    double *dgg_c;
+    int n;
+
+    n = points_c->rows;
+    dgg_c = malloc((n > 0 ? n : 1) * sizeof(double));
+    if (!dgg_c) {
+        free_matrix(points_c);
+        return NULL;
+    }
+
+    /* Calculate ddg vector while building the sym matrix */
+    Py_BEGIN_ALLOW_THREADS
+    sym_c = calc_sym_ddg(points_c, dgg_c, threads);
+    free_matrix(points_c);
+    Py_END_ALLOW_THREADS
+    if (!sym_c) {
+        free(dgg_c);
+        return NULL;
+    }
+    free_matrix(sym_c);
+
+    return dgg_c;
+}
+
+static PyObject *ddg_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "n", "d", "threads", "knn", "threshold", "float32", "output", NULL};
+    PyObject *points_py;
+    matrix *points_c;
+    symnmf_opts opts;
+    csr_matrix *csr_c;
+    int n, d, as_array;
+    double *dgg_c;
+
+    n = -1;
+    d = -1;
+    opts.threads = default_threads();
+    opts.knn = 0;
+    opts.threshold = 0.0;
+    opts.float32 = 0;
+    opts.half = -1;
+    opts.output = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii$iidpz", kwlist, &points_py, &n, &d, &opts.threads, &opts.knn,
+                                     &opts.threshold, &opts.float32, &opts.output))
+        return NULL;
+    if (check_threads(opts.threads) || check_graph_opts(&opts))
+        return NULL;
+    if (opts.float32 && (opts.knn > 0 || opts.threshold > 0.0)) {
+        /* Single precision; the sparse graphs hold doubles */
+        PyErr_SetString(PyExc_ValueError, "float32 supports dense affinities only");
+        return NULL;
+    }
+
+    /* Translate point matrix to C, from a list, a buffer or a file; only lists get lists back */
+    as_array = !PyList_Check(points_py);
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c)
+        return NULL;
+
+    if (opts.float32) {
+        return _single_wrapper("ddg", points_c, opts.threads, opts.output, as_array);
+    }
+
+    if (opts.knn > 0 || opts.threshold > 0.0) {
+        /* Degrees of the sparse graph */
+        csr_c = _sym_sparse_wrapper(points_c, &opts);
+        if (!csr_c)
+            return NULL;
+        Py_BEGIN_ALLOW_THREADS
+        dgg_c = calc_ddg_sparse(csr_c, opts.threads);
+        free_csr(csr_c);
+        Py_END_ALLOW_THREADS
+        return diag_result(dgg_c, n, opts.output, as_array);
+    }
+
+    /* Calculate dgg matrix */
+    dgg_c = _dgg_wrapper(points_c, opts.threads);
+
+    /* Translate diagonal matrix to Python */
+    return diag_result(dgg_c, n, opts.output, as_array);
+}
+
+matrix *_norm_wrapper(matrix *points_c, int threads) {
+    matrix *norm_c;
+
+    /* Calculate norm matrix straight from the points */
+    Py_BEGIN_ALLOW_THREADS
+    norm_c = calc_fused_norm(points_c, threads);
+    free_matrix(points_c);
+    Py_END_ALLOW_THREADS
+
+    return norm_c;
+}
+
+static PyObject *norm_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "n", "d", "threads", "knn", "threshold", "float32", "output", NULL};
+    PyObject *points_py;
+    matrix *points_c;
+    double *dgg_c;
+    symnmf_opts opts;
+    csr_matrix *csr_c;
+    int n, d, as_array;
+    matrix *norm_c;
+
+    n = -1;
+    d = -1;
+    opts.threads = default_threads();
+    opts.knn = 0;
+    opts.threshold = 0.0;
+    opts.float32 = 0;
+    opts.half = -1;
+    opts.output = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii$iidpz", kwlist, &points_py, &n, &d, &opts.threads, &opts.knn,
+                                     &opts.threshold, &opts.float32, &opts.output))
+        return NULL;
+    if (check_threads(opts.threads) || check_graph_opts(&opts))
+        return NULL;
+    if (opts.float32 && (opts.knn > 0 || opts.threshold > 0.0)) {
+        /* Single precision; the sparse graphs hold doubles */
+        PyErr_SetString(PyExc_ValueError, "float32 supports dense affinities only");
+        return NULL;
+    }
+
+    /* Translate point matrix to C, from a list, a buffer or a file; only lists get lists back */
+    as_array = !PyList_Check(points_py);
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c)
+        return NULL;
+
+    if (opts.float32) {
+        return _single_wrapper("norm", points_c, opts.threads, opts.output, as_array);
+    }
+
+    if (opts.knn > 0 || opts.threshold > 0.0) {
+        /* Normalize the sparse graph in place */
+        csr_c = _sym_sparse_wrapper(points_c, &opts);
+        if (!csr_c)
+            return NULL;
+        Py_BEGIN_ALLOW_THREADS
+        dgg_c = calc_ddg_sparse(csr_c, opts.threads);
+        if (dgg_c)
+            calc_norm_sparse(csr_c, dgg_c, opts.threads);
+        Py_END_ALLOW_THREADS
+        if (!dgg_c) {
+            free_csr(csr_c);
+            return PyErr_NoMemory();
+        }
+        free(dgg_c);
+        return csr_result(csr_c, opts.output, as_array);
+    }
+
+    /* Calculate norm matrix */
+    norm_c = _norm_wrapper(points_c, opts.threads);
+
+    /* Translate matrix to Python*/
+    return matrix_result(norm_c, opts.output, as_array);
+}
+
+PyObject *_symnmf_single_wrapper(PyObject *W_py, PyObject *H_init_py, int n, int k, int threads, int half_format,
+                                 int method, const char *output, symnmf_stats *stats) {
+    matrix_f *W_c, *H_init_c, *H_c;
+    half_matrix *W_half;
+    affinity_f W;
+
+    /* Translate W and the initial H to C, rounded to float or to 16 bits */
+    W_c = NULL;
+    W_half = NULL;
+    if (half_format >= 0) {
+        W_half = half_py_to_c(W_py, n, half_format, threads);
+        if (!W_half)
+            return NULL;
+        W.format = AFFINITY_HALF;
+    } else {
+        W_c = matrix_py_to_c_f(W_py, n, n);
+        if (!W_c)
+            return NULL;
+        W.format = AFFINITY_DENSE;
+    }
+    W.dense = W_c;
+    W.csr = NULL;
+    W.packed = NULL;
+    W.half = W_half;
+    W.scale = NULL;
+
+    H_init_c = matrix_py_to_c_f(H_init_py, n, k);
+    if (!H_init_c) {
+        free_matrix_f(W_c);
+        free_half(W_half);
+        return NULL;
+    }
+    if (stats)
+        stats->affinity_bytes = affinity_bytes_f(&W, n);
+
+    /* Calculate H matrix */
+    Py_BEGIN_ALLOW_THREADS
+    H_c = calc_symnmf_f(&W, H_init_c, threads, method, stats);
+    free_matrix_f(W_c);
+    free_half(W_half);
+    Py_END_ALLOW_THREADS
+
+    /* Translate H matrix to Python, as an array unless H came as a list */
+    return stats_result(matrix_result_f(H_c, output, !PyList_Check(H_init_py)), stats);
+}
+
+static PyObject *symnmf_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"W", "H_init", "n", "k", "threads", "packed", "float32", "half", "output", "method",
+                             "stats", NULL};
+    PyObject *W_py, *H_init_py;
+    matrix *W_c, *H_init_c, *H_c, W_view;
+    Py_buffer W_buf;
+    csr_matrix *W_csr;
+    sym_packed *W_packed;
+    half_matrix *W_half;
+    const char *half_name, *output, *method_name;
+    symnmf_stats stats;
+    affinity W;
+    int n, k, threads, packed, float32, half_format, method, viewed, with_stats;
+
+    threads = default_threads();
+    packed = 0;
+    float32 = 0;
+    half_name = NULL;
+    output = NULL;
+    method_name = "mu";
+    with_stats = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOii|$ippzzsp", kwlist, &W_py, &H_init_py, &n, &k, &threads,
+                                     &packed, &float32, &half_name, &output, &method_name, &with_stats))
+        return NULL;
+    if (check_threads(threads))
+        return NULL;
+    stats_reset(&stats);
+
+    method = method_from_name(method_name);
+    if (method < 0) {
+        PyErr_SetString(PyExc_ValueError, "method must be 'mu', 'nesterov', 'hals' or 'anls'");
+        return NULL;
+    }
+
+    half_format = -1;
+    if (half_name) {
+        /* 16-bit storage of a dense W */
+        half_format = half_format_from_name(half_name);
+        if (half_format < 0) {
+            PyErr_SetString(PyExc_ValueError, "half must be 'fp16' or 'bf16'");
+            return NULL;
+        }
+        if (PyTuple_Check(W_py) || packed) {
+            PyErr_SetString(PyExc_ValueError, "half supports dense affinities only");
+            return NULL;
+        }
+    }
+
+    if (float32) {
+        /* Single precision; the CSR and packed formats hold doubles */
+        if (PyTuple_Check(W_py) || packed) {
+            PyErr_SetString(PyExc_ValueError, "float32 supports dense affinities only");
+            return NULL;
+        }
+        return _symnmf_single_wrapper(W_py, H_init_py, n, k, threads, half_format, method, output,
+                                      with_stats ? &stats : NULL);
+    }
+
+    /* Translate W matrix to C, dense or as a CSR triple */
+    W_c = NULL;
+    W_csr = NULL;
+    W_packed = NULL;
+    W_half = NULL;
+    viewed = 0;
+    if (PyTuple_Check(W_py)) {
+        W_csr = csr_py_to_c(W_py, n);
+        if (!W_csr)
+            return NULL;
+        W.format = AFFINITY_CSR;
+    } else if (packed) {
+        /* W is symmetric: keep its upper triangle only */
+        W_packed = packed_py_to_c(W_py, n);
+        if (!W_packed)
+            return NULL;
+        W.format = AFFINITY_PACKED;
+    } else if (half_format >= 0) {
+        /* W is only read by W * H: keep it in 16 bits */
+        W_half = half_py_to_c(W_py, n, half_format, threads);
+        if (!W_half)
+            return NULL;
+        W.format = AFFINITY_HALF;
+    } else if (!PyList_Check(W_py) && PyObject_CheckBuffer(W_py)) {
+        /* W is only read: use the caller's buffer in place */
+        if (matrix_py_view(W_py, &n, &n, &W_buf, &W_view) != 0)
+            return NULL;
+        viewed = 1;
+        W.format = AFFINITY_DENSE;
+    } else {
+        W_c = matrix_py_to_c(W_py, n, n);
+        if (!W_c)
+            return NULL;
+        W.format = AFFINITY_DENSE;
+    }
+    W.dense = viewed ? &W_view : W_c;
+    W.csr = W_csr;
+    W.packed = W_packed;
+    W.half = W_half;
+    W.scale = NULL;
+
+    /* Translate initial H matrix to C */
+    H_init_c = matrix_py_to_c(H_init_py, n, k);
+    if (!H_init_c) {
+        free_matrix(W_c);
+        free_csr(W_csr);
+        free_packed(W_packed);
+        free_half(W_half);
+        if (viewed)
+            PyBuffer_Release(&W_buf);
+        return NULL;
+    }
+
+    /* A viewed W belongs to the caller */
+    if (!viewed)
+        stats.affinity_bytes = affinity_bytes(&W, n);
+
+    /* Calculate H matrix; a viewed W stays valid while its buffer is held */
+    Py_BEGIN_ALLOW_THREADS
+    H_c = calc_symnmf(&W, H_init_c, threads, method, with_stats ? &stats : NULL);
+    free_matrix(W_c);
+    free_csr(W_csr);
+    free_packed(W_packed);
+    free_half(W_half);
+    Py_END_ALLOW_THREADS
+    if (viewed)
+        PyBuffer_Release(&W_buf);
+
+    /* Translate H matrix to Python, as an array unless H came as a list */
+    return stats_result(matrix_result(H_c, output, !PyList_Check(H_init_py)), with_stats ? &stats : NULL);
+}
+
+static PyObject *fit_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "k", "n", "d", "seed", "threads", "knn", "threshold",
+                             "packed", "float32", "output", "method", "stats", "scratch", "half", NULL};
+    PyObject *points_py, *result_py;
+    matrix *points_c, *H_c;
+    symnmf_opts opts;
+    symnmf_stats stats;
+    const char *method_name, *half_name;
+    long long seed;
+    double start;
+    int n, d, as_array, with_stats, err;
+
+    n = -1;
+    d = -1;
+    seed = SYMNMF_SEED;
+    opts.threads = default_threads();
+    opts.knn = 0;
+    opts.threshold = 0.0;
+    opts.packed = 0;
+    opts.float32 = 0;
+    opts.output = NULL;
+    method_name = "mu";
+    with_stats = 0;
+    opts.scratch = NULL;
+    half_name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|ii$Liidppzspzz", kwlist, &points_py, &opts.k, &n, &d, &seed,
+                                     &opts.threads, &opts.knn, &opts.threshold, &opts.packed, &opts.float32,
+                                     &opts.output, &method_name, &with_stats, &opts.scratch, &half_name))
+        return NULL;
+    if (check_threads(opts.threads) || check_graph_opts(&opts))
+        return NULL;
+    if (opts.scratch)
+        opts.packed = 1;
+    if (check_half_opts(half_name, &opts))
+        return NULL;
+    stats_reset(&stats);
+    opts.stats = with_stats ? &stats : NULL;
+    opts.method = method_from_name(method_name);
+    if (opts.method < 0) {
+        PyErr_SetString(PyExc_ValueError, "method must be 'mu', 'nesterov', 'hals' or 'anls'");
+        return NULL;
+    }
+    if (seed < 0 || seed > 0xffffffffLL) {
+        PyErr_SetString(PyExc_ValueError, "seed must be between 0 and 2**32 - 1");
+        return NULL;
+    }
+    opts.seed = (unsigned long)seed;
+    if (opts.float32 && (opts.knn > 0 || opts.threshold > 0.0 || opts.packed)) {
+        /* Single precision; the CSR and packed formats hold doubles */
+        PyErr_SetString(PyExc_ValueError, "float32 supports dense affinities only");
+        return NULL;
+    }
+
+    /* Translate point matrix to C, from a list, a buffer or a file; only lists get lists back */
+    as_array = !PyList_Check(points_py);
+    start = stats_start(opts.stats);
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c)
+        return NULL;
+    stats_stop(opts.stats, STAGE_READ, start);
+    if (opts.k < 1 || opts.k >= n) {
+        free_matrix(points_c);
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and n - 1");
+        return NULL;
+    }
+
+    /* W, the initial H and the solve, all in C */
+    Py_BEGIN_ALLOW_THREADS
+    H_c = calc_symnmf_points(points_c, &opts);
+    err = errno;
+    Py_END_ALLOW_THREADS
+    if (!H_c && opts.scratch && err != ENOMEM) {
+        errno = err;
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, opts.scratch);
+    }
+
+    /* Translate H matrix to Python, timing the copy or the write when stats were asked for */
+    start = stats_start(opts.stats);
+    result_py = matrix_result(H_c, opts.output, as_array);
+    stats_stop(opts.stats, STAGE_WRITE, start);
+    return stats_result(result_py, opts.stats);
+}
+
+/* Reads a sequence of (k, seed) pairs into a new array of runs, or sets a Python error */
+static symnmf_run *runs_py_to_c(PyObject *runs_py, int *nruns) {
+    PyObject *seq;
+    symnmf_run *runs;
+    unsigned long long seed;
+    Py_ssize_t r, count;
+
+    seq = PySequence_Fast(runs_py, "runs must be a sequence of (k, seed) pairs");
+    if (!seq)
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count > INT_MAX) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "too many runs");
+        return NULL;
+    }
+
+    runs = malloc((count > 0 ? count : 1) * sizeof(symnmf_run));
+    if (!runs) {
+        Py_DECREF(seq);
+        return (symnmf_run *)PyErr_NoMemory();
+    }
+    for (r = 0; r < count; r++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, r), "iK;runs must hold (k, seed) pairs", &runs[r].k,
+                              &seed))
+            break;
+        if (seed > 0xffffffffULL) {
+            PyErr_SetString(PyExc_ValueError, "seed must be between 0 and 2**32 - 1");
+            break;
+        }
+        runs[r].seed = (unsigned long)seed;
+        runs[r].H = NULL;
+    }
+    Py_DECREF(seq);
+    if (r < count) {
+        free(runs);
+        return NULL;
+    }
+
+    *nruns = (int)count;
+    return runs;
+}
+
+static PyObject *fit_batch_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "runs", "n", "d", "threads", "knn", "threshold", "packed", "scratch", "half",
+                             NULL};
+    PyObject *points_py, *runs_py, *result_py, *H_py;
+    const char *half_name;
+    matrix *points_c;
+    symnmf_run *runs;
+    symnmf_opts opts;
+    affinity W;
+    int n, d, r, nruns, as_array, failed, err;
+
+    n = -1;
+    d = -1;
+    nruns = 0;
+    opts.threads = default_threads();
+    opts.knn = 0;
+    opts.threshold = 0.0;
+    opts.packed = 0;
+    opts.float32 = 0;
+    opts.output = NULL;
+    opts.stats = NULL;
+    opts.scratch = NULL;
+    half_name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ii$iidpzz", kwlist, &points_py, &runs_py, &n, &d, &opts.threads,
+                                     &opts.knn, &opts.threshold, &opts.packed, &opts.scratch, &half_name))
+        return NULL;
+    if (check_threads(opts.threads) || check_graph_opts(&opts))
+        return NULL;
+    if (opts.scratch)
+        opts.packed = 1;
+    if (check_half_opts(half_name, &opts))
+        return NULL;
+
+    runs = runs_py_to_c(runs_py, &nruns);
+    if (!runs)
+        return NULL;
+
+    /* Translate point matrix to C, from a list, a buffer or a file; only lists get lists back */
+    as_array = !PyList_Check(points_py);
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c) {
+        free(runs);
+        return NULL;
+    }
+    for (r = 0; r < nruns; r++) {
+        if (runs[r].k < 1 || runs[r].k >= n) {
+            free_matrix(points_c);
+            free(runs);
+            PyErr_SetString(PyExc_ValueError, "k must be between 1 and n - 1");
+            return NULL;
+        }
+    }
+
+    /* W once, then every run against it */
+    Py_BEGIN_ALLOW_THREADS
+    failed = calc_affinity(points_c, &opts, &W);
+    err = errno;
+    if (!failed) {
+        failed = calc_symnmf_batch(&W, n, runs, nruns, opts.threads) != 0;
+        free_affinity(&W);
+    }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        free(runs);
+        if (failed == AFFINITY_SCRATCH_ERROR) {
+            errno = err;
+            return PyErr_SetFromErrnoWithFilename(PyExc_OSError, opts.scratch);
+        }
+        return PyErr_NoMemory();
+    }
+
+    /* Hand back (H, objective) per run; matrix_result consumes the H it is given, free_runs the rest */
+    result_py = PyList_New(nruns);
+    for (r = 0; result_py && r < nruns; r++) {
+        H_py = matrix_result(runs[r].H, NULL, as_array);
+        runs[r].H = NULL;
+        if (!H_py) {
+            Py_CLEAR(result_py);
+            break;
+        }
+        PyList_SET_ITEM(result_py, r, Py_BuildValue("(Nd)", H_py, runs[r].objective));
+        if (!PyList_GET_ITEM(result_py, r))
+            Py_CLEAR(result_py);
+    }
+
+    free_runs(runs, nruns);
+    free(runs);
+    return result_py;
+}
+
+static PyObject *to_half_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"values", "half", NULL};
+    PyObject *values_py;
+    const char *half_name;
+    unsigned short *bits;
+    Py_buffer buf;
+    matrix view;
+    int n, d, i, j, format;
+
+    half_name = "fp16";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$s", kwlist, &values_py, &half_name))
+        return NULL;
+    format = half_format_from_name(half_name);
+    if (format < 0) {
+        PyErr_SetString(PyExc_ValueError, "half must be 'fp16' or 'bf16'");
+        return NULL;
+    }
+
+    /* Rounded as half_from_matrix rounds W, one entry at a time */
+    n = -1;
+    d = -1;
+    if (matrix_py_view(values_py, &n, &d, &buf, &view) != 0)
+        return NULL;
+    bits = malloc(((size_t)n * d > 0 ? (size_t)n * d : 1) * sizeof(unsigned short));
+    if (!bits) {
+        PyBuffer_Release(&buf);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < d; j++) {
+            bits[(size_t)i * d + j] = half_from_double(MAT_AT(&view, i, j), format);
+        }
+    }
+    PyBuffer_Release(&buf);
+
+    return array_from_c(bits, free, bits, "H", sizeof(unsigned short), 2, n, d, d, 1);
+}
+
+static PyObject *write_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"values", "output", NULL};
+    PyObject *values_py, *result_py;
+    const char *output;
+    out_writer *out;
+    Py_buffer buf;
+    matrix view;
+    int n, d;
+
+    output = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$z", kwlist, &values_py, &output))
+        return NULL;
+    n = -1;
+    d = -1;
+    if (matrix_py_view(values_py, &n, &d, &buf, &view) != 0)
+        return NULL;
+    if (output) {
+        result_py = matrix_c_to_npy(&view, output);
+        PyBuffer_Release(&buf);
+        return result_py;
+    }
+
+    /* Text goes straight to file descriptor 1, so Python's own buffer is flushed first */
+    result_py = PySys_GetObject("stdout");
+    if (result_py && result_py != Py_None) {
+        result_py = PyObject_CallMethod(result_py, "flush", NULL);
+        if (!result_py) {
+            PyBuffer_Release(&buf);
+            return NULL;
+        }
+        Py_DECREF(result_py);
+    }
+    out = writer_open(NULL, n, d);
+    if (!out) {
+        PyBuffer_Release(&buf);
+        return PyErr_NoMemory();
+    }
+    Py_BEGIN_ALLOW_THREADS
+    print_matrix(&view, out);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&buf);
+    if (writer_close(out))
+        return PyErr_SetFromErrno(PyExc_OSError);
+    return Py_BuildValue("(ii)", n, d);
+}
+
+/* Name of the capsules holding an incremental state */
+#define STATE_CAPSULE "mysymnmf.state"
+
+/* An incremental state behind a capsule; busy while a call works on it without the GIL */
+typedef struct {
+    symnmf_state *state;
+    int busy;
+} state_holder;
+
+static void state_capsule_free(PyObject *capsule) {
+    state_holder *holder;
+
+    holder = PyCapsule_GetPointer(capsule, STATE_CAPSULE);
+    if (holder) {
+        state_free(holder->state);
+        free(holder);
+    }
+}
+
+/* H of a state as a new list of lists or array; the state keeps its own */
+static PyObject *state_H(const symnmf_state *state, int as_array) {
+    matrix *H;
+    int i;
+
+    if (!as_array)
+        return matrix_c_to_py(state->H);
+
+    H = matrix_init(state->H->rows, state->H->cols);
+    if (!H)
+        return PyErr_NoMemory();
+    for (i = 0; i < H->rows; i++) {
+        memcpy(MAT_ROW(H, i), MAT_ROW(state->H, i), H->cols * sizeof(double));
+    }
+    return matrix_c_to_array(H);
+}
+
+static PyObject *fit_incremental_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"points", "k", "n", "d", "seed", "threads", NULL};
+    PyObject *points_py, *state_py, *H_py;
+    matrix *points_c;
+    state_holder *holder;
+    symnmf_state *state;
+    long long seed;
+    int n, d, k, threads;
+
+    n = -1;
+    d = -1;
+    seed = SYMNMF_SEED;
+    threads = default_threads();
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|ii$Li", kwlist, &points_py, &k, &n, &d, &seed, &threads))
+        return NULL;
+    if (check_threads(threads))
+        return NULL;
+    if (seed < 0 || seed > 0xffffffffLL) {
+        PyErr_SetString(PyExc_ValueError, "seed must be between 0 and 2**32 - 1");
+        return NULL;
+    }
+
+    /* Translate point matrix to C, from a list, a buffer or a file */
+    points_c = points_py_to_c(points_py, &n, &d);
+    if (!points_c)
+        return NULL;
+    if (k < 1 || k >= n) {
+        free_matrix(points_c);
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and n - 1");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    state = state_init(points_c, k, (unsigned long)seed, threads);
+    Py_END_ALLOW_THREADS
+    holder = state ? malloc(sizeof(state_holder)) : NULL;
+    if (!holder) {
+        state_free(state);
+        return PyErr_NoMemory();
+    }
+    holder->state = state;
+    holder->busy = 0;
+    state_py = PyCapsule_New(holder, STATE_CAPSULE, state_capsule_free);
+    if (!state_py) {
+        state_free(state);
+        free(holder);
+        return NULL;
+    }
+
+    H_py = state_H(state, !PyList_Check(points_py));
+    if (!H_py) {
+        Py_DECREF(state_py);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", state_py, H_py);
+}
+
+static PyObject *append_points_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"state", "points", "m", "d", "threads", NULL};
+    PyObject *state_py, *points_py, *result_py;
+    state_holder *holder;
+    matrix *points_c;
+    int m, d, threads, failed;
+
+    m = -1;
+    d = -1;
+    threads = default_threads();
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ii$i", kwlist, &state_py, &points_py, &m, &d, &threads))
+        return NULL;
+    if (check_threads(threads))
+        return NULL;
+    holder = PyCapsule_GetPointer(state_py, STATE_CAPSULE);
+    if (!holder)
+        return NULL;
+    if (holder->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the state is in use by another call");
+        return NULL;
+    }
+
+    /* Claimed before the points are read, since reading a file releases the GIL */
+    holder->busy = 1;
+    points_c = points_py_to_c(points_py, &m, &d);
+    if (!points_c) {
+        holder->busy = 0;
+        return NULL;
+    }
+    if (d != holder->state->points->cols) {
+        free_matrix(points_c);
+        holder->busy = 0;
+        PyErr_SetString(PyExc_ValueError, "the new points do not match the dimension of the state");
+        return NULL;
+    }
+
+    /* Only the new rows of A and a warm solve; the state is left as it was on failure */
+    Py_BEGIN_ALLOW_THREADS
+    failed = state_append(holder->state, points_c, threads);
+    Py_END_ALLOW_THREADS
+    result_py = failed ? PyErr_NoMemory() : state_H(holder->state, !PyList_Check(points_py));
+    holder->busy = 0;
+
+    return result_py;
+}
+
+static PyObject *state_affinity_wrapper(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"state", NULL};
+    PyObject *state_py, *W_py, *D_py;
+    state_holder *holder;
+    const symnmf_state *state;
+    matrix *W_c;
+    int i, j;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &state_py))
+        return NULL;
+    holder = PyCapsule_GetPointer(state_py, STATE_CAPSULE);
+    if (!holder)
+        return NULL;
+    if (holder->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the state is in use by another call");
+        return NULL;
+    }
+
+    /* W as the solve uses it: diag(scale) * A * diag(scale) */
+    state = holder->state;
+    W_c = matrix_init(state->n, state->n);
+    if (!W_c)
+        return PyErr_NoMemory();
+    for (i = 0; i < state->n; i++) {
+        for (j = 0; j < state->n; j++) {
+            MAT_AT(W_c, i, j) = state->scale[i] * MAT_AT(state->A, i, j) * state->scale[j];
+        }
+    }
+
+    W_py = matrix_c_to_array(W_c);
+    D_py = W_py ? diag_c_to_array(state->degrees, state->n) : NULL;
+    if (!D_py) {
+        Py_XDECREF(W_py);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", W_py, D_py);
+}
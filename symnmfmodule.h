@@ -1,4 +1,5 @@
 #include <Python.h>
+#include "symnmf.h"
 
 /*
  * ============================================================================
@@ -7,22 +8,183 @@
  */
 
 /**
- * Converts a Python list of lists to a C double** matrix.
- * @param py_matrix Python object representing a list of lists.
+ * Converts a Python list of lists, or a float64 buffer (see matrix_py_view), to a C matrix.
+ * @param py_matrix Python object representing a list of lists, or a buffer.
  * @param n Number of rows.
  * @param m Number of columns.
  * @return Pointer to allocated C matrix, or NULL on error.
  */
-double **matrix_py_to_c(PyObject *py_matrix, int n, int m);
+matrix *matrix_py_to_c(PyObject *py_matrix, int n, int m);
 
 /**
- * Converts a C double** matrix to a Python list of lists.
- * @param c_matrix Pointer to C matrix.
+ * Views a float64 buffer in place as a matrix.
+ * The buffer must hold native doubles in one or two dimensions with unit stride along a
+ * row, such as a C-contiguous numpy array or an array these functions returned.
+ * @param py_matrix Python object exporting the buffer.
+ * @param n In: number of rows, or -1 for any. Out: number of rows.
+ * @param m In: number of columns, or -1 for any. Out: number of columns.
+ * @param buf Output buffer, to be released with PyBuffer_Release once the view is done with.
+ * @param view Output matrix header over the buffer; it must not be freed.
+ * @return 0 on success, or 1 with a Python error set.
+ */
+int matrix_py_view(PyObject *py_matrix, int *n, int *m, Py_buffer *buf, matrix *view);
+
+/**
+ * Converts a Python list of lists or a float64 buffer to a C float matrix, rounding every entry.
+ * @param py_matrix Python object representing a list of lists, or a buffer.
  * @param n Number of rows.
  * @param m Number of columns.
+ * @return Pointer to allocated C matrix, or NULL on error.
+ */
+matrix_f *matrix_py_to_c_f(PyObject *py_matrix, int n, int m);
+
+/**
+ * Converts a C matrix to a Python list of lists. The C matrix is not freed.
+ * @param c_matrix Pointer to C matrix.
+ * @return Python object representing a list of lists, or NULL on error.
+ */
+PyObject *matrix_c_to_py(const matrix *c_matrix);
+
+/**
+ * Converts a C float matrix to a Python list of lists. The C matrix is not freed.
+ * @param c_matrix Pointer to C matrix.
  * @return Python object representing a list of lists, or NULL on error.
  */
-PyObject *matrix_c_to_py(double **c_matrix, int n, int m);
+PyObject *matrix_c_to_py_f(const matrix_f *c_matrix);
+
+/**
+ * Converts a diagonal, given as a C vector, to a Python list of lists.
+ * @param diag Pointer to the diagonal entries.
+ * @param n Size of the square matrix.
+ * @return Python object representing a list of lists, or NULL on error.
+ */
+PyObject *diag_c_to_py(const double *diag, int n);
+
+/**
+ * Converts a C CSR matrix to a Python (values, col_idx, row_ptr) tuple of lists.
+ * @param c_csr Pointer to the CSR matrix, which is not freed.
+ * @return Python tuple, or NULL on error.
+ */
+PyObject *csr_c_to_py(const csr_matrix *c_csr);
+
+/**
+ * Writes a C matrix to a .npy file, through the writer the CLI uses. The C matrix is not freed.
+ * @param c_matrix Pointer to C matrix.
+ * @param path File to write.
+ * @return The (rows, cols) written, or NULL on error.
+ */
+PyObject *matrix_c_to_npy(const matrix *c_matrix, const char *path);
+
+/**
+ * Writes a C float matrix to a .npy file of float64. The C matrix is not freed.
+ * @param c_matrix Pointer to C matrix.
+ * @param path File to write.
+ * @return The (rows, cols) written, or NULL on error.
+ */
+PyObject *matrix_c_to_npy_f(const matrix_f *c_matrix, const char *path);
+
+/**
+ * Writes a diagonal matrix, given as a C vector, to a .npy file in full.
+ * @param diag Pointer to the diagonal entries.
+ * @param n Size of the square matrix.
+ * @param path File to write.
+ * @return The (n, n) written, or NULL on error.
+ */
+PyObject *diag_c_to_npy(const double *diag, int n, const char *path);
+
+/**
+ * Writes a C CSR matrix to a .npy file densely. The C matrix is not freed.
+ * @param c_csr Pointer to the CSR matrix.
+ * @param path File to write.
+ * @return The (rows, cols) written, or NULL on error.
+ */
+PyObject *csr_c_to_npy(const csr_matrix *c_csr, const char *path);
+
+/**
+ * Wraps a C block in a numpy.ndarray that owns it, through a buffer-protocol object.
+ * Without numpy the buffer-protocol object itself is returned.
+ * @param owner What to release once the array is collected; released here on failure.
+ * @param release Releases owner.
+ * @param data First element.
+ * @param format Buffer format of an element ("d", "f", ...).
+ * @param itemsize Bytes per element.
+ * @param ndim 1 or 2.
+ * @param rows Number of rows (elements, for one dimension).
+ * @param cols Number of columns.
+ * @param stride Elements between the starts of consecutive rows.
+ * @param writable 0 when data is read-only memory; the array is then exported read-only.
+ * @return The array, or NULL on error.
+ */
+PyObject *array_from_c(void *owner, void (*release)(void *), void *data, const char *format, Py_ssize_t itemsize,
+                       int ndim, Py_ssize_t rows, Py_ssize_t cols, Py_ssize_t stride, int writable);
+
+/**
+ * Converts a C matrix to a numpy array without copying; the array takes over the matrix.
+ * A matrix viewing a read-only file mapping becomes a read-only array.
+ * @param c_matrix Pointer to C matrix.
+ * @return The array, or NULL on error (the matrix is freed either way).
+ */
+PyObject *matrix_c_to_array(matrix *c_matrix);
+
+/**
+ * Converts a C float matrix to a float32 numpy array without copying; the array takes over the matrix.
+ * @param c_matrix Pointer to C matrix.
+ * @return The array, or NULL on error (the matrix is freed either way).
+ */
+PyObject *matrix_c_to_array_f(matrix_f *c_matrix);
+
+/**
+ * Converts a diagonal, given as a C vector, to an n x n numpy array.
+ * @param diag Pointer to the diagonal entries, which are not freed.
+ * @param n Size of the square matrix.
+ * @return The array, or NULL on error.
+ */
+PyObject *diag_c_to_array(const double *diag, int n);
+
+/**
+ * Converts a C CSR matrix to a (values, col_idx, row_ptr) tuple of numpy arrays without copying.
+ * @param c_csr Pointer to the CSR matrix, taken over by the arrays.
+ * @return Python tuple, or NULL on error (the matrix is freed either way).
+ */
+PyObject *csr_c_to_array(csr_matrix *c_csr);
+
+/**
+ * Converts a Python (values, col_idx, row_ptr) tuple of sequences to an n x n C CSR matrix.
+ * @param py_csr Python tuple of lists or arrays.
+ * @param n Number of rows and columns.
+ * @return Pointer to allocated CSR matrix, or NULL with a Python error set.
+ */
+csr_matrix *csr_py_to_c(PyObject *py_csr, int n);
+
+/**
+ * Converts a symmetric Python list of lists or float64 buffer to packed C storage,
+ * reading only its upper triangle of tiles.
+ * @param py_matrix Python object representing an n x n list of lists, or a buffer.
+ * @param n Number of rows and columns.
+ * @return Pointer to allocated packed matrix, or NULL on error.
+ */
+sym_packed *packed_py_to_c(PyObject *py_matrix, int n);
+
+/**
+ * Converts a Python list of lists or float64 buffer to a C matrix of 16-bit floats.
+ * @param py_matrix Python object representing an n x n list of lists, or a buffer.
+ * @param n Number of rows and columns.
+ * @param format HALF_FP16 or HALF_BF16.
+ * @param threads Number of worker threads.
+ * @return Pointer to allocated 16-bit matrix, or NULL on error.
+ */
+half_matrix *half_py_to_c(PyObject *py_matrix, int n, int format, int threads);
+
+/**
+ * Converts the points argument of sym, ddg and norm to a C matrix.
+ * A list of lists is n x d; a file name (str or bytes) is read by read_input, as the CLI
+ * reads its input, and fills in n and d, which must match the file when given (>= 0).
+ * @param points_py Python list of lists, or a file name.
+ * @param n In: number of rows, or -1. Out: number of rows.
+ * @param d In: number of columns, or -1. Out: number of columns.
+ * @return Pointer to allocated C matrix, or NULL on error.
+ */
+matrix *points_py_to_c(PyObject *points_py, int *n, int *d);
 
 /*
  * ============================================================================
@@ -30,61 +192,203 @@ PyObject *matrix_c_to_py(double **c_matrix, int n, int m);
  * ============================================================================
  */
 
+/*
+ * Every entry point converts its Python arguments first and then runs the C core
+ * with the GIL released, so calls from several Python threads proceed in parallel.
+ * The core only touches C-owned blocks and buffers held for the call, and reports
+ * failures by returning NULL rather than exiting.
+ */
+
 /**
- * Internal helper for sym: computes the similarity matrix from Python input.
- * @param points_py Python list of lists representing data points.
- * @param n Number of points.
- * @param d Dimension of each point.
+ * Internal helper for sym: computes the similarity matrix of the points.
+ * @param points_c The data points, freed here.
+ * @param threads Number of worker threads.
  * @return Pointer to similarity matrix, or NULL on error.
  */
-double **_sym_wrapper(PyObject *points_py, int n, int d);
+matrix *_sym_wrapper(matrix *points_c, int threads);
+
+/**
+ * Internal helper for the sparse modes: builds the kNN or threshold graph of the points.
+ * @param points_c The data points, freed here.
+ * @param opts Thread count and the knn / threshold selection.
+ * @return Pointer to the CSR similarity matrix, or NULL on error.
+ */
+csr_matrix *_sym_sparse_wrapper(matrix *points_c, const symnmf_opts *opts);
+
+/**
+ * Internal helper for the float32 mode of sym, ddg and norm.
+ * @param goal The goal string ("sym", "ddg", or "norm").
+ * @param points The data points, freed here.
+ * @param threads Number of worker threads.
+ * @param output .npy file to write the result to, or NULL to return it.
+ * @param as_array Whether to return an array rather than a list of lists.
+ * @return The result as a Python list of lists or array, the shape written, or NULL on error.
+ */
+PyObject *_single_wrapper(const char *goal, matrix *points, int threads, const char *output, int as_array);
+
+/**
+ * Python wrapper for the CLI's input reader.
+ * @param self Unused.
+ * @param args Tuple: (file_name,); a comma-separated text, .npy or raw points file.
+ * @param kwargs May give file_name by keyword.
+ * @return The n x d points as a numpy array, which maps the file read-only for .npy and raw input;
+ *         NULL with ValueError when the file cannot be read.
+ */
+static PyObject *read_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
 
 /**
  * Python wrapper for similarity matrix calculation.
  * @param self Unused.
- * @param args Tuple: (points_py, n, d)
- * @return Similarity matrix as Python list of lists.
+ * @param args Tuple: (points_py, n, d); points_py may be a float64 buffer or a file name, with n and d
+ *             then optional. Results come back as numpy arrays unless points_py is a list.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1), knn, threshold, float32,
+ *               output (a .npy file to write the result to).
+ * @return Similarity matrix as Python list of lists, or a CSR triple when knn or threshold is set;
+ *         the (n, n) written when output is set.
  */
-static PyObject *sym_wrapper(PyObject *self, PyObject *args);
+static PyObject *sym_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
 
 /**
- * Internal helper for ddg: computes the diagonal degree matrix from Python input.
- * @param points_py Python list of lists representing data points.
- * @param n Number of points.
- * @param d Dimension of each point.
- * @return Pointer to diagonal degree matrix, or NULL on error.
+ * Internal helper for ddg: computes the degree vector of the points.
+ * @param points_c The data points, freed here.
+ * @param threads Number of worker threads.
+ * @return Pointer to the n degrees (the diagonal of D), or NULL on error.
  */
-double **_dgg_wrapper(PyObject *points_py, int n, int d);
+double *_dgg_wrapper(matrix *points_c, int threads);
 
 /**
  * Python wrapper for diagonal degree matrix calculation.
  * @param self Unused.
- * @param args Tuple: (points_py, n, d)
- * @return Diagonal degree matrix as Python list of lists.
+ * @param args Tuple: (points_py, n, d); points_py may be a float64 buffer or a file name, with n and d
+ *             then optional. Results come back as numpy arrays unless points_py is a list.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1), knn, threshold, float32,
+ *               output (a .npy file to write the result to).
+ * @return Diagonal degree matrix as Python list of lists, or the (n, n) written to output.
  */
-static PyObject *ddg_wrapper(PyObject *self, PyObject *args);
+static PyObject *ddg_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
 
 /**
- * Internal helper for norm: computes the normalized similarity matrix from Python input.
- * @param points_py Python list of lists representing data points.
- * @param n Number of points.
- * @param d Dimension of each point.
+ * Internal helper for norm: computes the normalized similarity matrix of the points.
+ * @param points_c The data points, freed here.
+ * @param threads Number of worker threads.
  * @return Pointer to normalized similarity matrix, or NULL on error.
  */
-double **_norm_wrapper(PyObject *points_py, int n, int d);
+matrix *_norm_wrapper(matrix *points_c, int threads);
 
 /**
  * Python wrapper for normalized similarity matrix calculation.
  * @param self Unused.
- * @param args Tuple: (points_py, n, d)
- * @return Normalized similarity matrix as Python list of lists.
+ * @param args Tuple: (points_py, n, d); points_py may be a float64 buffer or a file name, with n and d
+ *             then optional. Results come back as numpy arrays unless points_py is a list.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1), knn, threshold, float32,
+ *               output (a .npy file to write the result to).
+ * @return Normalized similarity matrix as Python list of lists, or a CSR triple when knn or threshold is set;
+ *         the (n, n) written when output is set.
+ */
+static PyObject *norm_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Internal helper for the float32 mode of symnmf, with a dense or 16-bit W.
+ * @param W_py Python list of lists representing W.
+ * @param H_init_py Python list of lists representing the initial H.
+ * @param n Number of points.
+ * @param k Number of clusters.
+ * @param threads Number of worker threads.
+ * @param half_format HALF_FP16 or HALF_BF16 to store W in 16 bits, or -1 for float.
+ * @param method The solver engine.
+ * @param output .npy file to write H to, or NULL to return it.
+ * @param stats Record to fill and return with H, or NULL.
+ * @return Optimized H matrix as Python list of lists, the shape written, or NULL on error;
+ *         paired with the stats dict when stats is given.
  */
-static PyObject *norm_wrapper(PyObject *self, PyObject *args);
+PyObject *_symnmf_single_wrapper(PyObject *W_py, PyObject *H_init_py, int n, int k, int threads, int half_format,
+                                 int method, const char *output, symnmf_stats *stats);
 
 /**
  * Python wrapper for symmetric NMF optimization.
  * @param self Unused.
- * @param args Tuple: (W_py, H_init_py, n, k)
- * @return Optimized H matrix as Python list of lists.
+ * @param args Tuple: (W_py, H_init_py, n, k); W_py is a list of lists, a float64 buffer (read in place
+ *             when dense) or a CSR triple, and H_init_py a list of lists or a float64 buffer.
+ *             H comes back as a numpy array unless H_init_py is a list.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1), packed
+ *               (default False) to keep a dense W in packed symmetric storage,
+ *               float32 (default False) to solve in single precision, and half
+ *               ("fp16" or "bf16", default None) to store a dense W in 16 bits, method
+ *               ("mu", "nesterov", "hals" or "anls", default "mu") to pick the solver engine,
+ *               output (default None) to write H to a .npy file, and stats (default False)
+ *               to return the instrumentation of the solve with H.
+ * @return Optimized H matrix as Python list of lists, or the (n, k) written to output;
+ *         (H, stats) with stats=True, stats a dict keyed as the CLI's --stats JSON.
+ */
+static PyObject *symnmf_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+/**
+ * Python wrapper for end-to-end SymNMF from the points.
+ * @param self Unused.
+ * @param args Tuple: (points_py, k, n, d); points_py may be a float64 buffer or a file name, with n and d
+ *             then optional. H comes back as a numpy array unless points_py is a list.
+ * @param kwargs Optional keywords: seed (default 1234) of the initial H, threads (defaults to
+ *               SYMNMF_THREADS or 1), knn, threshold and packed to select the format of W, float32,
+ *               method, half and stats (as for symnmf), output (a .npy file to write H to), and
+ *               scratch, a directory to keep the packed tiles of W in a file under (implies packed).
+ * @return Optimized H matrix as Python list of lists, or the (n, k) written to output; (H, stats)
+ *         with stats=True.
+ */
+static PyObject *fit_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper for a batch of SymNMF solves sharing one W.
+ * @param self Unused.
+ * @param args Tuple: (points_py, runs_py, n, d); points_py as for fit, runs_py a sequence of (k, seed) pairs.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1), and knn, threshold,
+ *               packed, scratch and half (as for fit) to select the format of W.
+ * @return List of (H, objective) tuples in the order of runs_py, with H as for fit and objective
+ *         ||W - H H^T||_F^2, or NULL on error.
+ */
+static PyObject *fit_batch_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper that starts an incremental fit.
+ * @param self Unused.
+ * @param args Tuple: (points_py, k, n, d); points_py as for fit.
+ * @param kwargs Optional keywords: seed (default 1234) of the initial H, and threads (defaults to
+ *               SYMNMF_THREADS or 1).
+ * @return Tuple (state, H): a capsule holding the fit for append_points, and H as for fit; NULL on error.
+ */
+static PyObject *fit_incremental_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper that appends points to an incremental fit and refits.
+ * @param self Unused.
+ * @param args Tuple: (state, points_py, m, d); state from fit_incremental, points_py the new points as for fit.
+ * @param kwargs Optional keywords: threads (defaults to SYMNMF_THREADS or 1).
+ * @return H of all points so far, as an array unless points_py is a list, or NULL on error.
+ */
+static PyObject *append_points_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper that hands out the affinities an incremental fit keeps.
+ * @param self Unused.
+ * @param args Tuple: (state,); a state from fit_incremental.
+ * @param kwargs May give state by keyword.
+ * @return Tuple (W, D) of numpy arrays: diag(s) A diag(s) with s = D^-0.5, and the diagonal degree matrix,
+ *         as norm and ddg give them for the points of the state; NULL on error.
+ */
+static PyObject *state_affinity_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper for the rounding a 16-bit W is stored with.
+ * @param self Unused.
+ * @param args Tuple: (values,); a float64 buffer of one or two dimensions.
+ * @param kwargs half: 'fp16' (the default) or 'bf16'.
+ * @return The n x d 16-bit encodings as a uint16 numpy array, or NULL with ValueError on bad input.
+ */
+static PyObject *to_half_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/**
+ * Python wrapper for the result writer the goals share.
+ * @param self Unused.
+ * @param args Tuple: (values,); a float64 buffer of one or two dimensions.
+ * @param kwargs output: a .npy file to write, or None (the default) for text on standard output.
+ * @return Tuple (rows, cols) of the values written, or NULL with OSError if a write failed.
  */
-static PyObject *symnmf_wrapper(PyObject *self, PyObject *args);
\ No newline at end of file
+static PyObject *write_wrapper(PyObject *self, PyObject *args, PyObject *kwargs);
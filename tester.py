@@ -2,11 +2,16 @@ import decimal
 from decimal import Decimal
 import enum
 import io
+import json
 from itertools import combinations
 import os
 import re
+import signal
 import subprocess
+import sys
 import tempfile
+import threading
+import time
 from typing import Optional, Any, IO
 
 import numpy as np
@@ -463,6 +468,932 @@ def test_symnmf_lib():
     return True
 
 
+def make_binary_file(data: bytes, suffix: str = ".bin"):
+    file = tempfile.NamedTemporaryFile(suffix=suffix, delete=True)
+    file.write(data)
+    file.flush()
+
+    return file
+
+
+def make_text_file(text: str):
+    return make_binary_file(text.encode(), ".txt")
+
+
+def same_bits(a: np.ndarray, b: np.ndarray) -> bool:
+    a = np.ascontiguousarray(a, dtype=np.float64)
+    b = np.ascontiguousarray(b, dtype=np.float64)
+    return a.shape == b.shape and np.array_equal(a.view(np.uint64), b.view(np.uint64))
+
+
+def reader_tokens() -> list[str]:
+    # Every branch of parse_double: the fast path, its strtod fallbacks, signs and zeros
+    tokens = [
+        # Exponents, either case and sign, at and around the fast path's 10^22 limit
+        "1e5", "1E5", "1.5e-3", "-2.5E+10", "3e0", "7e22", "1e-22", "-4.25e21",
+        "1e000010", "2e-000",
+        # More than 15 significant digits
+        "3.141592653589793238", "12345678901234567890", "9007199254740993",
+        "0.1000000000000000055511151231257827", "-1234567890.123456789",
+        "0.30000000000000004", "123456789012345.6",
+        # Values beyond 1e22 and below 1e-22
+        "1e23", "8.5e25", "123456e20", "1.7976931348623157e308", "1e-23",
+        "6.02214076e23", "1e300",
+        # Subnormals and the smallest normal
+        "4.9e-324", "5e-324", "1e-310", "2.2250738585072011e-308",
+        "2.2250738585072014e-308",
+        # Forms without a digit on one side of the point, or with an explicit sign
+        ".5", "5.", "+3.25", "-.75", "+.125", "-5.", "+0", "-0.0", "0", "0.0",
+        # Leading and trailing zeros
+        "000123.4500", "0.000000000000000000000001", "100000000000000000000000",
+        "0.0000e5",
+    ]
+
+    # Fixed-4 data, as the tests write it, and doubles printed at every precision
+    rng = np.random.default_rng()
+    tokens += [f"{x:.4f}" for x in rng.normal(scale=10.0, size=500)]
+    for x in rng.standard_normal(500) * 10.0 ** rng.integers(-30, 30, size=500):
+        tokens.append(f"{x:.{rng.integers(0, 20)}e}")
+        tokens.append(repr(float(x)))
+    for bits in rng.integers(0, 2**63 - 1, size=500, dtype=np.int64):
+        tokens.append(repr(float(np.int64(bits).view(np.float64))))
+
+    return [t for t in tokens if np.isfinite(float(t))]
+
+
+def test_reader() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+
+    # Every token parsed as float() does, one per row
+    tokens = reader_tokens()
+    expected = np.array([[float(t)] for t in tokens])
+    with make_text_file("\n".join(tokens) + "\n") as tmpfile:
+        points = symnmf.read(tmpfile.name)
+    if not same_bits(points, expected):
+        for t, got in zip(tokens, np.asarray(points)[:, 0]):
+            if not same_bits(np.array(got), np.array(float(t))):
+                print_red(f"failure: read {t!r} as {got!r}, expected {float(t)!r}")
+                break
+        success = False
+
+    # Layouts of the same two rows: CRLF, blank lines, blanks around the values and no
+    # final line end. numpy reads all but the last, where it takes the blanks for a row
+    layouts = (
+        "1.5,2\r\n3,-4.25\r\n",
+        "\n1.5,2\n\n\n3,-4.25\n\n",
+        "1.5,2\r\n\r\n3,-4.25",
+        " 1.5 , 2\t\n3,\t-4.25 \n",
+        "1.5,2\n   \n3,-4.25\n",
+    )
+    for i, text in enumerate(layouts):
+        with make_text_file(text) as tmpfile:
+            points = symnmf.read(tmpfile.name)
+            if i < len(layouts) - 1:
+                expected = np.loadtxt(tmpfile.name, delimiter=",", ndmin=2)
+            else:
+                expected = np.array([[1.5, 2.0], [3.0, -4.25]])
+        if not same_bits(points, expected):
+            print_red(f"failure: read {text!r} as {np.asarray(points).tolist()}")
+            success = False
+
+    # Ragged and malformed rows are rejected, by the module and by the CLI
+    malformed = (
+        "1,2\n3\n",
+        "1,2\n3,4,5\n",
+        "1,,2\n",
+        "1,2,\n",
+        "abc,1\n",
+        "1,2\n3;4\n",
+        "1 2\n",
+        "",
+    )
+    for text in malformed:
+        with make_text_file(text) as tmpfile:
+            try:
+                symnmf.read(tmpfile.name)
+                print_red(f"failure: the module accepted {text!r}")
+                success = False
+            except ValueError:
+                pass
+            result, _ = execute_c_program("sym", tmpfile.name)
+        if result.returncode == 0 or result.stdout != "An Error Has Occurred\n":
+            print_red(f"failure: the CLI accepted {text!r}")
+            success = False
+
+    return success
+
+
+def npy_bytes(array: np.ndarray) -> bytes:
+    buf = io.BytesIO()
+    np.save(buf, array)
+    return buf.getvalue()
+
+
+def raw_bytes(array: np.ndarray) -> bytes:
+    rows, cols = array.shape
+    header = b"SYMNMFLE" + int(rows).to_bytes(4, "little")
+    header += int(cols).to_bytes(4, "little")
+    return header + array.astype("<f8").tobytes()
+
+
+def test_binary_input() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData()
+    k = int(np.random.default_rng().integers(2, 11))
+    binaries = {
+        "npy": npy_bytes(test_data.X),
+        "raw": raw_bytes(test_data.X),
+        "npy-1d": npy_bytes(test_data.X[:, 0]),
+    }
+
+    text = make_stub_file(test_data.X)
+    text_1d = make_stub_file(test_data.X[:, :1])
+    with text, text_1d:
+        # Parsed text owns its block and stays writable
+        parsed = symnmf.read(text.name)
+        parsed[0, 0] = 5.0
+        if parsed[0, 0] != 5.0:
+            print_red("failure: a write to the text input was lost")
+            success = False
+
+        for fmt, data in binaries.items():
+            reference = text_1d.name if fmt == "npy-1d" else text.name
+            suffix = ".npy" if fmt.startswith("npy") else ".bin"
+            with make_binary_file(data, suffix) as binary:
+                # The mapped file is viewed in place, with unpadded rows
+                points = np.asarray(symnmf.read(binary.name))
+                if points.flags.owndata or points.strides != (8 * points.shape[1], 8):
+                    print_red(f"failure: {fmt} input was copied rather than viewed")
+                    success = False
+                if not same_bits(points, symnmf.read(reference)):
+                    print_red(f"failure: {fmt} input read other points than the text")
+                    success = False
+
+                # The view is read-only: writing to it raises rather than faulting on the mapping
+                try:
+                    points[0, 0] = 5.0
+                    print_red(f"failure: the {fmt} view accepted a write")
+                    success = False
+                except ValueError:
+                    pass
+                if not same_bits(points, symnmf.read(reference)):
+                    print_red(f"failure: a write to the {fmt} view changed it")
+                    success = False
+
+                # Every result is identical to the text input's, by the CLI and the module
+                for goal in ("sym", "ddg", "norm"):
+                    expected, _ = execute_c_program(goal, reference)
+                    result, _ = execute_c_program(goal, binary.name)
+                    if result.returncode != 0 or result.stdout != expected.stdout:
+                        print_red(f"failure: CLI {goal} of {fmt} input differs")
+                        success = False
+                    module_goal = getattr(symnmf, goal)
+                    if not same_bits(module_goal(binary.name), module_goal(reference)):
+                        print_red(f"failure: module {goal} of {fmt} input differs")
+                        success = False
+                if not same_bits(symnmf.fit(binary.name, k), symnmf.fit(reference, k)):
+                    print_red(f"failure: module fit of {fmt} input differs")
+                    success = False
+
+    # Files of another dtype, order or size than their header promises are rejected
+    X = test_data.X
+    rejected = {
+        "float32": npy_bytes(X.astype(np.float32)),
+        "big-endian": npy_bytes(X.astype(">f8")),
+        "fortran_order": npy_bytes(np.asfortranarray(X)),
+        "3-D": npy_bytes(X.reshape(1, *X.shape)),
+        "truncated npy": npy_bytes(X)[:-8],
+        "truncated raw": raw_bytes(X)[:-8],
+        "raw header only": raw_bytes(X)[:16],
+    }
+    for name, data in rejected.items():
+        with make_binary_file(data) as binary:
+            try:
+                symnmf.read(binary.name)
+                print_red(f"failure: the module accepted a {name} file")
+                success = False
+            except ValueError:
+                pass
+            result, _ = execute_c_program("sym", binary.name)
+        if result.returncode == 0 or result.stdout != "An Error Has Occurred\n":
+            print_red(f"failure: the CLI accepted a {name} file")
+            success = False
+
+    return success
+
+
+def test_fit_batch() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData(dedup=True)
+    X, n = test_data.X, test_data.n
+    runs = [(k, seed) for k in range(2, 6) for seed in (1234, 7, 2**32 - 1)]
+
+    # Every H of the batch is the H of a separate fit, for each format of W
+    formats = (("dense", {}), ("packed", {"packed": True}), ("knn", {"knn": 10}))
+    for name, kwargs in formats:
+        results = symnmf.fit_batch(X, runs, **kwargs)
+        if len(results) != len(runs):
+            print_red(f"failure: {name} batch returned {len(results)} runs")
+            success = False
+            continue
+        for (k, seed), (H, objective) in zip(runs, results):
+            if not same_bits(H, symnmf.fit(X, k, seed=seed, **kwargs)):
+                print_red(f"failure: {name} batch H of k={k}, seed={seed} differs")
+                success = False
+
+        # ||W - H H^T||_F^2 against the dense W
+        if name == "dense":
+            W = np.asarray(symnmf.norm(X))
+            for (k, seed), (H, objective) in zip(runs, results):
+                expected = np.linalg.norm(W - H @ H.T) ** 2
+                if abs(objective - expected) > 1e-9 * expected:
+                    print_red(f"failure: objective {objective}, expected {expected}")
+                    success = False
+
+    # A k outside [1, n) fails the whole batch
+    for bad in ((n, 1234), (n + 5, 1), (0, 1)):
+        try:
+            symnmf.fit_batch(X, [(2, 1234), bad])
+            print_red(f"failure: fit_batch accepted the run {bad}")
+            success = False
+        except ValueError:
+            pass
+
+    return success
+
+
+def test_incremental() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData(dedup=True)
+    X, n = test_data.X, test_data.n
+    k = int(np.random.default_rng().integers(2, min(11, n // 4)))
+    m = n // 8
+    start = n - 3 * m
+
+    # The initial fit is fit's
+    state, H = symnmf.fit_incremental(X[:start], k)
+    if not np.allclose(H, symnmf.fit(X[:start], k), rtol=0, atol=1e-12):
+        print_red("failure: fit_incremental H differs from fit")
+        success = False
+
+    # After every append, W and the degrees are those of a refit of all the points
+    for end in (start + m, start + 2 * m, n):
+        H = symnmf.append_points(state, X[end - m : end])
+        W, D = symnmf.state_affinity(state)
+        if H.shape != (end, k):
+            print_red(f"failure: H after an append has shape {H.shape}")
+            success = False
+        if not np.allclose(W, symnmf.norm(X[:end]), rtol=1e-12, atol=1e-15):
+            print_red(f"failure: W after appending up to {end} points differs from norm")
+            success = False
+        if not np.allclose(D, symnmf.ddg(X[:end]), rtol=1e-12, atol=0):
+            print_red(f"failure: D after appending up to {end} points differs from ddg")
+            success = False
+
+    # A failed append leaves the state as it was
+    W, D = symnmf.state_affinity(state)
+    for bad in (np.ones((3, X.shape[1] + 1)), np.ones((3, X.shape[1] - 1))):
+        try:
+            symnmf.append_points(state, bad)
+            print_red(f"failure: append_points accepted {bad.shape[1]}-d points")
+            success = False
+        except ValueError:
+            pass
+    W_after, D_after = symnmf.state_affinity(state)
+    if not same_bits(W, W_after) or not same_bits(D, D_after):
+        print_red("failure: a failed append changed the state")
+        success = False
+
+    # Concurrent appends to one state: each either lands or is turned away as busy,
+    # including while the other is still reading its file with the GIL released
+    rng = np.random.default_rng()
+    for _ in range(10):
+        state, _ = symnmf.fit_incremental(rng.random((300, 3)), 2)
+        files = [make_binary_file(npy_bytes(rng.random((400, 3))), ".npy") for _ in range(2)]
+        outcomes = []
+
+        def append(name):
+            try:
+                symnmf.append_points(state, name)
+                outcomes.append("ok")
+            except RuntimeError:
+                outcomes.append("busy")
+
+        threads = [threading.Thread(target=append, args=(file.name,)) for file in files]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for file in files:
+            file.close()
+
+        W, _ = symnmf.state_affinity(state)
+        if len(W) != 300 + 400 * outcomes.count("ok"):
+            print_red(f"failure: concurrent appends {outcomes} left {len(W)} points")
+            success = False
+            break
+
+    # A k outside [1, n) is rejected up front
+    for bad in (start, start + 1, 0):
+        try:
+            symnmf.fit_incremental(X[:start], bad)
+            print_red(f"failure: fit_incremental accepted k={bad}")
+            success = False
+        except ValueError:
+            pass
+
+    return success
+
+
+def test_engines() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData(dedup=True)
+    k = int(np.random.default_rng().integers(2, 11))
+    W = np.asarray(symnmf.norm(test_data.X))
+
+    # Every engine stops short of MAX_ITER at an objective no worse than MU's
+    objectives = {}
+    with make_stub_file(test_data.X) as tmpfile:
+        for method in ("mu", "nesterov", "hals", "anls"):
+            H, stats = symnmf.fit(test_data.X, k, method=method, stats=True)
+            objectives[method] = np.linalg.norm(W - H @ H.T) ** 2
+            if stats["iterations"] >= 300:
+                print_yellow(f"warning: {method} ran all 300 iterations")
+            if objectives[method] > objectives["mu"] * (1 + 1e-4):
+                print_red(
+                    f"failure: {method} objective {objectives[method]:.6f} "
+                    f"is worse than mu's {objectives['mu']:.6f}"
+                )
+                success = False
+
+            # The CLI's --method runs the same engine on the same (rounded) points
+            args = ["./symnmf", f"--k={k}", f"--method={method}", "symnmf", tmpfile.name]
+            result = subprocess.run(args, capture_output=True, text=True)
+            if not verify_output(result.stdout, H, f"method={method}"):
+                success = False
+
+    # An unknown engine is rejected
+    try:
+        symnmf.fit(test_data.X, k, method="newton")
+        print_red("failure: fit accepted method='newton'")
+        success = False
+    except ValueError:
+        pass
+
+    return success
+
+
+def csr_to_dense(csr, n: int) -> tuple[np.ndarray, np.ndarray]:
+    values, col_idx, row_ptr = csr
+    values = np.asarray(values, dtype=np.float64)
+    col_idx = np.asarray(col_idx, dtype=np.int64)
+    row_ptr = np.asarray(row_ptr, dtype=np.int64)
+    dense = np.zeros((n, n))
+    pattern = np.zeros((n, n), dtype=bool)
+    rows = np.repeat(np.arange(n), np.diff(row_ptr))
+    dense[rows, col_idx] = values
+    pattern[rows, col_idx] = True
+    return dense, pattern
+
+
+def test_sparse_graphs() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    rng = np.random.default_rng()
+    test_data = TestData(dedup=True)
+    X, n, d = test_data.X, test_data.n, test_data.dim
+    A = np.asarray(symnmf.sym(X.tolist(), n, d))
+    knn = int(rng.integers(1, 16))
+    threshold = float(rng.uniform(0.05, 0.5))
+
+    # Each point's knn nearest others, symmetrised by union; ranked by distance,
+    # since far affinities underflow to ties at zero
+    dist = ((X[:, None, :] - X[None, :, :]) ** 2).sum(axis=2)
+    np.fill_diagonal(dist, np.inf)
+    nearest = np.argsort(dist, axis=1)[:, :knn]
+    knn_mask = np.zeros((n, n), dtype=bool)
+    knn_mask[np.arange(n)[:, None], nearest] = True
+    knn_mask |= knn_mask.T
+    threshold_mask = (A >= threshold) & ~np.eye(n, dtype=bool)
+
+    # The CSR graphs keep the dense A on their pattern, with degrees and W formed from it
+    graphs = (
+        (f"knn={knn}", {"knn": knn}, knn_mask),
+        (f"threshold={threshold:.3f}", {"threshold": threshold}, threshold_mask),
+        ("both", {"knn": knn, "threshold": threshold}, knn_mask & threshold_mask),
+    )
+    for name, kwargs, mask in graphs:
+        expected_A = np.where(mask, A, 0.0)
+        degrees = expected_A.sum(axis=1)
+        inv_sqrt = np.where(degrees > 0, 1 / np.sqrt(np.maximum(degrees, 1e-300)), 0.0)
+        expected_W = inv_sqrt[:, None] * expected_A * inv_sqrt[None, :]
+
+        sparse_A, pattern = csr_to_dense(symnmf.sym(X.tolist(), n, d, **kwargs), n)
+        if not np.array_equal(pattern, mask):
+            print_red(
+                f"failure: {name} graph keeps {np.count_nonzero(pattern)} entries, "
+                f"expected {np.count_nonzero(mask)}"
+            )
+            success = False
+            continue
+        if not np.allclose(sparse_A, expected_A, rtol=1e-12, atol=1e-15):
+            print_red(f"failure: {name} sym values differ from the dense A")
+            success = False
+        if not np.allclose(np.diag(symnmf.ddg(X.tolist(), n, d, **kwargs)), degrees, rtol=1e-12, atol=0):
+            print_red(f"failure: {name} ddg differs from the row sums of the graph")
+            success = False
+        sparse_W = csr_to_dense(symnmf.norm(X.tolist(), n, d, **kwargs), n)[0]
+        if not np.allclose(sparse_W, expected_W, rtol=1e-12, atol=1e-15):
+            print_red(f"failure: {name} norm differs from the normalized graph")
+            success = False
+
+    return success
+
+
+def test_threads() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    X = np.random.default_rng().random((1000, 3))
+    expected = np.asarray(symnmf.sym(X))
+
+    # A child forked after a threaded call starts its own pool rather than waiting on the parent's
+    if not same_bits(symnmf.sym(X, threads=4), expected):
+        print_red("failure: threaded sym differs from the single-threaded one")
+        success = False
+    pid = os.fork()
+    if pid == 0:
+        try:
+            os._exit(0 if same_bits(symnmf.sym(X, threads=4), expected) else 1)
+        finally:
+            os._exit(2)
+    deadline = time.monotonic() + 60
+    while True:
+        done, status = os.waitpid(pid, os.WNOHANG)
+        if done:
+            if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+                print_red("failure: threaded sym in a forked child failed")
+                success = False
+            break
+        if time.monotonic() > deadline:
+            os.kill(pid, signal.SIGKILL)
+            os.waitpid(pid, 0)
+            print_red("failure: threaded sym in a forked child hung")
+            success = False
+            break
+        time.sleep(0.05)
+
+    # SYMNMF_THREADS outside what --threads accepts falls back to one thread
+    with make_stub_file(X[:300]) as points:
+        baseline = subprocess.run(["./symnmf", "sym", points.name], capture_output=True, text=True)
+        for value in ("2000", "2000000000", "4abc", "", "-3", "0"):
+            env = dict(os.environ, SYMNMF_THREADS=value)
+            result = subprocess.run(["./symnmf", "sym", points.name], capture_output=True, text=True, env=env)
+            if result.returncode != 0 or result.stdout != baseline.stdout:
+                print_red(f"failure: SYMNMF_THREADS={value!r} was not treated as one thread")
+                success = False
+        result = subprocess.run(["./symnmf", "--threads=2000", "sym", points.name], capture_output=True, text=True)
+        if result.returncode == 0:
+            print_red("failure: the CLI accepted --threads=2000")
+            success = False
+
+    return success
+
+
+def test_scratch() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData(dedup=True)
+    k = int(np.random.default_rng().integers(2, 11))
+    scratch = tempfile.gettempdir()
+
+    # Tiles in a scratch file give the in-memory packed W's H, byte for byte
+    with make_stub_file(test_data.X) as tmpfile:
+        packed = subprocess.run(
+            ["./symnmf", f"--k={k}", "--packed", "symnmf", tmpfile.name], capture_output=True, text=True
+        )
+        mapped = subprocess.run(
+            ["./symnmf", f"--k={k}", f"--scratch={scratch}", "symnmf", tmpfile.name], capture_output=True, text=True
+        )
+        if mapped.returncode != 0 or mapped.stdout != packed.stdout:
+            print_red("failure: CLI --scratch symnmf differs from --packed")
+            success = False
+        if not same_bits(symnmf.fit(test_data.X, k, scratch=scratch), symnmf.fit(test_data.X, k, packed=True)):
+            print_red("failure: fit with scratch differs from packed=True")
+            success = False
+
+        # A directory the file cannot be made in fails cleanly, naming it
+        missing = os.path.join(scratch, "symnmf-missing", "dir")
+        result = subprocess.run(
+            ["./symnmf", f"--k={k}", f"--scratch={missing}", "symnmf", tmpfile.name], capture_output=True, text=True
+        )
+        if result.returncode == 0 or result.stdout != "An Error Has Occurred\n":
+            print_red("failure: the CLI accepted a missing scratch directory")
+            success = False
+    for call in (
+        lambda: symnmf.fit(test_data.X, k, scratch=missing),
+        lambda: symnmf.fit_batch(test_data.X, [(k, 1234)], scratch=missing),
+    ):
+        try:
+            call()
+            print_red("failure: the module accepted a missing scratch directory")
+            success = False
+        except OSError as e:
+            if e.filename != missing:
+                print_red(f"failure: the scratch error names {e.filename!r}")
+                success = False
+
+    return success
+
+
+def test_float32() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    rng = np.random.default_rng()
+    n, d, k = int(rng.integers(50, 801)), int(rng.integers(2, 11)), int(rng.integers(2, 11))
+    # Unit-scale points: float32 distances then lose little to cancellation, and no degree underflows
+    X = rng.standard_normal((n, d))
+
+    # sym, ddg and norm within 1e-5 of the largest entry of the double result (about 1e-6 is seen)
+    for goal in ("sym", "ddg", "norm"):
+        expected = np.asarray(getattr(symnmf, goal)(X))
+        result = np.asarray(getattr(symnmf, goal)(X, float32=True))
+        error = np.max(np.abs(result - expected)) / np.max(np.abs(expected))
+        if result.shape != expected.shape or not error < 1e-5:
+            print_red(f"failure: float32 {goal} is {error:.2e} from double")
+            success = False
+
+    # H of symnmf and fit within 1e-4 of the double H in relative Frobenius norm (a few 1e-6 are seen)
+    W = np.asarray(symnmf.norm(X))
+    H0 = rng.uniform(0, 2 * np.sqrt(W.mean() / k), size=(n, k))
+    results = (
+        ("symnmf", symnmf.symnmf(W, H0, n, k, float32=True), symnmf.symnmf(W, H0, n, k)),
+        ("fit", symnmf.fit(X, k, float32=True), symnmf.fit(X, k)),
+    )
+    for name, H, expected in results:
+        error = np.linalg.norm(np.asarray(H) - expected) / np.linalg.norm(expected)
+        if not error < 1e-4:
+            print_red(f"failure: float32 {name} H is {error:.2e} from double")
+            success = False
+
+    # The CLI's --float32 prints the same numbers, up to the last printed digit
+    with make_stub_file(X) as tmpfile:
+        for goal in ("sym", "ddg", "norm", "symnmf"):
+            args = [f"--k={k}", goal, tmpfile.name] if goal == "symnmf" else [goal, tmpfile.name]
+            double = subprocess.run(["./symnmf"] + args, capture_output=True, text=True)
+            single = subprocess.run(["./symnmf", "--float32"] + args, capture_output=True, text=True)
+            if single.returncode != 0:
+                print_red(f"failure: CLI --float32 {goal} failed")
+                success = False
+                continue
+            expected = np.loadtxt(io.StringIO(double.stdout), delimiter=",", ndmin=2)
+            result = np.loadtxt(io.StringIO(single.stdout), delimiter=",", ndmin=2)
+            if result.shape != expected.shape or np.max(np.abs(result - expected)) > 1e-4 + 1e-5:
+                print_red(f"failure: CLI --float32 {goal} differs from double")
+                success = False
+
+    return success
+
+
+def bf16_bits(x: np.ndarray) -> np.ndarray:
+    # Nearest bfloat16, ties to even, rounded once from the double; inputs below FLT_MIN flush to zero
+    x = np.asarray(x, dtype=np.float64)
+    sign = np.where(np.signbit(x), 0x8000, 0).astype(np.uint16)
+    m, e = np.frexp(np.abs(x))
+    value = np.ldexp(np.rint(m * 256), e - 8)
+    with np.errstate(over="ignore"):
+        bits = (value.astype(np.float32).view(np.uint32) >> 16).astype(np.uint16)
+    bits = np.where(np.abs(x) < np.finfo(np.float32).tiny, 0, bits).astype(np.uint16)
+    return bits | sign
+
+
+def test_half() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    rng = np.random.default_rng()
+
+    # fp16 rounds as numpy's float16 does: every magnitude from subnormals past the largest
+    # finite value, exact midpoints between neighbours, and signed zeros
+    halves = rng.integers(0, 0x7C00, size=20000, dtype=np.uint16).view(np.float16).astype(np.float64)
+    neighbours = (halves.astype(np.float16).view(np.uint16) + 1).view(np.float16).astype(np.float64)
+    values = np.concatenate(
+        [
+            rng.standard_normal(20000) * 2.0 ** rng.integers(-30, 18, size=20000),
+            (halves + neighbours) / 2,
+            [0.0, -0.0, 65504.0, 65519.99, 65520.0, -65520.0, 2.0**-25, 2.0**-24, 1e-9, 1e300],
+        ]
+    ).reshape(-1, 2)
+    with np.errstate(over="ignore"):
+        expected = values.astype(np.float16).view(np.uint16)
+    got = np.asarray(symnmf.to_half(values))
+    if not np.array_equal(got, expected):
+        bad = np.argwhere(got != expected)[0]
+        print_red(
+            f"failure: fp16 of {values[tuple(bad)]!r} is {got[tuple(bad)]:#06x}, "
+            f"expected {expected[tuple(bad)]:#06x}"
+        )
+        success = False
+
+    # bf16 likewise, against a numpy rounding of the double to 8 significant bits
+    bf16 = rng.integers(0x0080, 0x7F7F, size=20000, dtype=np.uint32)
+    lower = (bf16 << 16).view(np.float32).astype(np.float64)
+    upper = ((bf16 + 1) << 16).view(np.float32).astype(np.float64)
+    values = np.concatenate(
+        [
+            rng.standard_normal(20000) * 2.0 ** rng.integers(-130, 120, size=20000),
+            (lower + upper) / 2,
+            [0.0, -0.0, 1e-39, -1e-39, 1.0, 1.0 + 2.0**-8, 1.0 + 3 * 2.0**-8],
+        ]
+    )
+    values = np.where(rng.integers(0, 2, size=len(values)) == 1, -values, values).reshape(-1, 1)
+    expected = bf16_bits(values)
+    got = np.asarray(symnmf.to_half(values, half="bf16"))
+    if not np.array_equal(got, expected):
+        bad = np.argwhere(got != expected)[0]
+        print_red(
+            f"failure: bf16 of {values[tuple(bad)]!r} is {got[tuple(bad)]:#06x}, "
+            f"expected {expected[tuple(bad)]:#06x}"
+        )
+        success = False
+
+    # A 16-bit W moves H in proportion to its rounding: a relative Frobenius error within twenty
+    # units of it, 2^-11 for fp16 and 2^-8 for bf16 (about five are seen), by symnmf and by fit,
+    # in both precisions
+    test_data = TestData(dedup=True)
+    X, n = test_data.X, test_data.n
+    k = int(rng.integers(2, 11))
+    W = np.asarray(symnmf.norm(X))
+    H0 = rng.uniform(0, 2 * np.sqrt(W.mean() / k), size=(n, k))
+    reference = np.asarray(symnmf.symnmf(W, H0, n, k))
+    reference_fit = symnmf.fit(X, k)
+    for half, tolerance in (("fp16", 20 * 2.0**-11), ("bf16", 20 * 2.0**-8)):
+        for float32 in (False, True):
+            results = (
+                ("symnmf", symnmf.symnmf(W, H0, n, k, half=half, float32=float32), reference),
+                ("fit", symnmf.fit(X, k, half=half, float32=float32), reference_fit),
+            )
+            for name, H, expected_H in results:
+                error = np.linalg.norm(np.asarray(H) - expected_H) / np.linalg.norm(expected_H)
+                if not error < tolerance:
+                    print_red(
+                        f"failure: {name} half={half} float32={float32} is {error:.2e} from the double H"
+                    )
+                    success = False
+
+    return success
+
+
+def fixed4_text(matrix: np.ndarray) -> str:
+    # The CLI's text output, as printf("%.4f") gives it
+    return "".join(",".join("%.4f" % v for v in row) + "\n" for row in matrix)
+
+
+def test_writer() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    rng = np.random.default_rng()
+
+    # Exact ties (odd multiples of 1/32 end in 5 at the fifth decimal), the nearest doubles to
+    # (k + 1/2) / 10^4, signed zeros, and magnitudes past 10^5 up to 10^300
+    ties = (2 * rng.integers(0, 16 * 10**5, 200) + 1) / 32
+    near = (rng.integers(0, 10**5, 200) + 0.5) / 1e4
+    values = np.concatenate([
+        ties, -ties, near, -near,
+        [0.0, -0.0, -0.00004, -0.00005, 0.00005, 0.00015, 2.5, -2.5, 99999.99995, 1e5, -1e5, 1e300, -1e300],
+        rng.uniform(-1e5, 1e5, 200), rng.uniform(-1, 1, 200), 10.0 ** rng.uniform(5, 300, 50),
+    ])
+    values = np.resize(values, (len(values) // 7 + 1) * 7).reshape(-1, 7)
+    expected = fixed4_text(values)
+
+    # Written in a child process, whose standard output the C writer reaches through file descriptor 1
+    with make_binary_file(npy_bytes(values), ".npy") as tmpfile:
+        result = subprocess.run(
+            [sys.executable, "-c", f"import mysymnmf, numpy; mysymnmf.write(numpy.load({tmpfile.name!r}))"],
+            capture_output=True, text=True,
+        )
+    if result.returncode != 0 or result.stdout != expected:
+        print_red("failure: the text writer differs from printf(\"%.4f\")")
+        for got, want in zip(result.stdout.splitlines(), expected.splitlines()):
+            if got != want:
+                print_red(f"{got} != {want}", "  ")
+                break
+        success = False
+
+    # .npy output round-trips through np.load: the header's shape and dtype and every bit of the data
+    test_data = TestData()
+    k = int(rng.integers(2, 11))
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = os.path.join(tmpdir, "out.npy")
+        if symnmf.write(values, output=path) != values.shape or not same_bits(np.load(path), values):
+            print_red("failure: write(output=) does not round-trip through np.load")
+            success = False
+        with make_stub_file(test_data.X) as tmpfile:
+            for goal in ("sym", "ddg", "norm", "symnmf"):
+                extra = [f"--k={k}"] if goal == "symnmf" else []
+                text = subprocess.run(
+                    ["./symnmf", *extra, goal, tmpfile.name], capture_output=True, text=True
+                ).stdout
+                cli = subprocess.run(["./symnmf", *extra, f"--output={path}", goal, tmpfile.name])
+                loaded = np.load(path) if cli.returncode == 0 else None
+                if loaded is None or loaded.dtype != np.float64 or fixed4_text(loaded) != text:
+                    print_red(f"failure: --output={goal} .npy does not load to the printed {goal}")
+                    success = False
+
+                expected = symnmf.fit(test_data.X, k) if goal == "symnmf" else getattr(symnmf, goal)(test_data.X)
+                shape = (
+                    symnmf.fit(test_data.X, k, output=path) if goal == "symnmf"
+                    else getattr(symnmf, goal)(test_data.X, output=path)
+                )
+                if tuple(shape) != np.shape(expected) or not same_bits(np.load(path), np.asarray(expected)):
+                    print_red(f"failure: {goal}(output=) does not round-trip through np.load")
+                    success = False
+
+    return success
+
+
+STATS_KEYS = {
+    "seconds", "affinity_bytes", "workspace_bytes", "peak_rss_bytes", "iterations",
+    "update_seconds", "residual", "objective",
+}
+STAGE_NAMES = {"read", "sym", "ddg", "norm", "init", "solve", "write"}
+
+
+def is_number(value: Any) -> bool:
+    # A JSON number; %.17g prints whole values such as 0 without a point
+    return isinstance(value, (int, float)) and not isinstance(value, bool) and bool(np.isfinite(value))
+
+
+def stats_errors(stats: Any, solved: bool) -> list[str]:
+    # What is wrong with one stats record, against the keys and shapes stats_print documents
+    if not isinstance(stats, dict) or set(stats) != STATS_KEYS:
+        return [f"keys {sorted(stats) if isinstance(stats, dict) else stats!r}"]
+    errors = []
+    if set(stats["seconds"]) != STAGE_NAMES or any(
+        not is_number(t) or t < 0 for t in stats["seconds"].values()
+    ):
+        errors.append(f"seconds {stats['seconds']}")
+    for key in ("affinity_bytes", "workspace_bytes", "peak_rss_bytes", "iterations"):
+        if not isinstance(stats[key], int) or stats[key] < 0:
+            errors.append(f"{key} {stats[key]!r}")
+    iterations = stats["iterations"] if isinstance(stats["iterations"], int) else -1
+    if solved != (iterations > 0):
+        errors.append(f"{iterations} iterations")
+    for key in ("update_seconds", "residual", "objective"):
+        if not isinstance(stats[key], list) or len(stats[key]) != iterations or any(
+            not is_number(v) or v < 0 for v in stats[key]
+        ):
+            errors.append(f"{key} of {len(stats[key]) if isinstance(stats[key], list) else stats[key]!r} entries")
+    return errors
+
+
+def test_stats() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    test_data = TestData(dedup=True)
+    n = len(test_data.X)
+    k = int(np.random.default_rng().integers(2, 11))
+
+    # --stats and SYMNMF_STATS=1 print one valid JSON object on stderr and leave stdout alone
+    with make_stub_file(test_data.X) as tmpfile:
+        for goal, extra in (
+            ("sym", []), ("ddg", []), ("norm", []), ("norm", ["--packed"]), ("norm", ["--float32"]),
+            ("symnmf", [f"--k={k}"]), ("symnmf", [f"--k={k}", "--packed"]), ("symnmf", [f"--k={k}", "--float32"]),
+            ("symnmf", [f"--k={k}", "--method=nesterov"]), ("symnmf", [f"--k={k}", "--method=hals"]),
+        ):
+            plain = subprocess.run(["./symnmf", *extra, goal, tmpfile.name], capture_output=True, text=True)
+            for flags, env in (
+                (["--stats"], None), ([], {**os.environ, "SYMNMF_STATS": "1"}),
+            ):
+                name = " ".join(extra + flags + [goal]) + (" with SYMNMF_STATS=1" if env else "")
+                result = subprocess.run(
+                    ["./symnmf", *extra, *flags, goal, tmpfile.name], capture_output=True, text=True, env=env
+                )
+                if result.returncode != 0 or result.stdout != plain.stdout:
+                    print_red(f"failure: {name} changed the result")
+                    success = False
+                    continue
+                try:
+                    errors = stats_errors(json.loads(result.stderr), goal == "symnmf")
+                except json.JSONDecodeError as e:
+                    errors = [f"invalid JSON ({e}): {result.stderr[:200]!r}"]
+                if result.stderr.count("\n") != 1:
+                    errors.append("not one line")
+                for error in errors:
+                    print_red(f"failure: {name} stats: {error}")
+                    success = False
+
+        result = subprocess.run(
+            ["./symnmf", f"--k={k}", "symnmf", tmpfile.name], capture_output=True, text=True,
+            env={**os.environ, "SYMNMF_STATS": "0"},
+        )
+        if result.stderr:
+            print_red("failure: SYMNMF_STATS=0 printed stats")
+            success = False
+
+    # stats=True gives the same record, shaped as the JSON, from fit and symnmf
+    W = np.asarray(symnmf.norm(test_data.X))
+    H0 = initialize_H(W, k, set_seed=True)
+    for name, call in (
+        ("fit", lambda: symnmf.fit(test_data.X, k, stats=True)),
+        ("fit(packed=True)", lambda: symnmf.fit(test_data.X, k, packed=True, stats=True)),
+        ("fit(float32=True)", lambda: symnmf.fit(test_data.X, k, float32=True, stats=True)),
+        ("symnmf", lambda: symnmf.symnmf(W, H0, n, k, stats=True)),
+    ):
+        result = call()
+        if not isinstance(result, tuple) or len(result) != 2:
+            print_red(f"failure: {name} with stats=True gave {type(result).__name__}, not (H, stats)")
+            success = False
+            continue
+        stats = json.loads(json.dumps(result[1]))
+        for error in stats_errors(stats, True):
+            print_red(f"failure: {name} stats: {error}")
+            success = False
+
+    return success
+
+
+def ticks_during(call) -> tuple[int, float]:
+    # Wakeups of a Python thread sleeping 1 ms at a time while call runs, and the seconds it took
+    ticks, done = [0], threading.Event()
+
+    def ticker():
+        while not done.is_set():
+            ticks[0] += 1
+            time.sleep(0.001)
+
+    thread = threading.Thread(target=ticker)
+    thread.start()
+    time.sleep(0.01)
+    start, before = time.monotonic(), ticks[0]
+    try:
+        call()
+    finally:
+        elapsed, during = time.monotonic() - start, ticks[0] - before
+        done.set()
+        thread.join()
+    return during, elapsed
+
+
+def test_gil() -> bool:
+    import mysymnmf as symnmf
+
+    success = True
+    rng = np.random.default_rng()
+    X = rng.random((3000, 4))
+    k = 8
+    W = np.asarray(symnmf.norm(X))
+    H0 = initialize_H(W, k, set_seed=True)
+
+    # A call holding the GIL throughout leaves the ticker a wakeup or two (sorted() of 2e6 floats
+    # gives 2 in over a second); one that releases it lets it run every millisecond or so
+    for name, call in (
+        ("sym", lambda: symnmf.sym(X, threads=1)),
+        ("symnmf", lambda: symnmf.symnmf(W, H0, len(X), k, threads=1)),
+        ("fit", lambda: symnmf.fit(X, k, threads=1)),
+        ("fit_batch", lambda: symnmf.fit_batch(X, [(k, 1234), (k, 4321)], threads=1)),
+    ):
+        ticks, elapsed = ticks_during(call)
+        if elapsed < 0.02:
+            print_yellow(f"warning: {name} took {elapsed * 1000:.0f} ms, too short to check the GIL")
+        elif ticks < 5:
+            print_red(f"failure: a Python thread woke {ticks} times during {elapsed:.2f} s of {name}")
+            success = False
+
+    # Two fits overlapping in threads each give the H they give alone
+    expected = [symnmf.fit(X, k, seed=seed, threads=1) for seed in (1, 2)]
+    results = [None, None]
+
+    def run(i):
+        results[i] = symnmf.fit(X, k, seed=i + 1, threads=1)
+
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(2)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    if not all(r is not None and same_bits(r, e) for r, e in zip(results, expected)):
+        print_red("failure: concurrent fits differ from the same fits run alone")
+        success = False
+
+    return success
+
+
 def test_programs():
     rng = np.random.default_rng()
 
@@ -634,6 +1565,84 @@ if __name__ == "__main__":
     else:
         print_red("failure: no trial succeeded")
 
+    print("\n--------")
+    print("Testing the input reader")
+    print("--------")
+    if test_reader():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing .npy and raw input")
+    print("--------")
+    if test_binary_input():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing fit_batch")
+    print("--------")
+    if test_fit_batch():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing fit_incremental and append_points")
+    print("--------")
+    if test_incremental():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing the solver engines")
+    print("--------")
+    if test_engines():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing the kNN and threshold graphs")
+    print("--------")
+    if test_sparse_graphs():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing the worker pool")
+    print("--------")
+    if test_threads():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing out-of-core W")
+    print("--------")
+    if test_scratch():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing float32")
+    print("--------")
+    if test_float32():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing 16-bit W")
+    print("--------")
+    if test_half():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing the result writer")
+    print("--------")
+    if test_writer():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing instrumentation")
+    print("--------")
+    if test_stats():
+        print_green("success")
+
+    print("\n--------")
+    print("Testing GIL release")
+    print("--------")
+    if test_gil():
+        print_green("success")
+
     print("\n--------")
     print("Testing with valgrind")
     print("--------")
@@ -0,0 +1,213 @@
+#include "vmath.h"
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define VMATH_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * exp(x) = 2^k * exp(r) with k = round(x / ln 2) and |r| <= ln(2) / 2. The
+ * reduction uses a two-part ln 2 (fdlibm's split, exact for |k| < 2^20), and
+ * exp(r) is the degree 13 Taylor polynomial, whose truncation error is below
+ * 1e-17 on that interval.
+ */
+#define LOG2E 1.44269504088896338700e+00
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+
+/* Width of the widest SIMD kernel; tails are padded to it */
+#define VEXP_LANES 8
+
+/* Floats widened per vexp_f step; one sym tile row */
+#define VEXP_F_BLOCK 64
+
+typedef void (*vexp_fn)(double *x, int n);
+
+/*
+ * ============================================================================
+ * Kernels
+ * ============================================================================
+ */
+
+/* Portable fallback: the C library exp */
+static void vexp_generic(double *x, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        x[i] = exp(x[i] < VEXP_MIN ? VEXP_MIN : x[i] > VEXP_MAX ? VEXP_MAX : x[i]);
+    }
+}
+
+#ifdef VMATH_X86
+
+/* Horner step of the Taylor polynomial: p <- p * r + 1/i! */
+#define AVX2_TERM(c) p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(c))
+
+/* 2^k for integral k in [-1022, 1023], built in the exponent field */
+__attribute__((target("avx2,fma"))) static __m256d avx2_pow2(__m256d k) {
+    __m256d shifted;
+
+    /* Adding 2^52 + 2^51 leaves k + 1023 in the low mantissa bits */
+    shifted = _mm256_add_pd(k, _mm256_set1_pd(6755399441055744.0 + 1023.0));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(shifted), 52));
+}
+
+/* AVX2: four lanes; 2^k is applied in two halves so subnormal results stay exact */
+__attribute__((target("avx2,fma"))) static void vexp_avx2_block(double *x) {
+    __m256d v, k, k1, r, p;
+
+    v = _mm256_loadu_pd(x);
+    v = _mm256_max_pd(_mm256_min_pd(v, _mm256_set1_pd(VEXP_MAX)), _mm256_set1_pd(VEXP_MIN));
+    k = _mm256_round_pd(_mm256_mul_pd(v, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_HI), v);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_LO), r);
+
+    p = _mm256_set1_pd(1.0 / 6227020800.0);
+    AVX2_TERM(1.0 / 479001600.0);
+    AVX2_TERM(1.0 / 39916800.0);
+    AVX2_TERM(1.0 / 3628800.0);
+    AVX2_TERM(1.0 / 362880.0);
+    AVX2_TERM(1.0 / 40320.0);
+    AVX2_TERM(1.0 / 5040.0);
+    AVX2_TERM(1.0 / 720.0);
+    AVX2_TERM(1.0 / 120.0);
+    AVX2_TERM(1.0 / 24.0);
+    AVX2_TERM(1.0 / 6.0);
+    AVX2_TERM(1.0 / 2.0);
+    AVX2_TERM(1.0);
+    AVX2_TERM(1.0);
+
+    k1 = _mm256_floor_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)));
+    p = _mm256_mul_pd(p, avx2_pow2(k1));
+    p = _mm256_mul_pd(p, avx2_pow2(_mm256_sub_pd(k, k1)));
+    _mm256_storeu_pd(x, p);
+}
+
+__attribute__((target("avx2,fma"))) static void vexp_avx2(double *x, int n) {
+    double pad[VEXP_LANES];
+    int i, j;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        vexp_avx2_block(x + i);
+    }
+    if (i < n) {
+        for (j = 0; j < 4; j++) {
+            pad[j] = i + j < n ? x[i + j] : 0.0;
+        }
+        vexp_avx2_block(pad);
+        for (j = 0; i + j < n; j++) {
+            x[i + j] = pad[j];
+        }
+    }
+}
+
+#define AVX512_TERM(c) p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(c))
+
+/* AVX-512: eight lanes, scaled by 2^k with a single vscalefpd */
+__attribute__((target("avx512f"))) static void vexp_avx512_block(double *x) {
+    __m512d v, k, r, p;
+
+    v = _mm512_loadu_pd(x);
+    v = _mm512_max_pd(_mm512_min_pd(v, _mm512_set1_pd(VEXP_MAX)), _mm512_set1_pd(VEXP_MIN));
+    k = _mm512_roundscale_pd(_mm512_mul_pd(v, _mm512_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_HI), v);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_LO), r);
+
+    p = _mm512_set1_pd(1.0 / 6227020800.0);
+    AVX512_TERM(1.0 / 479001600.0);
+    AVX512_TERM(1.0 / 39916800.0);
+    AVX512_TERM(1.0 / 3628800.0);
+    AVX512_TERM(1.0 / 362880.0);
+    AVX512_TERM(1.0 / 40320.0);
+    AVX512_TERM(1.0 / 5040.0);
+    AVX512_TERM(1.0 / 720.0);
+    AVX512_TERM(1.0 / 120.0);
+    AVX512_TERM(1.0 / 24.0);
+    AVX512_TERM(1.0 / 6.0);
+    AVX512_TERM(1.0 / 2.0);
+    AVX512_TERM(1.0);
+    AVX512_TERM(1.0);
+
+    _mm512_storeu_pd(x, _mm512_scalef_pd(p, k));
+}
+
+__attribute__((target("avx512f"))) static void vexp_avx512(double *x, int n) {
+    double pad[VEXP_LANES];
+    int i, j;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        vexp_avx512_block(x + i);
+    }
+    if (i < n) {
+        for (j = 0; j < 8; j++) {
+            pad[j] = i + j < n ? x[i + j] : 0.0;
+        }
+        vexp_avx512_block(pad);
+        for (j = 0; i + j < n; j++) {
+            x[i + j] = pad[j];
+        }
+    }
+}
+
+#endif
+
+/*
+ * ============================================================================
+ * Kernel Selection
+ * ============================================================================
+ */
+
+static vexp_fn active_fn = NULL;
+static const char *active_name = NULL;
+
+static void vexp_select(void) {
+    active_fn = vexp_generic;
+    active_name = "generic";
+#ifdef VMATH_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        active_fn = vexp_avx512;
+        active_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        active_fn = vexp_avx2;
+        active_name = "avx2";
+    }
+#endif
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+void vexp(double *x, int n) {
+    if (active_fn == NULL)
+        vexp_select();
+    active_fn(x, n);
+}
+
+/* Results below FLT_MIN are flushed to zero: float subnormals slow every kernel that reads them */
+void vexp_f(float *x, int n) {
+    double wide[VEXP_F_BLOCK];
+    int i, j, len;
+
+    for (i = 0; i < n; i += VEXP_F_BLOCK) {
+        len = n - i < VEXP_F_BLOCK ? n - i : VEXP_F_BLOCK;
+        for (j = 0; j < len; j++) {
+            wide[j] = x[i + j];
+        }
+        vexp(wide, len);
+        for (j = 0; j < len; j++) {
+            x[i + j] = wide[j] < FLT_MIN ? 0.0f : (float)wide[j];
+        }
+    }
+}
+
+const char *vexp_kernel_name(void) {
+    if (active_fn == NULL)
+        vexp_select();
+    return active_name;
+}
@@ -0,0 +1,41 @@
+#ifndef VMATH_H
+#define VMATH_H
+
+/* Arguments below this give exp(x) == 0 in double precision */
+#define VEXP_MIN -746.0
+
+/* Arguments above this would overflow */
+#define VEXP_MAX 709.0
+
+/*
+ * ============================================================================
+ * Function Prototypes
+ * ============================================================================
+ */
+
+/**
+ * @brief Replaces every x[i] by exp(x[i]), several lanes at a time.
+ * The widest kernel the CPU supports is picked on first use, which is not
+ * thread-safe; call vexp_kernel_name first when workers will share it. The
+ * SIMD kernels are accurate to about one ulp, and the generic one calls the C library.
+ * Arguments are clamped to [VEXP_MIN, VEXP_MAX]; NaNs are not supported.
+ * @param x The array, overwritten with the results.
+ * @param n Number of elements.
+ */
+void vexp(double *x, int n);
+
+/**
+ * @brief Single-precision vexp: widens blocks of x, runs vexp, and rounds back.
+ * Results are within about one float ulp; those below FLT_MIN are flushed to zero.
+ * @param x The array, overwritten with the results.
+ * @param n Number of elements.
+ */
+void vexp_f(float *x, int n);
+
+/**
+ * @brief Returns the name of the active exp kernel ("generic", "avx2" or "avx512").
+ * @return The kernel name.
+ */
+const char *vexp_kernel_name(void);
+
+#endif
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "writer.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Magnitudes below this take the integer path: 10^4 times them stays under 2^30 */
+#define FIXED_LIMIT 1e5
+
+/* Distance from a rounding tie within which 10^4 * value, rounded, cannot decide the digit */
+#define TIE_MARGIN 1e-6
+
+/* Bytes of a .npy header, magic and length included; numpy aligns the data to 64 */
+#define NPY_HEADER 128
+
+struct out_writer {
+    char *buf;
+    size_t len;
+    int fd;
+    int binary;
+    int cols;
+    int col;
+    int error;
+};
+
+/*
+ * ============================================================================
+ * Buffer Handling
+ * ============================================================================
+ */
+
+/* Writes out the buffered bytes; a failure is kept and reported by writer_close */
+static void writer_flush(out_writer *w) {
+    size_t done;
+    ssize_t put;
+
+    for (done = 0; done < w->len && !w->error; done += (size_t)put) {
+        put = write(w->fd, w->buf + done, w->len - done);
+        if (put < 0)
+            w->error = 1;
+    }
+    w->len = 0;
+}
+
+static int host_little_endian(void) {
+    const double one = 1.0;
+
+    return ((const unsigned char *)&one)[sizeof(double) - 1] == 0x3f;
+}
+
+/* Header of a C-order .npy array of rows x cols little-endian float64, padded to NPY_HEADER bytes */
+static void npy_header(out_writer *w, int rows, int cols) {
+    char dict[NPY_HEADER];
+    int len;
+
+    len = sprintf(dict, "{'descr': '<f8', 'fortran_order': False, 'shape': (%d, %d), }", rows, cols);
+    memset(dict + len, ' ', NPY_HEADER - 10 - len);
+    dict[NPY_HEADER - 11] = '\n';
+
+    memcpy(w->buf, "\223NUMPY\1\0", 8);
+    w->buf[8] = (char)((NPY_HEADER - 10) & 0xff);
+    w->buf[9] = (char)((NPY_HEADER - 10) >> 8);
+    memcpy(w->buf + 10, dict, NPY_HEADER - 10);
+    w->len = NPY_HEADER;
+}
+
+/*
+ * ============================================================================
+ * Function Implementations
+ * ============================================================================
+ */
+
+out_writer *writer_open(const char *npy_path, int rows, int cols) {
+    out_writer *w;
+
+    w = malloc(sizeof(out_writer));
+    if (w == NULL)
+        return NULL;
+    w->buf = malloc(WRITE_BLOCK);
+    if (w->buf == NULL) {
+        free(w);
+        return NULL;
+    }
+    w->len = 0;
+    w->cols = cols;
+    w->col = 0;
+    w->error = 0;
+    w->binary = npy_path != NULL;
+
+    if (w->binary) {
+        w->fd = open(npy_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (w->fd < 0) {
+            free(w->buf);
+            free(w);
+            return NULL;
+        }
+        npy_header(w, rows, cols);
+    } else {
+        /* Anything printf left in the stdio buffer goes first */
+        fflush(stdout);
+        w->fd = STDOUT_FILENO;
+    }
+
+    return w;
+}
+
+void writer_value(out_writer *w, double value) {
+    unsigned char *dst;
+    size_t b;
+
+    if (w->len > WRITE_BLOCK - WRITE_VALUE_MAX - 1)
+        writer_flush(w);
+
+    if (w->binary) {
+        dst = (unsigned char *)w->buf + w->len;
+        memcpy(dst, &value, sizeof(double));
+        if (!host_little_endian()) {
+            for (b = 0; b < sizeof(double) / 2; b++) {
+                unsigned char byte = dst[b];
+                dst[b] = dst[sizeof(double) - 1 - b];
+                dst[sizeof(double) - 1 - b] = byte;
+            }
+        }
+        w->len += sizeof(double);
+        return;
+    }
+
+    w->len += format_fixed4(w->buf + w->len, value);
+    if (++w->col == w->cols) {
+        w->buf[w->len++] = '\n';
+        w->col = 0;
+    } else {
+        w->buf[w->len++] = ',';
+    }
+}
+
+int writer_close(out_writer *w) {
+    int error;
+
+    if (w == NULL)
+        return 0;
+
+    writer_flush(w);
+    error = w->error;
+    if (w->binary && close(w->fd) != 0)
+        error = 1;
+    free(w->buf);
+    free(w);
+    return error;
+}
+
+int format_fixed4(char *dst, double value) {
+    char digits[16];
+    double scaled, whole, frac;
+    unsigned long q, ip, fp;
+    int len, n, negative;
+
+    /* Also catches NaN */
+    if (!(value > -FIXED_LIMIT && value < FIXED_LIMIT))
+        return sprintf(dst, "%.4f", value);
+
+    negative = value < 0.0 || (value == 0.0 && 1.0 / value < 0.0);
+    scaled = (negative ? -value : value) * 10000.0;
+    whole = floor(scaled);
+    frac = scaled - whole;
+
+    /* The product is within half an ulp (< 2^-23 here) of the exact one, so only near-ties are in doubt */
+    if (fabs(frac - 0.5) < TIE_MARGIN)
+        return sprintf(dst, "%.4f", value);
+
+    q = (unsigned long)whole + (frac > 0.5);
+    ip = q / 10000;
+    fp = q % 10000;
+
+    len = 0;
+    if (negative)
+        dst[len++] = '-';
+    n = 0;
+    do {
+        digits[n++] = (char)('0' + ip % 10);
+        ip /= 10;
+    } while (ip > 0);
+    while (n > 0) {
+        dst[len++] = digits[--n];
+    }
+    dst[len++] = '.';
+    dst[len++] = (char)('0' + fp / 1000);
+    dst[len++] = (char)('0' + fp / 100 % 10);
+    dst[len++] = (char)('0' + fp / 10 % 10);
+    dst[len++] = (char)('0' + fp % 10);
+
+    return len;
+}
@@ -0,0 +1,58 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+/*
+ * ============================================================================
+ * Output Writer Function Prototypes
+ * ============================================================================
+ */
+
+/* Bytes buffered between writes */
+#define WRITE_BLOCK (1 << 22)
+
+/**
+ * @brief A sink for the rows x cols values of a result, in row-major order.
+ * Text goes to standard output as printf("%.4f") values separated by commas,
+ * one row per line; binary goes to a .npy file of little-endian float64.
+ * Either way the bytes collect in a WRITE_BLOCK buffer that is written out
+ * with write() whenever it fills.
+ */
+typedef struct out_writer out_writer;
+
+/**
+ * @brief Opens a writer for a rows x cols result.
+ * @param npy_path File to write the result to as .npy, or NULL for text on standard output.
+ * @param rows Number of rows.
+ * @param cols Number of columns.
+ * @return The writer, or NULL if the buffer cannot be allocated or the file cannot be created.
+ */
+out_writer *writer_open(const char *npy_path, int rows, int cols);
+
+/**
+ * @brief Appends the next value of the result, ending the row after every cols values.
+ * @param w The writer.
+ * @param value The value.
+ */
+void writer_value(out_writer *w, double value);
+
+/**
+ * @brief Flushes the buffer, closes the file and frees the writer.
+ * @param w The writer (may be NULL).
+ * @return 0 on success, 1 if any write failed.
+ */
+int writer_close(out_writer *w);
+
+/**
+ * @brief Formats a value exactly as printf("%.4f") would.
+ * Finite values below 10^5 in magnitude take an integer path; the rest, and
+ * the rare products too close to a rounding tie to decide, go to sprintf.
+ * @param dst Output, at least WRITE_VALUE_MAX bytes; not terminated.
+ * @param value The value.
+ * @return Number of characters written.
+ */
+int format_fixed4(char *dst, double value);
+
+/* Longest output of format_fixed4: sign, 309 integer digits, point and 4 decimals */
+#define WRITE_VALUE_MAX 320
+
+#endif
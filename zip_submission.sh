@@ -6,7 +6,7 @@ id2="322634783"
 folder="${id1}_${id2}_project"
 
 mkdir -p "$folder"
-cp symnmf.py symnmf.c symnmfmodule.c symnmf.h symnmfmodule.h analysis.py setup.py kmeans.py Makefile "$folder"/
+cp symnmf.py symnmf.c symnmfmodule.c symnmf.h symnmfmodule.h gemm.c gemm.h parallel.c parallel.h sparse.c sparse.h kdtree.c kdtree.h vmath.c vmath.h packed.c packed.h reader.c reader.h writer.c writer.h rng.c rng.h batch.c batch.h incremental.c incremental.h stats.c stats.h half.c half.h half_real.inc precision.h gemm_real.h gemm_real.inc symnmf_real.h symnmf_real.inc analysis.py setup.py kmeans.py Makefile "$folder"/
 
 tar -czvf "${folder}.tar.gz" "$folder"
 rm -rf "$folder"
\ No newline at end of file